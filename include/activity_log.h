@@ -0,0 +1,76 @@
+#ifndef ACTIVITY_LOG_H
+#define ACTIVITY_LOG_H
+
+#include <Arduino.h>
+#include "card_uid.h"
+
+#define ACTIVITY_LOG_FILE "/activity.bin"
+
+// Records kept in the preallocated circular log file (24 bytes each)
+#define ACTIVITY_LOG_CAPACITY 8192
+
+// Commit when this many records are pending, or the oldest has waited this long
+#define ACTIVITY_LOG_BATCH 16
+#define ACTIVITY_LOG_FLUSH_MS 2000
+
+enum ActivityStatus : uint8_t {
+  ACTIVITY_ALLOWED = 1,
+  ACTIVITY_UNKNOWN = 2,
+};
+
+// Fixed-size on-flash record; seq % capacity gives its slot
+struct ActivityRecord {
+  uint32_t seq;
+  uint32_t time; // epoch seconds, 0 when the clock was not set
+  uint8_t status;
+  uint8_t uidLength;
+  uint8_t uid[CARD_UID_MAX_LEN];
+  uint16_t reserved;
+  uint16_t crc; // CRC-16 over the preceding bytes
+};
+
+struct ActivityLogStats {
+  uint32_t firstSeq;  // oldest readable record
+  uint32_t nextSeq;   // sequence number of the next committed record
+  uint32_t pending;   // queued in RAM, not yet on flash
+  uint32_t dropped;   // lost because the RAM queue was full
+  uint32_t batches;
+  uint32_t lastCommitUs;
+};
+
+// Open or create the log file and recover the write position
+bool activityLogBegin();
+
+// Queue a tap; safe to call from one producer task without touching flash.
+// seq, if given, receives the sequence number the record will be committed under.
+bool activityLogAppend(const CardUid& uid, uint32_t time, ActivityStatus status, uint32_t* seq = nullptr);
+
+// Commit pending records when a batch is due; call periodically from one task
+void activityLogService(unsigned long now);
+
+// Read a committed record; false if seq is out of range or the slot is damaged
+bool activityLogRead(uint32_t seq, ActivityRecord& record);
+
+// Read up to max consecutive records starting at seq with one seek; damaged
+// slots are returned with seq set to 0xFFFFFFFF. Returns the number read.
+size_t activityLogReadRange(uint32_t seq, ActivityRecord* records, size_t max);
+
+// First sequence number whose time is >= time, by binary search over the ring
+uint32_t activityLogSeekTime(uint32_t time);
+
+// Delivery cursor of a log consumer: the first seq it has not yet handed off.
+// Kept in its own small file with a CRC; false if missing or damaged.
+bool activityCursorLoad(const char* path, uint32_t& seq);
+bool activityCursorSave(const char* path, uint32_t seq);
+
+// Drop every committed record
+bool activityLogClear();
+
+const char* activityStatusName(uint8_t status);
+
+// Format a record as the JSON object served by /activities
+size_t activityRecordToJson(const ActivityRecord& record, char* out, size_t cap);
+
+ActivityLogStats activityLogStats();
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef ATTENDANCE_H
+#define ATTENDANCE_H
+
+#include <Arduino.h>
+#include "card_uid.h"
+
+// Cards counted per day; taps of further cards are only in the activity log
+#define ATTENDANCE_MAX_CARDS 256
+#define ATTENDANCE_BUCKETS 512 // power of two
+
+// One card's attendance for the current day
+struct AttendanceEntry {
+  CardUid uid;
+  uint32_t firstTime; // epoch seconds of the first and last tap
+  uint32_t lastTime;
+  uint16_t count;
+};
+
+struct AttendanceStats {
+  uint32_t day;      // days since the epoch in local time being counted, 0 before NTP
+  uint32_t cards;
+  uint32_t taps;     // today, including cards that did not fit
+  uint32_t overflow; // taps of cards that did not fit
+};
+
+void attendanceBegin();
+
+// Count a tap (NFC task). A tap on a new day starts a fresh count.
+// Returns the card's taps today, 0 if the table is full.
+uint16_t attendanceRecord(const CardUid& uid, uint32_t time);
+
+// Copy entries from offset, in first-seen order; returns the number copied
+size_t attendanceRead(size_t offset, AttendanceEntry* out, size_t max);
+
+void attendanceClear();
+
+AttendanceStats attendanceStats();
+
+#endif
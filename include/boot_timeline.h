@@ -0,0 +1,22 @@
+#ifndef BOOT_TIMELINE_H
+#define BOOT_TIMELINE_H
+
+#include <Arduino.h>
+
+#define BOOT_MAX_PHASES 20
+
+// A startup step, in milliseconds since reset
+struct BootPhase {
+  const char* name; // static string
+  uint32_t startMs;
+  uint32_t durationMs;
+};
+
+// Record a phase that began at startMs and ends now; safe from any task.
+// Phases past BOOT_MAX_PHASES are dropped.
+void bootPhaseMark(const char* name, uint32_t startMs);
+
+// Copy the recorded phases in the order they finished; returns the count
+size_t bootPhases(BootPhase* out, size_t max);
+
+#endif
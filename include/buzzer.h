@@ -0,0 +1,50 @@
+#ifndef BUZZER_H
+#define BUZZER_H
+
+#include <Arduino.h>
+#include "config_manager.h"
+
+// LEDC channel and duty resolution for the buzzer tone
+#define BUZZER_LEDC_CHANNEL 0
+#define BUZZER_LEDC_BITS 10
+
+// Sounds waiting behind the one playing; more are dropped
+#define BUZZER_QUEUE_SIZE 4
+
+#define BUZZER_MAX_STEPS 6
+
+enum BuzzerSound : uint8_t {
+  SOUND_NONE,
+  SOUND_TAP,     // any tap; sound.duration long
+  SOUND_ALLOWED,
+  SOUND_UNKNOWN,
+  SOUND_REPEAT,  // card still cooling down
+  SOUND_ERROR,   // tap could not be recorded
+};
+#define BUZZER_SOUND_COUNT 6
+
+// One tone of a pattern; 0 Hz is a pause
+struct ToneStep {
+  uint16_t freqHz;
+  uint16_t ms;
+};
+
+struct BuzzerStats {
+  uint32_t played;
+  uint32_t dropped;      // queue full
+  uint32_t lastQueueUs;  // time buzzerPlay() took, i.e. what a sound costs its caller
+};
+
+// Attach the pin to LEDC and create the step timer
+void buzzerBegin(uint8_t pin, const SoundConfig& config);
+
+// Volume and tap length; safe to call while a sound plays
+void buzzerConfigure(const SoundConfig& config);
+
+// Queue a sound and return at once. The patterns are played by an esp_timer
+// callback, one step per expiry. One producer task only.
+bool buzzerPlay(BuzzerSound sound);
+
+BuzzerStats buzzerStats();
+
+#endif
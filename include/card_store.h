@@ -0,0 +1,114 @@
+#ifndef CARD_STORE_H
+#define CARD_STORE_H
+
+#include <Arduino.h>
+#include "card_uid.h"
+
+// Hashed record store; /cards.txt is only an import/export format
+#define CARDS_DB_FILE "/cards.db"
+#define CARDS_FILE "/cards.txt"
+
+// Slots a resumable listing reads per call (16 bytes each), so a prefix that
+// matches nothing or a deep cursor never reads the whole file at once
+#define CARD_LIST_SCAN_SLOTS 512
+
+// Pre-parsed card settings
+struct CardInfo {
+  uint32_t color;    // packed 0xRRGGBB
+  uint8_t animation; // LedAnimation
+};
+
+// Card fields as text, for listings
+struct CardText {
+  char uid[CARD_UID_HEX_SIZE];
+  char color[8];
+  char animation[16];
+};
+
+// Outcome of the last bulk import
+struct CardImportStats {
+  bool active;
+  bool ok;
+  uint32_t rows;              // non-blank lines seen
+  uint32_t accepted;
+  uint32_t rejected;          // bad uid, color or animation
+  uint32_t duplicates;        // repeated UIDs; the first row wins
+  uint32_t firstRejectedLine; // 1-based, 0 if none
+  uint32_t elapsedMs;         // from begin to swap, including transfer time
+  uint32_t buildMs;
+  uint32_t rowsPerSec;
+};
+
+typedef void (*CardVisitor)(const CardText& card, void* context);
+
+// Position of a listing that is produced a piece at a time
+struct CardListCursor {
+  uint32_t slot;  // next slot to read
+  uint32_t skip;  // matches still to skip (the offset)
+  bool done;
+};
+
+// Store/lookup statistics
+struct CardStoreStats {
+  bool storeReady;
+  bool cacheReady;
+  bool rebuildDue;      // the table needs to grow or compact; cardStoreService() will
+  uint32_t cardCount;
+  uint32_t slotCount;
+  uint32_t tombstones;  // deleted slots awaiting compaction
+  uint32_t cacheBytes;  // RAM held by the card cache
+  uint32_t cacheBudget; // configured limit for the card cache
+  uint32_t lastRebuildMs;
+  uint32_t lastSwapUs;  // store lock held to swap in a rebuilt table and replay edits
+  uint32_t lastLookupUs;
+};
+
+// Open /cards.db (importing /cards.txt the first time) and load the RAM
+// cache when the store fits in cacheBudget bytes
+bool cardStoreBegin(size_t cacheBudget);
+
+// Replace every card with the contents of a "uid,color,animation" CSV file
+bool cardStoreImport(const char* csvPath);
+
+// Streaming bulk import: feed CSV bytes in chunks of any size as they arrive.
+// Rows are validated and staged as records; cardImportEnd() builds the new
+// table and swaps it in. Lookups use the old cards until the swap. Only one
+// import runs at a time; cardImportBegin() is false while another is active.
+bool cardImportBegin();
+void cardImportWrite(const uint8_t* data, size_t len);
+bool cardImportEnd();
+void cardImportAbort();
+const CardImportStats& cardImportStats();
+
+// Look up a card in the RAM cache, or on flash
+bool cardStoreFind(const CardUid& uid, CardInfo& card);
+
+// Add or update one card in place; a UID is only ever stored once. Never
+// rebuilds: a new card is refused while the table is too full, until
+// cardStoreService() has grown it (stats.rebuildDue).
+bool cardStorePut(const CardUid& uid, const CardInfo& card);
+
+// Delete one card by leaving a tombstone; false if it was not stored
+bool cardStoreRemove(const CardUid& uid);
+
+// Grow the table as it fills and compact it once tombstones pile up; call
+// periodically from a task that may block. The new table is built without the
+// store lock, so lookups carry on; edits made meanwhile are replayed into it.
+void cardStoreService();
+
+// Visit cards in slot order whose UID starts with prefix (case-insensitive),
+// skipping the first offset matches and stopping after limit; returns the number visited
+uint32_t cardStoreList(const char* prefix, uint32_t offset, uint32_t limit,
+                       CardVisitor visit, void* context);
+
+// Resumable form of cardStoreList for chunked responses: visit at most max more
+// matches from the cursor and advance it, reading at most CARD_LIST_SCAN_SLOTS
+// slots. Returns 0 with the cursor not done when that ran out first; call again.
+// cursor.slot can be handed to a client to resume from later. A rebuild between
+// calls may reorder slots.
+uint32_t cardStoreListNext(CardListCursor& cursor, const char* prefix, uint32_t max,
+                           CardVisitor visit, void* context);
+
+const CardStoreStats& cardStoreStats();
+
+#endif
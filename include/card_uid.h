@@ -0,0 +1,38 @@
+#ifndef CARD_UID_H
+#define CARD_UID_H
+
+#include <Arduino.h>
+
+// Longest UID readPassiveTargetID can return
+#define CARD_UID_MAX_LEN 10
+
+// Buffer size for a UID as uppercase hex plus terminator
+#define CARD_UID_HEX_SIZE (CARD_UID_MAX_LEN * 2 + 1)
+
+// Packed binary card UID
+struct CardUid {
+  uint8_t length;
+  uint8_t bytes[CARD_UID_MAX_LEN];
+};
+
+// Credentials read from inside a card (NDEF, DESFire file, FeliCa IDm) are
+// keyed as 9 bytes, a length no ISO14443A UID has (4, 7 or 10): a type tag,
+// then 8 identifier bytes, zero padded, or a 64-bit FNV-1a hash when longer
+#define CARD_KEY_TAGGED_LEN 9
+enum CardKeyTag : uint8_t {
+  CARD_KEY_NDEF = 0xF1,
+  CARD_KEY_DESFIRE = 0xF2,
+  CARD_KEY_FELICA = 0xF3,
+};
+
+bool cardUidFromBytes(const uint8_t* bytes, uint8_t length, CardUid& out);
+void cardKeyTagged(CardKeyTag tag, const uint8_t* id, size_t length, CardUid& out);
+bool cardUidFromHex(const char* hex, size_t len, CardUid& out);
+
+// Writes uppercase hex into out (at least CARD_UID_HEX_SIZE bytes)
+void cardUidToHex(const CardUid& uid, char* out);
+
+uint32_t cardUidHash(const CardUid& uid);
+bool cardUidEquals(const CardUid& a, const CardUid& b);
+
+#endif
@@ -3,12 +3,21 @@
 
 #include <Arduino.h>
 
-// Light settings
+#define CONFIG_JSON_FILE "/config.json"
+
+// Validated binary copy of the parsed config, tagged with the size and CRC of
+// the JSON it came from; boot reads it instead of parsing while they match
+#define CONFIG_SNAPSHOT_FILE "/config.bin"
+
+// Bump when DeviceConfig or the schema changes; older snapshots are then rebuilt
+#define CONFIG_SCHEMA_VERSION 5
+
+// Light settings; colors and animations are parsed once at load
 struct LightConfig {
-  String knownDefaultColor;
-  String unknownDefaultColor;
-  String knownCardAnimation;
-  String unknownCardAnimation;
+  uint32_t knownDefaultColor;   // packed 0xRRGGBB
+  uint32_t unknownDefaultColor;
+  uint8_t knownCardAnimation;   // LedAnimation
+  uint8_t unknownCardAnimation;
   int lightDuration;
   int numberOfBlinks;
 };
@@ -23,24 +32,57 @@ struct SoundConfig {
 
 // WiFi settings
 struct WifiConfig {
-  String ssid;
-  String password;
+  char ssid[33];
+  char password[65];
 };
 
 // Server settings
 struct ServerConfig {
-  String address;
+  char address[64];
   int port;
 };
 
 // MQTT settings
 struct MqttConfig {
   bool enable;
-  String host;
+  char host[64];
   int port;
-  String topic;
-  String user;
-  String pass;
+  char topic[96];
+  char user[32];
+  char pass[64];
+};
+
+// Cellular (SIM800) backhaul for event uploads when Wi-Fi is down
+struct CellularConfig {
+  bool enable;
+  char apn[32];
+  int baud;
+};
+
+// PN532 detection: armed once and read when the reader signals a card,
+// through the IRQ pin or by polling its I2C ready byte; or the old blocking poll
+struct NfcConfig {
+  bool eventDriven;
+  int irqPin;      // -1 when IRQ is not wired
+  int readyPollMs; // ready-byte poll interval without an IRQ pin
+  bool felica;     // also look for FeliCa, alternating with ISO14443A
+  bool readNdef;   // opt-in: key NTAG/Ultralight cards by their first NDEF record (not unique, user-writable)
+  int desfireAid;  // key DESFire cards by a free-read file in this application, 0 for the UID
+  int desfireFile;
+};
+
+// Re-tap suppression: a card seen again within its cooldown is not processed
+struct DebounceConfig {
+  int knownCooldownMs;
+  int unknownCooldownMs; // also for modes that do not look cards up
+};
+
+// Mode 2 decision cache. Decisions are served for their TTL, then for the stale
+// window while a background request refreshes them; 0 TTL does not cache.
+struct VerifyConfig {
+  int allowTtlSec;
+  int denyTtlSec;  // negative caching
+  int staleSec;
 };
 
 // IOT settings
@@ -48,22 +90,88 @@ struct IotConfig {
   bool enabled;
 };
 
-// Full device config
+// Full device config. Plain data: no heap, copyable, and stored as is in the snapshot.
 struct DeviceConfig {
-  String deviceName;
+  char deviceName[33];
   int ledBrightness;
   int mode;
-  String hotspotPassword;
+  char hotspotPassword[65];
+  int cardCacheBytes; // RAM budget for the card cache, 0 disables it
   LightConfig light;
   SoundConfig sound;
   WifiConfig wifi;
   ServerConfig server;
   MqttConfig mqtt;
+  CellularConfig cellular;
+  NfcConfig nfc;
+  DebounceConfig debounce;
+  VerifyConfig verify;
   IotConfig iot;
 };
 
-// Function declarations
+// Parts of the config that can change independently, as bits of a diff
+enum ConfigSection : uint16_t {
+  CONFIG_IDENTITY = 1 << 0,   // deviceName, hotspotPassword
+  CONFIG_LEDS = 1 << 1,       // ledBrightness, light
+  CONFIG_MODE = 1 << 2,
+  CONFIG_SOUND = 1 << 3,
+  CONFIG_WIFI = 1 << 4,
+  CONFIG_SERVER = 1 << 5,
+  CONFIG_MQTT = 1 << 6,
+  CONFIG_CELLULAR = 1 << 7,
+  CONFIG_CARD_CACHE = 1 << 8,
+  CONFIG_IOT = 1 << 9,
+  CONFIG_NFC = 1 << 10,
+  CONFIG_DEBOUNCE = 1 << 11,
+  CONFIG_VERIFY = 1 << 12,
+};
+#define CONFIG_SECTION_COUNT 13
+
+enum ConfigFieldType : uint8_t {
+  CONFIG_BOOL,      // JSON true/false or a number
+  CONFIG_INT,       // in [min, max]; decimal, or "0x..." hex as a JSON string
+  CONFIG_STRING,    // truncated to the field size
+  CONFIG_COLOR,     // "#RRGGBB"/"#RGB" into packed RGB
+  CONFIG_ANIMATION, // animation name into LedAnimation
+};
+
+// One config field: where it lives in JSON and in DeviceConfig, and its default.
+// Defaults are written as JSON text would be and go through the same parsing.
+struct ConfigField {
+  const char* section; // nullptr for top-level keys
+  const char* key;
+  ConfigFieldType type;
+  uint16_t group;      // ConfigSection
+  uint16_t offset;
+  uint16_t size;
+  int32_t min;
+  int32_t max;
+  const char* defaultValue;
+};
+
+extern const ConfigField configSchema[];
+extern const size_t configSchemaSize;
+
+struct ConfigLoadStats {
+  const char* source;   // "snapshot", "json" or "none"
+  uint32_t loadUs;      // whole loadDeviceConfig(), including the JSON check
+  int32_t heapDelta;    // free heap before minus after
+  uint32_t jsonBytes;
+  uint16_t invalidFields; // out of range or unparsable, replaced by the default
+};
+
+// Every field at its schema default
+void defaultDeviceConfig(DeviceConfig &config);
+
+// Load from the snapshot when it matches config.json, otherwise parse the JSON
+// and rewrite the snapshot. False if there is no config.json.
 bool loadDeviceConfig(DeviceConfig &config);
 void printDeviceConfig(const DeviceConfig &config);
 
+const ConfigLoadStats& configLoadStats();
+
+// ConfigSection bits for every section that differs between a and b
+uint16_t diffDeviceConfig(const DeviceConfig &a, const DeviceConfig &b);
+const char *configSectionName(uint16_t section);
+
 #endif
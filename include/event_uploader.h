@@ -0,0 +1,65 @@
+#ifndef EVENT_UPLOADER_H
+#define EVENT_UPLOADER_H
+
+#include <Arduino.h>
+#include "activity_log.h"
+#include "config_manager.h"
+
+// First seq the server has not acknowledged
+#define UPLOAD_CURSOR_FILE "/upload.cur"
+#define UPLOAD_PATH "/events"
+#define UPLOAD_CONTENT_TYPE "application/x-jastap-batch"
+#define UPLOAD_MAX_TRANSPORTS 3
+
+// Records per POST, and how long a partial batch may wait for more
+#define UPLOAD_BATCH 64
+#define UPLOAD_LINGER_MS 3000
+
+#define UPLOAD_TIMEOUT_MS 5000
+#define UPLOAD_BACKOFF_MIN_MS 1000
+#define UPLOAD_BACKOFF_MAX_MS 300000
+
+// Batch body (application/x-jastap-batch), little endian:
+//   "JTB" 0x01, device name length (u8) and bytes, record count (u16),
+//   then per record: seq delta and zigzag time delta as varints against
+//   the previous record (the first against 0), (status << 4) | uid length,
+//   uid bytes.
+// A tap usually costs 8-13 bytes instead of ~100 as JSON.
+
+// A way to POST a batch to http://host:port UPLOAD_PATH. start() may finish the
+// request before returning (Wi-Fi) or leave it running for poll() (cellular).
+struct UploadTransport {
+  const char* name;
+  bool (*available)();
+  bool (*start)(const char* host, uint16_t port, const uint8_t* body, size_t len);
+  int (*poll)(); // 0 while running, then the HTTP status or a negative error
+};
+
+struct UploadStats {
+  bool enabled;
+  const char* transport;   // used for the last batch
+  uint32_t events;         // acknowledged by the server
+  uint32_t batches;
+  uint32_t failures;
+  int lastStatus;          // HTTP status or HTTPClient error of the last POST
+  uint32_t backlog;        // logged taps not yet acknowledged
+  uint32_t lost;           // overwritten in the log before they could be sent
+  uint32_t eventsPerSec;   // over the last measurement window
+  uint32_t lastBatchBytes;
+  uint32_t lastBatchMs;    // start of the POST to its status
+  uint32_t backoffMs;
+};
+
+// (Re)start with the server settings; an empty address disables uploads.
+// Call after activityLogBegin().
+void eventUploaderBegin(const ServerConfig& config, const char* deviceName);
+
+// Add a fallback transport, tried in order after Wi-Fi; call before the service starts
+void eventUploaderAddTransport(const UploadTransport* transport);
+
+// Send the next batch when one is due; a Wi-Fi POST blocks, so call from its own task
+void eventUploaderService(unsigned long now);
+
+UploadStats eventUploaderStats();
+
+#endif
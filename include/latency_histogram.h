@@ -0,0 +1,25 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <Arduino.h>
+
+// Log2 buckets: bucket 0 is below LATENCY_BUCKET0_US, each next one doubles,
+// and the last also takes everything above (about 2 s)
+#define LATENCY_BUCKETS 16
+#define LATENCY_BUCKET0_US 128
+
+struct LatencyHistogram {
+  uint32_t counts[LATENCY_BUCKETS];
+  uint32_t total;
+  uint32_t maxUs;
+};
+
+void latencyRecord(LatencyHistogram& h, uint32_t us);
+
+// Upper bound of the bucket holding the given percentile, 0 when empty
+uint32_t latencyPercentile(const LatencyHistogram& h, uint8_t percent);
+
+// Exclusive upper bound of a bucket, in microseconds
+uint32_t latencyBucketLimit(uint8_t bucket);
+
+#endif
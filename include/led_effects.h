@@ -3,6 +3,46 @@
 
 #include <Adafruit_NeoPixel.h>
 
-void showSolidEffect(uint32_t color, unsigned long durationMs, Adafruit_NeoPixel& strip);
+// Longest ring the engine renders
+#define LED_MAX_PIXELS 64
+
+// Frame budget: at most one rendered frame per LED_FRAME_MS
+#define LED_FRAME_MS 20
+
+// Card/default animations by config name
+enum LedAnimation : uint8_t {
+  LED_ANIM_NONE = 0,
+  LED_ANIM_SOLID,
+  LED_ANIM_BLINK,
+  LED_ANIM_PULSE,
+  LED_ANIM_SPIN,
+  LED_ANIM_RAINBOW,
+};
+
+// Parse "#RRGGBB" / "#RGB" into packed 0xRRGGBB (black if invalid)
+uint32_t parseColor(const char* hex, size_t len);
+LedAnimation parseAnimation(const char* name, size_t len);
+// Strict checks for imports: "#RRGGBB"/"#RGB" ('#' optional) and known names incl. "none"
+bool isValidColor(const char* hex, size_t len);
+bool isValidAnimation(const char* name, size_t len);
+// Name as used in cards.txt ("none" for LED_ANIM_NONE)
+const char* animationName(uint8_t animation);
+
+// Frame-based effect engine. Effects are advanced by ledEffectTick() from
+// loop() and never block; frames are rendered into an internal buffer that
+// ledEffectShow() pushes to the strip.
+void ledEngineBegin(uint16_t numPixels, uint8_t brightness);
+void ledEngineSetBrightness(uint8_t brightness);
+
+// durationMs == 0 plays until ledEffectStop(); cycles sets blink/pulse count
+void ledEffectStart(LedAnimation animation, uint32_t color, unsigned long durationMs,
+                    uint8_t cycles, unsigned long now);
+void ledEffectStop();
+bool ledEffectActive();
+
+// Renders a frame if one is due; returns true when the frame buffer changed
+bool ledEffectTick(unsigned long now);
+const uint32_t* ledFrame();
+void ledEffectShow(Adafruit_NeoPixel& strip);
 
 #endif
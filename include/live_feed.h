@@ -0,0 +1,49 @@
+#ifndef LIVE_FEED_H
+#define LIVE_FEED_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include "activity_log.h"
+
+// Server-Sent Events endpoint. Events:
+//   tap     a card was read; logged taps carry id = log seq + 1
+//   log     the activity log was cleared
+//   status  the device status digest, when it changes or as a heartbeat
+// A browser reconnecting with Last-Event-ID gets the logged taps it missed.
+#define LIVE_FEED_PATH "/live"
+
+#define LIVE_FEED_MAX_CLIENTS 4
+#define LIVE_FEED_REPLAY_MAX 32      // logged taps replayed on reconnect
+#define LIVE_FEED_STATUS_MS 1000     // how often the status digest is rebuilt
+#define LIVE_FEED_HEARTBEAT_MS 15000 // status is re-sent at least this often
+#define LIVE_FEED_SLOW_QUEUE 4       // average queued messages per client before status is held back
+
+// Writes the status digest as a JSON object; returns its length
+typedef size_t (*LiveStatusFn)(char* out, size_t cap);
+
+struct LiveFeedStats {
+  uint32_t clients;
+  uint32_t connects;
+  uint32_t rejected;    // over LIVE_FEED_MAX_CLIENTS
+  uint32_t events;      // sent to at least one client
+  uint32_t dropped;     // tap queue full
+  uint32_t deferred;    // status updates held back while clients were slow
+  uint32_t replayed;
+};
+
+// Register LIVE_FEED_PATH on the server; call before server.begin()
+void liveFeedBegin(AsyncWebServer& server, LiveStatusFn status);
+
+// Hand a tap to the feed; called by the NFC task only. Never blocks or allocates.
+// logged says whether seq is a real activity log sequence number.
+void liveFeedTap(const CardUid& uid, uint32_t time, ActivityStatus status, bool logged, uint32_t seq);
+
+// Tell clients the activity log was cleared; safe from any task
+void liveFeedLogCleared();
+
+// Send queued events and the status digest; call periodically from one task
+void liveFeedService(unsigned long now);
+
+LiveFeedStats liveFeedStats();
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef MQTT_PACKET_H
+#define MQTT_PACKET_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Minimal MQTT 3.1.1 codec: just what a QoS 1 publisher needs. Plain C++ with
+// no Arduino dependencies, so it builds on a host as well.
+
+enum MqttPacketType : uint8_t {
+  MQTT_CONNECT = 1,
+  MQTT_CONNACK = 2,
+  MQTT_PUBLISH = 3,
+  MQTT_PUBACK = 4,
+  MQTT_PINGREQ = 12,
+  MQTT_PINGRESP = 13,
+  MQTT_DISCONNECT = 14,
+};
+
+// Encoders write into out and return the packet length, or 0 if it does not fit.
+// user/pass may be null or empty to leave them out.
+size_t mqttEncodeConnect(uint8_t* out, size_t cap, const char* clientId, const char* user,
+                         const char* pass, uint16_t keepAliveSec);
+size_t mqttEncodePublish(uint8_t* out, size_t cap, const char* topic, uint16_t packetId,
+                         const uint8_t* payload, size_t payloadLen, bool dup);
+size_t mqttEncodePingReq(uint8_t* out, size_t cap);
+size_t mqttEncodeDisconnect(uint8_t* out, size_t cap);
+
+// Incremental reader for broker packets. Bodies longer than the buffer are
+// consumed but truncated; the packets a publisher acts on are all tiny.
+struct MqttReader {
+  uint8_t type;          // MqttPacketType of the completed packet
+  uint8_t flags;         // low nibble of the fixed header
+  uint32_t length;       // remaining length
+  uint8_t body[8];
+  uint32_t received;
+  uint8_t state;
+  uint8_t lengthShift;
+};
+
+void mqttReaderReset(MqttReader& reader);
+
+// Feed one byte; true when it completed a packet (read type/body, then keep feeding)
+bool mqttReaderFeed(MqttReader& reader, uint8_t byte);
+
+// Packet id of a completed PUBACK, return code of a completed CONNACK
+uint16_t mqttPacketId(const MqttReader& reader);
+uint8_t mqttConnackCode(const MqttReader& reader);
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef MQTT_PUBLISHER_H
+#define MQTT_PUBLISHER_H
+
+#include <Arduino.h>
+#include "activity_log.h"
+#include "config_manager.h"
+
+// The activity log is the outbox: this file holds the first seq not yet acknowledged
+#define MQTT_CURSOR_FILE "/mqtt.cur"
+
+// QoS 1 publishes awaiting PUBACK
+#define MQTT_MAX_INFLIGHT 8
+
+#define MQTT_KEEPALIVE_S 30
+#define MQTT_ACK_TIMEOUT_MS 20000
+#define MQTT_CURSOR_SAVE_MS 5000
+#define MQTT_BACKOFF_MIN_MS 1000
+#define MQTT_BACKOFF_MAX_MS 60000
+
+struct MqttStats {
+  bool enabled;
+  bool connected;
+  uint32_t connects;
+  uint32_t published;     // PUBLISH packets sent, including resends
+  uint32_t acked;
+  uint32_t lost;          // overwritten in the log before they could be sent
+  uint32_t liveDropped;   // live queue full; these are sent from the log instead
+  uint32_t backlog;       // committed or queued taps not yet acknowledged
+  uint32_t inflight;
+  uint32_t lastLatencyMs; // tap (or send, for backlog) to PUBACK
+  uint32_t maxLatencyMs;
+};
+
+// (Re)start the publisher with a config; disabled configs just stop it.
+// Call after activityLogBegin().
+void mqttPublisherBegin(const MqttConfig& config, const char* deviceName);
+
+// Hand a logged tap to the publisher for immediate sending; called by the NFC
+// task with the seq from activityLogAppend(). Never blocks or allocates.
+void mqttPublishTap(uint32_t seq, const CardUid& uid, uint32_t time, ActivityStatus status);
+
+// Connect, send and process acknowledgements; call periodically from one task
+void mqttPublisherService(unsigned long now);
+
+MqttStats mqttPublisherStats();
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef NFC_READER_H
+#define NFC_READER_H
+
+#include <Arduino.h>
+#include <Adafruit_PN532.h>
+#include "card_uid.h"
+#include "config_manager.h"
+
+// An armed detection is re-sent after this long without a card, in case the
+// reader lost it (brown-out, bus glitch)
+#define NFC_REARM_MS 30000
+
+// Blocking wait for a card in the legacy poll mode
+#define NFC_POLL_TIMEOUT_MS 100
+
+// Utilization figures are per window
+#define NFC_STATS_WINDOW_MS 5000
+
+// Limits for the reads that follow a detection
+#define NFC_EXCHANGE_TIMEOUT_MS 50
+#define NFC_NDEF_MAX_BYTES 64     // pages 4..19 of an NTAG/Ultralight
+#define NFC_DESFIRE_READ_LEN 16   // read from the start of the DESFire file, which must be at least this long
+
+// Passive activation retries per armed search while FeliCa alternates with
+// ISO14443A; 0xFF (the default otherwise) waits for a card indefinitely
+#define NFC_ALTERNATE_RETRIES 0x20
+
+enum NfcDetectMode : uint8_t {
+  NFC_DETECT_POLL,  // InListPassiveTarget + readPassiveTargetID every call
+  NFC_DETECT_IRQ,   // armed once, read on the falling edge of the IRQ pin
+  NFC_DETECT_READY, // armed once, read when the I2C status byte says ready
+};
+
+// Card families told apart by ATQA/SAK (or the FeliCa polling response)
+enum NfcCardType : uint8_t {
+  NFC_CARD_UNKNOWN,        // ISO14443A that matches nothing below, or read in poll mode
+  NFC_CARD_MIFARE_CLASSIC,
+  NFC_CARD_NTAG,           // NTAG21x / Ultralight
+  NFC_CARD_DESFIRE,
+  NFC_CARD_ISO_DEP,        // other ISO14443-4 cards, e.g. phones and bank cards
+  NFC_CARD_FELICA,
+};
+#define NFC_CARD_TYPE_COUNT 6
+
+// What a detection produced. key is what the card store and log see: the UID,
+// or a tagged key (card_uid.h) when an identifier was read from inside the card.
+struct NfcCredential {
+  CardUid key;
+  CardUid uid;     // UID, or the IDm for FeliCa
+  uint8_t type;    // NfcCardType
+  uint16_t atqa;
+  uint8_t sak;
+};
+
+// Per card type: card ready to credential read, including the type-specific reads
+struct NfcTypeStats {
+  uint32_t reads;
+  uint32_t fallbacks;  // type read failed, keyed by the UID instead
+  uint32_t lastUs;
+  uint32_t maxUs;
+};
+
+struct NfcReaderStats {
+  uint8_t mode;            // NfcDetectMode
+  uint32_t arms;
+  uint32_t rearms;         // re-sent after NFC_REARM_MS without a card
+  uint32_t detections;
+  uint32_t lastLatencyUs;  // card ready (IRQ edge, ready byte, or poll start) to credential read
+  uint32_t maxLatencyUs;
+  uint32_t callsPerSec;    // reader transactions issued, last window
+  uint32_t busyPermille;   // share of the window spent blocked in reader calls
+};
+
+// Talk to the reader with the given detection settings; false if it does not answer
+bool nfcReaderBegin(Adafruit_PN532& reader, const NfcConfig& config);
+
+// Check for a card without blocking (except in poll mode and the short reads
+// after a detection); true with its credential when one was read.
+// A detection is re-armed on the next call.
+bool nfcReaderPoll(NfcCredential& credential, unsigned long now);
+
+// Drop the armed detection, e.g. while taps are ignored; the next poll re-arms
+void nfcReaderIdle();
+
+const char* nfcDetectModeName(uint8_t mode);
+const char* nfcCardTypeName(uint8_t type);
+
+NfcReaderStats nfcReaderStats();
+NfcTypeStats nfcTypeStats(uint8_t type);
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef ONLINE_VERIFY_H
+#define ONLINE_VERIFY_H
+
+#include <Arduino.h>
+#include "card_uid.h"
+#include "config_manager.h"
+#include "latency_histogram.h"
+
+// GET http://host:port VERIFY_PATH?device=<name>&uid=<hex>
+// 200 allows the card, 403 or 404 denies it; anything else is an error and
+// the tap falls back to the local card store. A "Cache-Control: max-age=<s>"
+// header overrides the configured TTL for caching that answer.
+#define VERIFY_PATH "/verify"
+#define VERIFY_TIMEOUT_MS 1500
+
+// Requests waiting for the verify task; a tap that does not fit is decided locally
+#define VERIFY_QUEUE_SIZE 8
+
+enum VerifyDecision : uint8_t {
+  VERIFY_ALLOW,
+  VERIFY_DENY,
+  VERIFY_ERROR, // no answer, or one that is neither allow nor deny
+};
+
+struct VerifyResult {
+  CardUid uid;
+  uint32_t time;     // tap time, carried through
+  uint32_t startUs;  // tap read, carried through
+  bool refresh;      // background refresh of a cached decision, no tap waiting
+  uint8_t decision;  // VerifyDecision
+  uint32_t ttlMs;    // from max-age, 0 when the server gave none
+  int httpStatus;    // or an HTTPClient error
+};
+
+struct OnlineVerifyStats {
+  bool enabled;
+  uint32_t requests;
+  uint32_t allowed;
+  uint32_t denied;
+  uint32_t errors;
+  uint32_t dropped;     // queue full
+  int lastStatus;
+  uint32_t lastRequestMs;
+  LatencyHistogram roundTrip; // server requests only
+};
+
+// (Re)start with the server settings; an empty address disables verification
+void onlineVerifyBegin(const ServerConfig& config, const char* deviceName);
+
+// True while a request has a chance: a server is configured and Wi-Fi is up
+bool onlineVerifyAvailable();
+
+// NFC task: queue a card for the verify task; false when the queue is full
+bool onlineVerifyRequest(const CardUid& uid, uint32_t time, uint32_t startUs, bool refresh);
+
+// NFC task: take the next finished request
+bool onlineVerifyResult(VerifyResult& result);
+
+// Verify task: run queued requests; the HTTP round trip blocks, so call from its own task
+void onlineVerifyService(unsigned long now);
+
+OnlineVerifyStats onlineVerifyStats();
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef SIM800_MODEM_H
+#define SIM800_MODEM_H
+
+#include <Arduino.h>
+#include "event_uploader.h"
+
+#define MODEM_LINE_MAX 96
+#define MODEM_CMD_TIMEOUT_MS 2000
+#define MODEM_REG_POLL_MS 2000
+#define MODEM_REG_TIMEOUT_MS 60000
+#define MODEM_BEARER_TIMEOUT_MS 85000 // SAPBR=1,1 may take this long
+#define MODEM_ACTION_TIMEOUT_MS 60000
+#define MODEM_RESET_BACKOFF_MS 10000
+#define MODEM_PROBE_ATTEMPTS 10
+
+// Negative results of modemHttpResult()
+#define MODEM_RESULT_ERROR -1
+#define MODEM_RESULT_TIMEOUT -2
+
+// Driver states; commands are written on entry and the state advances on
+// the final result code, so nothing ever waits with delay()
+enum ModemState : uint8_t {
+  MODEM_OFF = 0,
+  MODEM_PROBE,         // AT until the modem answers
+  MODEM_ECHO_OFF,      // ATE0
+  MODEM_SIGNAL,        // AT+CSQ
+  MODEM_REGISTRATION,  // AT+CREG? until home or roaming
+  MODEM_ATTACH,        // AT+CGATT? until attached
+  MODEM_BEARER_TYPE,   // AT+SAPBR=3,1,"CONTYPE","GPRS"
+  MODEM_BEARER_APN,    // AT+SAPBR=3,1,"APN",<apn>
+  MODEM_BEARER_OPEN,   // AT+SAPBR=1,1
+  MODEM_BEARER_QUERY,  // AT+SAPBR=2,1
+  MODEM_HTTP_TERM,     // AT+HTTPTERM, clearing a session left by a reset
+  MODEM_HTTP_INIT,     // AT+HTTPINIT
+  MODEM_HTTP_CID,      // AT+HTTPPARA="CID",1
+  MODEM_READY,         // bearer and HTTP service up, idle
+  MODEM_HTTP_URL,      // AT+HTTPPARA="URL",... (skipped when unchanged)
+  MODEM_HTTP_CONTENT,  // AT+HTTPPARA="CONTENT",...
+  MODEM_HTTP_DATA,     // AT+HTTPDATA=<len>,<ms>, waits for DOWNLOAD
+  MODEM_HTTP_BODY,     // raw body written, waits for OK
+  MODEM_HTTP_ACTION,   // AT+HTTPACTION=1, waits for the +HTTPACTION URC
+  MODEM_RESET_WAIT,    // backing off before probing again
+};
+
+struct ModemStats {
+  uint8_t state;
+  int8_t rssi;          // AT+CSQ value, 99 if unknown
+  bool registered;
+  bool bearerUp;
+  uint32_t resets;      // times the bring-up started over
+  uint32_t requests;
+  uint32_t failures;
+  int lastStatus;       // HTTP status of the last request, or a negative error
+  uint32_t lastRequestMs;
+  uint32_t bringUpMs;   // probe to ready
+};
+
+// Start driving the modem on serial (already begun at the modem's baud rate)
+void modemBegin(Stream& serial, const char* apn);
+
+// Consume modem output and advance the state machine; call periodically from one task
+void modemService(unsigned long now);
+
+// Bearer and HTTP service are up and no request is running
+bool modemReady();
+
+// Start an HTTP POST; body must stay valid until modemHttpResult() is non-zero.
+// The URL is only resent to the modem when it changes.
+bool modemHttpPost(const char* url, const char* contentType, const uint8_t* body, size_t len);
+
+// 0 while the request is running, then the HTTP status or a negative error
+int modemHttpResult();
+
+const char* modemStateName(uint8_t state);
+
+ModemStats modemStats();
+
+// Event upload over the modem's HTTP service, for sites without Wi-Fi
+extern const UploadTransport cellularTransport;
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef TAP_DEBOUNCE_H
+#define TAP_DEBOUNCE_H
+
+#include <Arduino.h>
+#include "card_uid.h"
+#include "config_manager.h"
+
+// Recently accepted cards; the least recently seen one is evicted when full
+#define TAP_DEBOUNCE_SLOTS 16
+#define TAP_DEBOUNCE_BUCKETS 32 // power of two
+
+// A card held on the reader is seen over and over; repeat feedback is
+// given at most this often per card
+#define TAP_REPEAT_FEEDBACK_MS 1000
+
+enum TapVerdict : uint8_t {
+  TAP_ACCEPT,          // new card, or its cooldown ran out
+  TAP_REPEAT,          // suppressed, with feedback due
+  TAP_REPEAT_SILENT,   // suppressed, feedback already given recently
+};
+
+struct TapDebounceStats {
+  uint32_t accepted;
+  uint32_t suppressed;
+  uint32_t feedbacks;   // suppressed taps that got repeat feedback
+  uint32_t evictions;   // entries dropped while still cooling down
+  uint32_t entries;
+};
+
+// Empty table with the configured cooldowns; call before the first check
+void tapDebounceBegin(const DebounceConfig& config);
+
+// New cooldowns, also for the cards already in the table
+void tapDebounceConfigure(const DebounceConfig& config);
+
+// Check a tap against the table. A suppressed card's cooldown restarts, so a
+// card left on the reader stays suppressed until it has been away for a cooldown.
+TapVerdict tapDebounceCheck(const CardUid& uid, unsigned long now);
+
+// Record an accepted tap; status (ActivityStatus) picks the cooldown
+void tapDebounceAccept(const CardUid& uid, uint8_t status, unsigned long now);
+
+const TapDebounceStats& tapDebounceStats();
+
+#endif
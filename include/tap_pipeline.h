@@ -0,0 +1,56 @@
+#ifndef TAP_PIPELINE_H
+#define TAP_PIPELINE_H
+
+#include <Arduino.h>
+#include "card_uid.h"
+#include "latency_histogram.h"
+
+// Device modes, config "mode" 0..3
+#define TAP_MODE_COUNT 4
+
+// An accepted (debounced) tap, as handed to the mode's handler
+struct TapEvent {
+  CardUid uid;
+  uint8_t cardType;     // NfcCardType
+  uint32_t time;        // epoch seconds, 0 before NTP
+  unsigned long nowMs;
+  uint32_t startUs;     // card read, where the handler latency starts
+};
+
+enum TapOutcome : uint8_t {
+  TAP_DONE,     // decided and feedback queued
+  TAP_PENDING,  // decided later; the handler calls tapPipelineDone()
+};
+
+// One mode's tap handling, all on the NFC task. handle() runs for each tap while
+// the mode is selected; service() runs every NFC loop for every registered handler,
+// so work left pending by a mode that was switched away from still completes.
+struct TapHandler {
+  const char* name;
+  TapOutcome (*handle)(const TapEvent& tap);
+  void (*service)(unsigned long now);        // may be null
+};
+
+struct TapHandlerStats {
+  const char* name;
+  uint32_t taps;
+  uint32_t pending;          // handed off and not decided yet
+  LatencyHistogram latency;  // card read to decision
+};
+
+// Register before the NFC task starts
+void tapPipelineRegister(uint8_t mode, const TapHandler* handler);
+
+// Switch the active handler; false for a mode without one
+bool tapPipelineSelect(uint8_t mode);
+uint8_t tapPipelineMode();
+
+void tapPipelineHandle(const TapEvent& tap);
+void tapPipelineService(unsigned long now);
+
+// A TAP_PENDING tap of this handler was decided
+void tapPipelineDone(const TapHandler* handler, uint32_t startUs);
+
+bool tapPipelineStats(uint8_t mode, TapHandlerStats& out);
+
+#endif
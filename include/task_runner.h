@@ -0,0 +1,29 @@
+#ifndef TASK_RUNNER_H
+#define TASK_RUNNER_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// A periodic FreeRTOS task and its loop timing
+struct AppTask {
+  const char* name;
+  void (*body)();
+  TaskHandle_t handle;
+  uint32_t stackSize;
+  uint32_t periodMs;
+  BaseType_t core;
+  volatile uint32_t loops;
+  volatile uint32_t lastPeriodUs; // start-to-start time of the last iteration
+  volatile uint32_t maxPeriodUs;
+  volatile uint32_t maxBusyUs;    // longest single call to body
+};
+
+// Run body every periodMs on the given core
+bool startAppTask(AppTask& task, const char* name, void (*body)(), uint32_t stackSize,
+                  UBaseType_t priority, BaseType_t core, uint32_t periodMs);
+
+// Minimum free stack seen so far, in bytes
+uint32_t appTaskStackFree(const AppTask& task);
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef VERIFY_CACHE_H
+#define VERIFY_CACHE_H
+
+#include <Arduino.h>
+#include "card_uid.h"
+#include "config_manager.h"
+
+// Server decisions kept for mode 2; the least recently used one is evicted when full
+#define VERIFY_CACHE_SLOTS 128
+#define VERIFY_CACHE_BUCKETS 256 // power of two
+
+// A fresh entry is refreshed in the background once this share of its TTL has passed
+#define VERIFY_REFRESH_AHEAD_PERCENT 75
+
+enum VerifyCacheState : uint8_t {
+  VERIFY_CACHE_MISS,
+  VERIFY_CACHE_FRESH,  // within its TTL
+  VERIFY_CACHE_STALE,  // past its TTL but within the stale window; served while refreshed
+};
+
+struct VerifyCacheStats {
+  uint32_t hits;        // fresh
+  uint32_t staleHits;
+  uint32_t misses;
+  uint32_t refreshes;   // background refreshes started
+  uint32_t evictions;   // entries dropped before they expired
+  uint32_t entries;
+};
+
+// TTLs from the config; drops every entry. NFC task only, like the rest.
+void verifyCacheBegin(const VerifyConfig& config);
+
+// Look a card up. When canRefresh is set and the entry is due, refresh is set
+// and the entry is marked as being refreshed until verifyCacheStore() or
+// verifyCacheRefreshFailed() for it.
+VerifyCacheState verifyCacheLookup(const CardUid& uid, unsigned long now, bool canRefresh,
+                                   bool& allow, bool& refresh);
+
+// Keep a server decision; ttlMs 0 takes the configured TTL for allow or deny,
+// and a decision whose TTL is still 0 is not cached
+void verifyCacheStore(const CardUid& uid, bool allow, uint32_t ttlMs, unsigned long now);
+
+// The refresh could not be sent or got no usable answer; the entry is kept as it was
+void verifyCacheRefreshFailed(const CardUid& uid);
+
+const VerifyCacheStats& verifyCacheStats();
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef WEB_UI_H
+#define WEB_UI_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+// A page from web/, gzipped into flash at build time by scripts/embed_web.py
+struct WebAsset {
+  const char* name;
+  const char* contentType;
+  const uint8_t* data;
+  size_t length;
+  const char* etag; // quoted, from the uncompressed content
+};
+
+struct WebUiStats {
+  uint32_t served;        // full responses
+  uint32_t notModified;   // 304s for a matching If-None-Match
+  uint32_t lastServeUs;   // handler entry until the response was queued
+  int32_t lastHeapDelta;  // free heap before minus after
+};
+
+// Send an embedded asset straight from flash with Content-Encoding: gzip,
+// or 304 when the client already has it; false if there is no such asset
+bool serveWebAsset(AsyncWebServerRequest* request, const char* name);
+
+const WebUiStats& webUiStats();
+
+#endif
@@ -0,0 +1,79 @@
+# Gzip the static web UI in web/ into include/web_assets.h as PROGMEM arrays.
+# Runs before every PlatformIO build (extra_scripts = pre:...), or by hand:
+#   python scripts/embed_web.py
+import gzip
+import hashlib
+import os
+
+try:
+    Import("env")  # noqa: F821 - provided by PlatformIO
+    PROJECT_DIR = env["PROJECT_DIR"]  # noqa: F821
+except NameError:
+    PROJECT_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+WEB_DIR = os.path.join(PROJECT_DIR, "web")
+OUT_FILE = os.path.join(PROJECT_DIR, "include", "web_assets.h")
+
+CONTENT_TYPES = {
+    ".html": "text/html",
+    ".js": "application/javascript",
+    ".css": "text/css",
+    ".svg": "image/svg+xml",
+    ".ico": "image/x-icon",
+}
+
+
+def symbol(name):
+    return "web_" + "".join(c if c.isalnum() else "_" for c in name)
+
+
+def render():
+    lines = [
+        "// Generated by scripts/embed_web.py from web/; do not edit",
+        "#ifndef WEB_ASSETS_H",
+        "#define WEB_ASSETS_H",
+        "",
+        '#include "web_ui.h"',
+        "",
+    ]
+    entries = []
+    for name in sorted(os.listdir(WEB_DIR)):
+        ext = os.path.splitext(name)[1]
+        if ext not in CONTENT_TYPES:
+            continue
+        with open(os.path.join(WEB_DIR, name), "rb") as f:
+            raw = f.read()
+        packed = gzip.compress(raw, 9, mtime=0)
+        etag = '\\"%s\\"' % hashlib.sha1(raw).hexdigest()[:16]
+        sym = symbol(name)
+
+        lines.append("// %s: %d bytes, %d gzipped" % (name, len(raw), len(packed)))
+        lines.append("static const uint8_t %s[] PROGMEM = {" % sym)
+        for i in range(0, len(packed), 16):
+            lines.append("  " + ", ".join("0x%02x" % b for b in packed[i:i + 16]) + ",")
+        lines.append("};")
+        lines.append("")
+        entries.append('  {"%s", "%s", %s, sizeof(%s), "%s"},' % (name, CONTENT_TYPES[ext], sym, sym, etag))
+
+    lines.append("static const WebAsset webAssets[] = {")
+    lines.extend(entries)
+    lines.append("};")
+    lines.append("")
+    lines.append("#endif")
+    return "\n".join(lines) + "\n"
+
+
+def main():
+    text = render()
+    try:
+        with open(OUT_FILE) as f:
+            if f.read() == text:
+                return  # unchanged; keep the timestamp so nothing rebuilds
+    except OSError:
+        pass
+    with open(OUT_FILE, "w") as f:
+        f.write(text)
+    print("embed_web: wrote %s" % os.path.relpath(OUT_FILE, PROJECT_DIR))
+
+
+main()
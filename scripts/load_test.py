@@ -0,0 +1,95 @@
+"""Hammer the device's HTTP server with concurrent clients and report
+throughput and latency percentiles.
+
+    python scripts/load_test.py 192.168.4.1 --clients 8 --seconds 20
+    python scripts/load_test.py 192.168.4.1 --path /status --path /cards?limit=50
+
+The HTTP layer runs on ESPAsyncWebServer and AsyncTCP, which have no host
+build, so this targets a device (its soft AP is 192.168.4.1).
+"""
+import argparse
+import http.client
+import threading
+import time
+
+DEFAULT_PATHS = ["/status", "/lastuid", "/", "/cards?limit=20", "/activities?limit=20"]
+
+
+def percentile(sorted_values, p):
+    if not sorted_values:
+        return 0.0
+    index = min(len(sorted_values) - 1, int(round(p / 100.0 * (len(sorted_values) - 1))))
+    return sorted_values[index]
+
+
+def client(host, port, paths, deadline, keepalive, results, lock):
+    latencies = []
+    errors = 0
+    conn = None
+    i = 0
+    while time.monotonic() < deadline:
+        path = paths[i % len(paths)]
+        i += 1
+        start = time.monotonic()
+        try:
+            if conn is None:
+                conn = http.client.HTTPConnection(host, port, timeout=10)
+            conn.request("GET", path, headers={"Accept-Encoding": "gzip"})
+            response = conn.getresponse()
+            response.read()
+            if response.status >= 400:
+                errors += 1
+            else:
+                latencies.append(time.monotonic() - start)
+            if not keepalive or response.will_close:
+                conn.close()
+                conn = None
+        except (OSError, http.client.HTTPException):
+            errors += 1
+            if conn is not None:
+                conn.close()
+            conn = None
+    if conn is not None:
+        conn.close()
+    with lock:
+        results["latencies"].extend(latencies)
+        results["errors"] += errors
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("host")
+    parser.add_argument("--port", type=int, default=80)
+    parser.add_argument("--clients", type=int, default=8)
+    parser.add_argument("--seconds", type=float, default=15)
+    parser.add_argument("--path", action="append", help="repeatable; defaults to a mix of pages and APIs")
+    parser.add_argument("--keepalive", action="store_true", help="reuse connections between requests")
+    args = parser.parse_args()
+
+    paths = args.path or DEFAULT_PATHS
+    results = {"latencies": [], "errors": 0}
+    lock = threading.Lock()
+    deadline = time.monotonic() + args.seconds
+    threads = [
+        threading.Thread(target=client, args=(args.host, args.port, paths, deadline, args.keepalive, results, lock))
+        for _ in range(args.clients)
+    ]
+    start = time.monotonic()
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    elapsed = time.monotonic() - start
+
+    latencies = sorted(results["latencies"])
+    ok = len(latencies)
+    print("clients     %d" % args.clients)
+    print("requests    %d ok, %d failed" % (ok, results["errors"]))
+    print("throughput  %.1f req/s" % (ok / elapsed if elapsed else 0))
+    for p in (50, 90, 99):
+        print("p%-2d         %.1f ms" % (p, percentile(latencies, p) * 1000))
+    if latencies:
+        print("max         %.1f ms" % (latencies[-1] * 1000))
+
+
+main()
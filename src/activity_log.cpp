@@ -0,0 +1,361 @@
+#include "activity_log.h"
+#include "spsc_queue.h"
+#include <LittleFS.h>
+#include <time.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#define LOG_MAGIC 0x474C4341 // "ACLG"
+#define LOG_VERSION 1
+#define LOG_HEADER_SIZE 32
+
+// File header; records follow at LOG_HEADER_SIZE
+struct LogHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t recordSize;
+  uint32_t capacity;
+  uint32_t clearedSeq; // records below this were deleted
+};
+
+static_assert(sizeof(ActivityRecord) == 24, "ActivityRecord must stay 24 bytes");
+static_assert(sizeof(LogHeader) <= LOG_HEADER_SIZE, "LogHeader too large");
+
+static SpscQueue<ActivityRecord, 64> pending;
+static ActivityRecord batch[ACTIVITY_LOG_BATCH];
+static File logFile;
+static LogHeader header;
+static uint32_t nextSeq = 0;
+static uint32_t appendSeq = 0; // producer side: seq of the next queued record
+static unsigned long pendingSinceMs = 0;
+static bool havePending = false;
+static uint32_t batches = 0;
+static uint32_t lastCommitUs = 0;
+
+// Guards logFile and nextSeq between the log task and web readers
+static SemaphoreHandle_t logLock = nullptr;
+
+struct LogLock {
+  LogLock() { xSemaphoreTake(logLock, portMAX_DELAY); }
+  ~LogLock() { xSemaphoreGive(logLock); }
+};
+
+static uint16_t crc16(const uint8_t* data, size_t len) {
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= (uint16_t)data[i] << 8;
+    for (int b = 0; b < 8; b++)
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+static uint16_t recordCrc(const ActivityRecord& r) {
+  return crc16((const uint8_t*)&r, offsetof(ActivityRecord, crc));
+}
+
+static uint32_t slotOffset(uint32_t seq) {
+  return LOG_HEADER_SIZE + (seq % ACTIVITY_LOG_CAPACITY) * sizeof(ActivityRecord);
+}
+
+static uint32_t firstSeq() {
+  uint32_t oldest = nextSeq > ACTIVITY_LOG_CAPACITY ? nextSeq - ACTIVITY_LOG_CAPACITY : 0;
+  return max(oldest, header.clearedSeq);
+}
+
+static bool writeHeader() {
+  uint8_t buf[LOG_HEADER_SIZE] = {0};
+  memcpy(buf, &header, sizeof(header));
+  logFile.seek(0, SeekSet);
+  return logFile.write(buf, sizeof(buf)) == sizeof(buf);
+}
+
+// Preallocate the whole ring so commits only ever overwrite in place
+static bool createLogFile() {
+  File f = LittleFS.open(ACTIVITY_LOG_FILE, "w");
+  if (!f)
+    return false;
+
+  header = {LOG_MAGIC, LOG_VERSION, sizeof(ActivityRecord), ACTIVITY_LOG_CAPACITY, 0};
+  uint8_t buf[512] = {0};
+  memcpy(buf, &header, sizeof(header));
+  size_t total = LOG_HEADER_SIZE + ACTIVITY_LOG_CAPACITY * sizeof(ActivityRecord);
+  for (size_t written = 0; written < total;) {
+    size_t n = min(sizeof(buf), total - written);
+    if (f.write(buf, n) != n) {
+      f.close();
+      return false;
+    }
+    if (written == 0)
+      memset(buf, 0, sizeof(header));
+    written += n;
+  }
+  f.close();
+  return true;
+}
+
+// Find the newest intact record; a torn final batch simply fails its CRC
+static void recover() {
+  ActivityRecord chunk[32];
+  bool found = false;
+  uint32_t maxSeq = 0;
+
+  logFile.seek(LOG_HEADER_SIZE, SeekSet);
+  for (uint32_t slot = 0; slot < ACTIVITY_LOG_CAPACITY;) {
+    size_t n = logFile.read((uint8_t*)chunk, sizeof(chunk)) / sizeof(ActivityRecord);
+    if (n == 0)
+      break;
+    for (size_t i = 0; i < n; i++, slot++) {
+      const ActivityRecord& r = chunk[i];
+      if (r.crc != recordCrc(r) || r.seq % ACTIVITY_LOG_CAPACITY != slot)
+        continue;
+      if (!found || r.seq > maxSeq) {
+        maxSeq = r.seq;
+        found = true;
+      }
+    }
+  }
+
+  nextSeq = found ? maxSeq + 1 : 0;
+  if (nextSeq < header.clearedSeq)
+    nextSeq = header.clearedSeq;
+  appendSeq = nextSeq;
+}
+
+bool activityLogBegin() {
+  if (!logLock)
+    logLock = xSemaphoreCreateMutex();
+  LogLock lock;
+
+  for (int attempt = 0; attempt < 2; attempt++) {
+    logFile = LittleFS.open(ACTIVITY_LOG_FILE, "r+");
+    if (logFile && logFile.read((uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+        header.magic == LOG_MAGIC && header.version == LOG_VERSION &&
+        header.recordSize == sizeof(ActivityRecord) && header.capacity == ACTIVITY_LOG_CAPACITY &&
+        logFile.size() == LOG_HEADER_SIZE + ACTIVITY_LOG_CAPACITY * sizeof(ActivityRecord)) {
+      recover();
+      Serial.printf("Activity log: %u records, next seq %u\n", nextSeq - firstSeq(), nextSeq);
+      return true;
+    }
+    if (logFile)
+      logFile.close();
+    if (attempt == 0 && !createLogFile())
+      break;
+  }
+
+  Serial.println("❌ Activity log unavailable");
+  return false;
+}
+
+bool activityLogAppend(const CardUid& uid, uint32_t time, ActivityStatus status, uint32_t* seq) {
+  ActivityRecord r;
+  memset(&r, 0, sizeof(r));
+  r.seq = appendSeq; // the queue is FIFO, so commits hand out the same numbers
+  r.time = time;
+  r.status = status;
+  r.uidLength = uid.length;
+  memcpy(r.uid, uid.bytes, uid.length);
+  if (!pending.push(r))
+    return false;
+  if (seq)
+    *seq = appendSeq;
+  appendSeq++;
+  return true;
+}
+
+static void commitBatch(size_t count) {
+  unsigned long start = micros();
+  bool writeFailed = false;
+  {
+    LogLock lock;
+    for (size_t i = 0; i < count; i++) {
+      batch[i].seq = nextSeq + i;
+      batch[i].crc = recordCrc(batch[i]);
+    }
+
+    // At most two contiguous runs when the batch wraps the end of the ring
+    size_t done = 0;
+    while (done < count) {
+      uint32_t seq = nextSeq + done;
+      size_t run = min(count - done, (size_t)(ACTIVITY_LOG_CAPACITY - seq % ACTIVITY_LOG_CAPACITY));
+      logFile.seek(slotOffset(seq), SeekSet);
+      if (logFile.write((const uint8_t*)&batch[done], run * sizeof(ActivityRecord)) != run * sizeof(ActivityRecord))
+        writeFailed = true;
+      done += run;
+    }
+    logFile.flush(); // one metadata commit per batch
+    nextSeq += count;
+  }
+
+  batches++;
+  lastCommitUs = micros() - start;
+  // Only failures are reported; a line per batch is noise under sustained taps
+  if (writeFailed)
+    Serial.printf("❌ Activity log write failed (%u records)\n", (unsigned)count);
+}
+
+void activityLogService(unsigned long now) {
+  if (!logFile)
+    return;
+
+  size_t queued = pending.size();
+  if (queued == 0) {
+    havePending = false;
+    return;
+  }
+  if (!havePending) {
+    havePending = true;
+    pendingSinceMs = now;
+  }
+  if (queued < ACTIVITY_LOG_BATCH && now - pendingSinceMs < ACTIVITY_LOG_FLUSH_MS)
+    return;
+
+  size_t count = 0;
+  while (count < ACTIVITY_LOG_BATCH && pending.pop(batch[count]))
+    count++;
+  commitBatch(count);
+  havePending = false;
+}
+
+bool activityLogRead(uint32_t seq, ActivityRecord& record) {
+  if (!logFile)
+    return false;
+  LogLock lock;
+  if (seq < firstSeq() || seq >= nextSeq)
+    return false;
+
+  logFile.seek(slotOffset(seq), SeekSet);
+  if (logFile.read((uint8_t*)&record, sizeof(record)) != sizeof(record))
+    return false;
+  return record.seq == seq && record.crc == recordCrc(record);
+}
+
+size_t activityLogReadRange(uint32_t seq, ActivityRecord* records, size_t max) {
+  if (!logFile)
+    return 0;
+  LogLock lock;
+  if (seq < firstSeq() || seq >= nextSeq)
+    return 0;
+
+  // Stop at the end of the ring so the read stays contiguous
+  size_t count = min(max, (size_t)(nextSeq - seq));
+  count = min(count, (size_t)(ACTIVITY_LOG_CAPACITY - seq % ACTIVITY_LOG_CAPACITY));
+  logFile.seek(slotOffset(seq), SeekSet);
+  count = logFile.read((uint8_t*)records, count * sizeof(ActivityRecord)) / sizeof(ActivityRecord);
+
+  for (size_t i = 0; i < count; i++) {
+    if (records[i].seq != seq + i || records[i].crc != recordCrc(records[i]))
+      records[i].seq = 0xFFFFFFFF;
+  }
+  return count;
+}
+
+// Time of the first timestamped record at or after seq (records logged before
+// NTP sync carry no time); UINT32_MAX if there is none before limit
+static uint32_t timeAtOrAfter(uint32_t& seq, uint32_t limit) {
+  ActivityRecord r;
+  for (; seq < limit; seq++) {
+    if (activityLogRead(seq, r) && r.time)
+      return r.time;
+  }
+  return UINT32_MAX;
+}
+
+uint32_t activityLogSeekTime(uint32_t time) {
+  uint32_t lo = firstSeq();
+  uint32_t hi = nextSeq;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    uint32_t probe = mid;
+    if (timeAtOrAfter(probe, hi) < time)
+      lo = probe + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+struct CursorFile {
+  uint32_t magic;
+  uint32_t seq;
+  uint16_t reserved;
+  uint16_t crc;
+};
+
+#define CURSOR_MAGIC 0x52434C41 // "ALCR"
+
+bool activityCursorLoad(const char* path, uint32_t& seq) {
+  File f = LittleFS.open(path, "r");
+  if (!f)
+    return false;
+  CursorFile c;
+  bool ok = f.read((uint8_t*)&c, sizeof(c)) == sizeof(c) && c.magic == CURSOR_MAGIC &&
+            c.crc == crc16((const uint8_t*)&c, offsetof(CursorFile, crc));
+  f.close();
+  if (ok)
+    seq = c.seq;
+  return ok;
+}
+
+// Rewritten in place, so the file keeps its blocks
+bool activityCursorSave(const char* path, uint32_t seq) {
+  File f = LittleFS.open(path, LittleFS.exists(path) ? "r+" : "w");
+  if (!f)
+    return false;
+  CursorFile c = {CURSOR_MAGIC, seq, 0, 0};
+  c.crc = crc16((const uint8_t*)&c, offsetof(CursorFile, crc));
+  f.seek(0, SeekSet);
+  bool ok = f.write((const uint8_t*)&c, sizeof(c)) == sizeof(c);
+  f.close();
+  return ok;
+}
+
+bool activityLogClear() {
+  if (!logFile)
+    return false;
+  LogLock lock;
+  header.clearedSeq = nextSeq;
+  bool ok = writeHeader();
+  logFile.flush();
+  return ok;
+}
+
+const char* activityStatusName(uint8_t status) {
+  switch (status) {
+    case ACTIVITY_ALLOWED: return "allowed";
+    case ACTIVITY_UNKNOWN: return "unknown";
+    default: return "invalid";
+  }
+}
+
+size_t activityRecordToJson(const ActivityRecord& record, char* out, size_t cap) {
+  char ts[32];
+  if (record.time) {
+    time_t t = record.time;
+    struct tm timeinfo;
+    localtime_r(&t, &timeinfo);
+    strftime(ts, sizeof(ts), "%Y-%m-%d %H:%M:%S", &timeinfo);
+  } else {
+    strcpy(ts, "unknown");
+  }
+
+  CardUid uid;
+  char uidHex[CARD_UID_HEX_SIZE] = "";
+  if (cardUidFromBytes(record.uid, record.uidLength, uid))
+    cardUidToHex(uid, uidHex);
+
+  int len = snprintf(out, cap, "{\"seq\":%u,\"time\":\"%s\",\"uid\":\"%s\",\"status\":\"%s\"}",
+                     (unsigned)record.seq, ts, uidHex, activityStatusName(record.status));
+  return len < 0 ? 0 : min((size_t)len, cap - 1);
+}
+
+ActivityLogStats activityLogStats() {
+  ActivityLogStats s;
+  s.firstSeq = firstSeq();
+  s.nextSeq = nextSeq;
+  s.pending = pending.size();
+  s.dropped = pending.dropped();
+  s.batches = batches;
+  s.lastCommitUs = lastCommitUs;
+  return s;
+}
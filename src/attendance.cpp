@@ -0,0 +1,97 @@
+#include "attendance.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <time.h>
+
+#define NO_ENTRY 0xFFFF
+
+static AttendanceEntry entries[ATTENDANCE_MAX_CARDS]; // in first-seen order
+static uint16_t buckets[ATTENDANCE_BUCKETS];           // open addressing into entries
+static AttendanceStats stats = {0, 0, 0, 0};
+static SemaphoreHandle_t attendanceLock = nullptr;
+
+// Held by the NFC task while counting and by web handlers while reading
+struct AttendanceLock {
+  AttendanceLock() { xSemaphoreTake(attendanceLock, portMAX_DELAY); }
+  ~AttendanceLock() { xSemaphoreGive(attendanceLock); }
+};
+
+static void reset(uint32_t day) {
+  memset(buckets, 0xFF, sizeof(buckets));
+  stats = {day, 0, 0, 0};
+}
+
+// Days since the epoch in local time, so the count rolls over at local midnight.
+// The zone is the one configTime() set; the offset is taken from localtime_r().
+static uint32_t localDay(uint32_t time) {
+  static uint32_t dayStart = 0; // cached bounds of the last day computed
+  static uint32_t dayEnd = 0;
+  static uint32_t lastDay = 0;
+  if (time == 0)
+    return 0;
+  if (time >= dayStart && time < dayEnd)
+    return lastDay;
+  time_t t = time;
+  struct tm local;
+  localtime_r(&t, &local);
+  int32_t offset = local.tm_hour * 3600 + local.tm_min * 60 + local.tm_sec - (int32_t)(time % 86400);
+  if (offset > 14 * 3600)
+    offset -= 86400;
+  else if (offset < -12 * 3600)
+    offset += 86400;
+  lastDay = (uint32_t)(((int64_t)time + offset) / 86400);
+  dayStart = (uint32_t)((int64_t)lastDay * 86400 - offset);
+  dayEnd = dayStart + 86400;
+  return lastDay;
+}
+
+void attendanceBegin() {
+  attendanceLock = xSemaphoreCreateMutex();
+  reset(0);
+}
+
+uint16_t attendanceRecord(const CardUid& uid, uint32_t time) {
+  AttendanceLock lock;
+  uint32_t day = localDay(time);
+  if (day != stats.day)
+    reset(day);
+  stats.taps++;
+
+  uint32_t slot = cardUidHash(uid) & (ATTENDANCE_BUCKETS - 1);
+  while (buckets[slot] != NO_ENTRY) {
+    AttendanceEntry& e = entries[buckets[slot]];
+    if (cardUidEquals(e.uid, uid)) {
+      e.lastTime = time;
+      if (e.count < 0xFFFF)
+        e.count++;
+      return e.count;
+    }
+    slot = (slot + 1) & (ATTENDANCE_BUCKETS - 1);
+  }
+
+  if (stats.cards == ATTENDANCE_MAX_CARDS) {
+    stats.overflow++;
+    return 0;
+  }
+  buckets[slot] = stats.cards;
+  entries[stats.cards++] = {uid, time, time, 1};
+  return 1;
+}
+
+size_t attendanceRead(size_t offset, AttendanceEntry* out, size_t max) {
+  AttendanceLock lock;
+  size_t n = 0;
+  for (size_t i = offset; i < stats.cards && n < max; i++)
+    out[n++] = entries[i];
+  return n;
+}
+
+void attendanceClear() {
+  AttendanceLock lock;
+  reset(stats.day);
+}
+
+AttendanceStats attendanceStats() {
+  AttendanceLock lock;
+  return stats;
+}
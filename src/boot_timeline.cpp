@@ -0,0 +1,22 @@
+#include "boot_timeline.h"
+#include <freertos/FreeRTOS.h>
+
+static BootPhase phases[BOOT_MAX_PHASES];
+static size_t phaseCount = 0;
+static portMUX_TYPE phaseMux = portMUX_INITIALIZER_UNLOCKED;
+
+void bootPhaseMark(const char* name, uint32_t startMs) {
+  uint32_t now = millis();
+  portENTER_CRITICAL(&phaseMux);
+  if (phaseCount < BOOT_MAX_PHASES)
+    phases[phaseCount++] = {name, startMs, now - startMs};
+  portEXIT_CRITICAL(&phaseMux);
+}
+
+size_t bootPhases(BootPhase* out, size_t max) {
+  portENTER_CRITICAL(&phaseMux);
+  size_t n = min(max, phaseCount);
+  memcpy(out, phases, n * sizeof(BootPhase));
+  portEXIT_CRITICAL(&phaseMux);
+  return n;
+}
@@ -0,0 +1,108 @@
+#include "buzzer.h"
+#include "spsc_queue.h"
+#include <atomic>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+
+// Patterns per sound, ended by a zero step. SOUND_TAP takes its length from the config.
+static const ToneStep patterns[BUZZER_SOUND_COUNT][BUZZER_MAX_STEPS] = {
+  /* none    */ {{0, 0}},
+  /* tap     */ {{2700, 50}, {0, 0}},
+  /* allowed */ {{2000, 60}, {0, 40}, {2700, 90}, {0, 0}},
+  /* unknown */ {{1400, 150}, {0, 60}, {1000, 220}, {0, 0}},
+  /* repeat  */ {{2700, 100}, {0, 100}, {2700, 100}, {0, 100}, {2700, 100}, {0, 0}},
+  /* error   */ {{600, 400}, {0, 0}},
+};
+
+static esp_timer_handle_t timer = nullptr;
+static SpscQueue<uint8_t, BUZZER_QUEUE_SIZE> queue;
+static portMUX_TYPE playMux = portMUX_INITIALIZER_UNLOCKED;
+static bool playing = false; // timer armed or its callback running; under playMux
+
+// Timer callback state
+static uint8_t sound = SOUND_NONE;
+static uint8_t step = 0;
+
+static std::atomic<uint32_t> duty(1 << (BUZZER_LEDC_BITS - 1));
+static std::atomic<uint16_t> tapMs(50);
+
+static BuzzerStats stats = {0, 0, 0};
+
+static void tone(uint16_t freqHz) {
+  if (freqHz == 0) {
+    ledcWrite(BUZZER_LEDC_CHANNEL, 0);
+    return;
+  }
+  ledcChangeFrequency(BUZZER_LEDC_CHANNEL, freqHz, BUZZER_LEDC_BITS);
+  ledcWrite(BUZZER_LEDC_CHANNEL, duty);
+}
+
+// Runs on the esp_timer task: start the next step, the next queued sound, or go idle
+static void onStep(void*) {
+  while (true) {
+    const ToneStep* s = &patterns[sound][step];
+    if (sound != SOUND_NONE && s->ms) {
+      tone(s->freqHz);
+      step++;
+      uint16_t ms = sound == SOUND_TAP ? tapMs.load() : s->ms;
+      esp_timer_start_once(timer, (uint64_t)ms * 1000);
+      return;
+    }
+
+    tone(0);
+    uint8_t next;
+    portENTER_CRITICAL(&playMux);
+    bool more = queue.pop(next);
+    if (!more)
+      playing = false;
+    portEXIT_CRITICAL(&playMux);
+    if (!more) {
+      sound = SOUND_NONE;
+      return;
+    }
+    sound = next;
+    step = 0;
+    stats.played++;
+  }
+}
+
+void buzzerConfigure(const SoundConfig& config) {
+  // Loudest at 50% duty
+  duty = (uint32_t)constrain(config.volume, 0, 100) * (1 << (BUZZER_LEDC_BITS - 1)) / 100;
+  tapMs = constrain(config.duration, 1, 5000);
+}
+
+void buzzerBegin(uint8_t pin, const SoundConfig& config) {
+  buzzerConfigure(config);
+  ledcSetup(BUZZER_LEDC_CHANNEL, 2000, BUZZER_LEDC_BITS);
+  ledcAttachPin(pin, BUZZER_LEDC_CHANNEL);
+  ledcWrite(BUZZER_LEDC_CHANNEL, 0);
+
+  esp_timer_create_args_t args = {};
+  args.callback = onStep;
+  args.name = "buzzer";
+  esp_timer_create(&args, &timer);
+}
+
+bool buzzerPlay(BuzzerSound s) {
+  if (!timer || s == SOUND_NONE || s >= BUZZER_SOUND_COUNT)
+    return false;
+  uint32_t start = micros();
+  if (!queue.push(s)) {
+    stats.dropped++;
+    return false;
+  }
+
+  portENTER_CRITICAL(&playMux);
+  bool idle = !playing;
+  playing = true;
+  portEXIT_CRITICAL(&playMux);
+  if (idle)
+    esp_timer_start_once(timer, 0);
+  stats.lastQueueUs = micros() - start;
+  return true;
+}
+
+BuzzerStats buzzerStats() {
+  return stats;
+}
@@ -0,0 +1,976 @@
+#include "card_store.h"
+#include "led_effects.h"
+#include <LittleFS.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#define CARDS_DB_TMP_FILE "/cards.db.tmp"
+#define CARDS_IMPORT_TMP_FILE "/cards.db.new" // imports build outside the store lock
+#define CARDS_STAGE_FILE "/cards.stage"
+#define CARDS_BACKUP_FILE "/cards.txt.bak"
+#define LEGACY_INDEX_FILE "/cards.idx"
+#define DB_MAGIC 0x31424443 // "CDB1"
+#define DB_VERSION 1
+#define DB_HEADER_SIZE 32
+#define MAX_LINE_LEN 96
+#define MAX_CARRY 32
+#define MAX_WINDOW_SLOTS 4096
+#define SOURCE_BLOCK_SLOTS 16
+// Imports stage records in blocks grouped by hash bits 12-15, which are the
+// bits that pick a MAX_WINDOW_SLOTS-aligned build window
+#define IMPORT_BUCKETS 16
+#define IMPORT_BUCKET_SHIFT 12
+// Load (live + tombstones) at which cardStoreService() rebuilds the table, and
+// past which cardStorePut() refuses new cards until it has
+#define GROW_LOAD_PCT 85
+#define FULL_LOAD_PCT 95
+#define REBUILD_JOURNAL_SIZE 32
+#define REBUILD_RETRY_MS 10000
+#define SLOT_EMPTY 0
+#define SLOT_TOMBSTONE 0xFF
+#define NO_SLOT 0xFFFFFFFF
+
+// /cards.db header; capacity slots follow at DB_HEADER_SIZE
+struct DbHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t slotSize;
+  uint32_t capacity; // power of two
+  uint32_t live;
+  uint32_t tombstones;
+};
+
+// One record; uid.length is SLOT_EMPTY or SLOT_TOMBSTONE for unused slots.
+// The RAM cache is a byte-for-byte copy of the slot array.
+struct CardSlot {
+  CardUid uid;
+  uint8_t animation;
+  uint32_t color;
+};
+
+static_assert(sizeof(CardSlot) == 16, "CardSlot must stay 16 bytes");
+static_assert(sizeof(DbHeader) <= DB_HEADER_SIZE, "DbHeader too large");
+
+static CardStoreStats stats = {false, false, false, 0, 0, 0, 0, 0, 0, 0, 0};
+static DbHeader header;
+static File dbFile;
+static CardSlot* cache = nullptr;
+static CardImportStats importStats = {false, false, 0, 0, 0, 0, 0, 0, 0, 0};
+
+// Serializes lookups from the NFC task against changes from web handlers
+static SemaphoreHandle_t storeLock = nullptr;
+
+struct StoreLock {
+  StoreLock() { xSemaphoreTake(storeLock, portMAX_DELAY); }
+  ~StoreLock() { xSemaphoreGive(storeLock); }
+};
+
+// Reads slots for probing, from the RAM cache when loaded or in small batches from flash
+struct SlotReader {
+  CardSlot buf[8];
+  uint32_t start;
+  uint32_t count;
+
+  bool get(uint32_t i, CardSlot& out) {
+    if (cache) {
+      out = cache[i];
+      return true;
+    }
+    if (count == 0 || i < start || i >= start + count) {
+      start = i;
+      count = min((uint32_t)8, header.capacity - i);
+      dbFile.seek(DB_HEADER_SIZE + i * sizeof(CardSlot), SeekSet);
+      count = dbFile.read((uint8_t*)buf, count * sizeof(CardSlot)) / sizeof(CardSlot);
+      if (count == 0)
+        return false;
+    }
+    out = buf[i - start];
+    return true;
+  }
+};
+
+// One partially filled staging block per bucket
+struct ImportBlock {
+  CardSlot slots[SOURCE_BLOCK_SLOTS];
+  uint8_t used;
+};
+
+struct ImportState {
+  File stage;
+  ImportBlock* blocks;   // IMPORT_BUCKETS filling blocks
+  uint8_t* blockBuckets; // bucket of each block written to the stage file
+  uint32_t blockCount;
+  uint32_t blockCapacity;
+  char line[MAX_LINE_LEN];
+  size_t lineLen;
+  bool overlong;
+  uint32_t lineNumber;
+  unsigned long startMs;
+};
+
+static ImportState importState = {};
+static CardSlot* importSlots = nullptr; // the built table, read for the cache before the swap
+
+// An edit made while a rebuild was building the new table
+struct JournalEntry {
+  CardUid uid;
+  CardInfo card;
+  bool remove;
+};
+
+// Grow/compaction in progress. The new table is built from /cards.db without
+// the store lock; puts and removes made meanwhile are journaled and replayed
+// into it at the swap.
+struct RebuildState {
+  bool active;
+  bool overflow; // more edits than the journal holds: the build is discarded
+  uint32_t count;
+  uint32_t generation; // storeGeneration when the build started
+  unsigned long retryAtMs;
+  JournalEntry journal[REBUILD_JOURNAL_SIZE];
+};
+
+static RebuildState rebuild = {};
+static uint32_t storeGeneration = 0; // bumped by every swap
+
+struct ProbeResult {
+  bool found;
+  uint32_t index;     // slot holding the UID, when found
+  uint32_t freeIndex; // first reusable slot on the probe path
+  bool freeIsTombstone;
+  CardSlot slot;
+};
+
+static void trimField(const char*& start, const char*& end) {
+  while (start < end && isspace((unsigned char)*start)) start++;
+  while (end > start && isspace((unsigned char)end[-1])) end--;
+}
+
+// Strictly parse a "uid,color,animation" line into a record
+static bool parseCardLine(const char* line, CardSlot& slot) {
+  const char* firstComma = strchr(line, ',');
+  const char* secondComma = firstComma ? strchr(firstComma + 1, ',') : nullptr;
+  if (!secondComma)
+    return false;
+
+  const char* uid = line;
+  const char* uidEnd = firstComma;
+  const char* color = firstComma + 1;
+  const char* colorEnd = secondComma;
+  const char* anim = secondComma + 1;
+  const char* animEnd = anim + strlen(anim);
+  trimField(uid, uidEnd);
+  trimField(color, colorEnd);
+  trimField(anim, animEnd);
+
+  memset(&slot, 0, sizeof(slot));
+  if (!cardUidFromHex(uid, uidEnd - uid, slot.uid) ||
+      !isValidColor(color, colorEnd - color) ||
+      !isValidAnimation(anim, animEnd - anim))
+    return false;
+
+  slot.color = parseColor(color, colorEnd - color);
+  slot.animation = parseAnimation(anim, animEnd - anim);
+  return true;
+}
+
+// Smallest power-of-two table keeping the load factor at or below 0.8
+static uint32_t capacityFor(uint32_t count) {
+  uint32_t capacity = 16;
+  while (capacity < count + count / 4 + 1)
+    capacity *= 2;
+  return capacity;
+}
+
+static void freeCache() {
+  free(cache);
+  cache = nullptr;
+  stats.cacheReady = false;
+  stats.cacheBytes = 0;
+}
+
+// Copy a table's slot array into a new RAM buffer, if it fits the budget
+static CardSlot* readSlots(File& f, uint32_t capacity) {
+  size_t bytes = capacity * sizeof(CardSlot);
+  if (bytes > stats.cacheBudget) {
+    Serial.printf("Card cache: %u bytes exceeds budget of %u, using flash store\n",
+                  (unsigned)bytes, stats.cacheBudget);
+    return nullptr;
+  }
+
+  CardSlot* slots = (CardSlot*)malloc(bytes);
+  if (!slots) {
+    Serial.println("Card cache: out of memory, using flash store");
+    return nullptr;
+  }
+
+  f.seek(DB_HEADER_SIZE, SeekSet);
+  if (f.read((uint8_t*)slots, bytes) != bytes) {
+    free(slots);
+    return nullptr;
+  }
+  return slots;
+}
+
+// Read a freshly built table for the cache before it is swapped in, so the swap
+// does not read it under the store lock; null if it does not fit the budget
+static CardSlot* preloadTable(const char* path, uint32_t capacity) {
+  File f = LittleFS.open(path, "r");
+  if (!f)
+    return nullptr;
+  CardSlot* slots = readSlots(f, capacity);
+  f.close();
+  return slots;
+}
+
+// Adopt slots, a copy of the open table, as the cache
+static void installCache(CardSlot* slots) {
+  size_t bytes = header.capacity * sizeof(CardSlot);
+  cache = slots;
+  stats.cacheReady = true;
+  stats.cacheBytes = bytes;
+  Serial.printf("Card cache: %u cards in %u bytes\n", header.live, (unsigned)bytes);
+}
+
+static bool loadCache() {
+  CardSlot* slots = readSlots(dbFile, header.capacity);
+  if (!slots)
+    return false;
+  installCache(slots);
+  return true;
+}
+
+static bool rebuildDue() {
+  return (header.live + header.tombstones) * 100 > header.capacity * GROW_LOAD_PCT ||
+         header.tombstones > header.capacity / 4;
+}
+
+static void updateStats() {
+  stats.cardCount = header.live;
+  stats.slotCount = header.capacity;
+  stats.tombstones = header.tombstones;
+  stats.rebuildDue = rebuildDue();
+}
+
+static void closeStore() {
+  freeCache();
+  if (dbFile) dbFile.close();
+  stats.storeReady = false;
+}
+
+// Open /cards.db; preloaded, when given, is its slot array already read into RAM
+static bool openStore(CardSlot* preloaded = nullptr) {
+  dbFile = LittleFS.open(CARDS_DB_FILE, "r+");
+  if (!dbFile) {
+    free(preloaded);
+    return false;
+  }
+
+  if (dbFile.read((uint8_t*)&header, sizeof(header)) != sizeof(header) ||
+      header.magic != DB_MAGIC || header.version != DB_VERSION ||
+      header.slotSize != sizeof(CardSlot) || header.capacity == 0 ||
+      (header.capacity & (header.capacity - 1)) != 0 ||
+      dbFile.size() != DB_HEADER_SIZE + header.capacity * sizeof(CardSlot)) {
+    free(preloaded);
+    closeStore();
+    return false;
+  }
+
+  stats.storeReady = true;
+  updateStats();
+  if (preloaded)
+    installCache(preloaded);
+  else
+    loadCache();
+  return true;
+}
+
+static bool writeHeader(File& f, const DbHeader& h) {
+  uint8_t buf[DB_HEADER_SIZE] = {0};
+  memcpy(buf, &h, sizeof(h));
+  f.seek(0, SeekSet);
+  return f.write(buf, sizeof(buf)) == sizeof(buf);
+}
+
+// Insert into the window by linear probing from home. Returns 1 if inserted,
+// 0 for a duplicate (the first occurrence wins) and -1 if it ran off the end.
+static int probeInsert(CardSlot* window, uint32_t windowSize, uint32_t home, const CardSlot& slot) {
+  for (uint32_t i = home; i < windowSize; i++) {
+    if (window[i].uid.length == SLOT_EMPTY) {
+      window[i] = slot;
+      return 1;
+    }
+    if (cardUidEquals(window[i].uid, slot.uid))
+      return 0;
+  }
+  return -1;
+}
+
+// Place entries that probed past the last window, wrapping to the start of the table
+static int insertWrapped(File& out, const CardSlot& slot, uint32_t capacity) {
+  CardSlot existing;
+  for (uint32_t i = 0; i < capacity; i++) {
+    out.seek(DB_HEADER_SIZE + i * sizeof(CardSlot), SeekSet);
+    if (out.read((uint8_t*)&existing, sizeof(existing)) != sizeof(existing))
+      return -1;
+    if (existing.uid.length == SLOT_EMPTY) {
+      out.seek(DB_HEADER_SIZE + i * sizeof(CardSlot), SeekSet);
+      return out.write((const uint8_t*)&slot, sizeof(slot)) == sizeof(slot) ? 1 : -1;
+    }
+    if (cardUidEquals(existing.uid, slot.uid))
+      return 0;
+  }
+  return -1;
+}
+
+// True if records of an import bucket can land in the window starting at winStart
+static bool windowHasBucket(uint32_t winStart, uint32_t mask, uint8_t bucket) {
+  return ((((uint32_t)bucket << IMPORT_BUCKET_SHIFT) ^ winStart) & mask & 0xF000) == 0;
+}
+
+// Build a fresh table at outPath from CardSlot records stored sequentially
+// from sourceOffset (empty and tombstone slots are skipped). The table is filled window by
+// window so RAM use is bounded regardless of card count; entries that probe
+// past a window carry over into the next one. With blockBuckets (an import
+// stage), each window only reads the blocks whose bucket can land in it.
+// All buffers are per call: an import build and a compaction may run at once.
+static bool buildTable(File& source, uint32_t sourceOffset, const uint8_t* blockBuckets, uint32_t blockCount,
+                       uint32_t capacity, const char* outPath, uint32_t& live) {
+  CardSlot* carry = (CardSlot*)malloc(2 * MAX_CARRY * sizeof(CardSlot));
+  if (!carry)
+    return false;
+  CardSlot* nextCarry = carry + MAX_CARRY;
+
+  uint32_t windowSize = min(capacity, (uint32_t)MAX_WINDOW_SLOTS);
+  CardSlot* window = (CardSlot*)malloc(windowSize * sizeof(CardSlot));
+  while (!window && windowSize > 256) {
+    windowSize /= 2;
+    window = (CardSlot*)malloc(windowSize * sizeof(CardSlot));
+  }
+  if (!window) {
+    free(carry);
+    return false;
+  }
+
+  File out = LittleFS.open(outPath, "w+");
+  if (!out) {
+    free(window);
+    free(carry);
+    return false;
+  }
+
+  DbHeader h = {DB_MAGIC, DB_VERSION, sizeof(CardSlot), capacity, 0, 0};
+  bool ok = writeHeader(out, h);
+  uint32_t mask = capacity - 1;
+  size_t carryCount = 0;
+  CardSlot chunk[SOURCE_BLOCK_SLOTS];
+
+  for (uint32_t winStart = 0; ok && winStart < capacity; winStart += windowSize) {
+    memset(window, 0, windowSize * sizeof(CardSlot));
+    size_t nextCount = 0;
+
+    for (size_t i = 0; i < carryCount && ok; i++) {
+      int r = probeInsert(window, windowSize, 0, carry[i]);
+      if (r > 0) h.live++;
+      if (r < 0) {
+        if (nextCount == MAX_CARRY) ok = false;
+        else nextCarry[nextCount++] = carry[i];
+      }
+    }
+
+    source.seek(sourceOffset, SeekSet);
+    bool skipped = false;
+    for (uint32_t block = 0; ok; block++) {
+      if (blockBuckets) {
+        if (block == blockCount)
+          break;
+        if (!windowHasBucket(winStart, mask, blockBuckets[block])) {
+          skipped = true;
+          continue;
+        }
+        if (skipped) {
+          source.seek(sourceOffset + block * sizeof(chunk), SeekSet);
+          skipped = false;
+        }
+      }
+
+      size_t n = source.read((uint8_t*)chunk, sizeof(chunk)) / sizeof(CardSlot);
+      if (n == 0)
+        break;
+      for (size_t i = 0; i < n; i++) {
+        const CardSlot& slot = chunk[i];
+        if (slot.uid.length == SLOT_EMPTY || slot.uid.length == SLOT_TOMBSTONE)
+          continue;
+        uint32_t home = cardUidHash(slot.uid) & mask;
+        if (home < winStart || home >= winStart + windowSize)
+          continue;
+        int r = probeInsert(window, windowSize, home - winStart, slot);
+        if (r > 0) h.live++;
+        if (r < 0) {
+          if (nextCount == MAX_CARRY) ok = false;
+          else nextCarry[nextCount++] = slot;
+        }
+      }
+    }
+
+    if (ok)
+      ok = out.write((const uint8_t*)window, windowSize * sizeof(CardSlot)) == windowSize * sizeof(CardSlot);
+    memcpy(carry, nextCarry, nextCount * sizeof(CardSlot));
+    carryCount = nextCount;
+  }
+
+  for (size_t i = 0; i < carryCount && ok; i++) {
+    int r = insertWrapped(out, carry[i], capacity);
+    if (r > 0) h.live++;
+    if (r < 0) ok = false;
+  }
+
+  if (ok)
+    ok = writeHeader(out, h);
+  out.close();
+  free(window);
+  free(carry);
+
+  live = h.live;
+  if (!ok)
+    LittleFS.remove(outPath);
+  return ok;
+}
+
+// Replace /cards.db with a freshly built table; a crash between the remove and the
+// rename is finished by cardStoreBegin()
+static bool swapInTable(const char* tmpPath, CardSlot* preloaded = nullptr) {
+  closeStore();
+  LittleFS.remove(CARDS_DB_FILE);
+  storeGeneration++;
+  if (!LittleFS.rename(tmpPath, CARDS_DB_FILE)) {
+    free(preloaded);
+    return false;
+  }
+  return openStore(preloaded);
+}
+
+static uint8_t importBucket(const CardUid& uid) {
+  return (cardUidHash(uid) >> IMPORT_BUCKET_SHIFT) & (IMPORT_BUCKETS - 1);
+}
+
+static void importFree() {
+  if (importState.stage) importState.stage.close();
+  free(importState.blocks);
+  free(importState.blockBuckets);
+  importState.blocks = nullptr;
+  importState.blockBuckets = nullptr;
+  importStats.active = false;
+}
+
+// Append a bucket's block to the stage file; unused slots stay empty
+static bool importFlushBlock(uint8_t bucket) {
+  ImportBlock& block = importState.blocks[bucket];
+  if (importState.blockCount == importState.blockCapacity) {
+    uint32_t capacity = importState.blockCapacity ? importState.blockCapacity * 2 : 64;
+    uint8_t* grown = (uint8_t*)realloc(importState.blockBuckets, capacity);
+    if (!grown)
+      return false;
+    importState.blockBuckets = grown;
+    importState.blockCapacity = capacity;
+  }
+  if (importState.stage.write((const uint8_t*)block.slots, sizeof(block.slots)) != sizeof(block.slots))
+    return false;
+  importState.blockBuckets[importState.blockCount++] = bucket;
+  memset(&block, 0, sizeof(block));
+  return true;
+}
+
+static void importLine() {
+  importState.lineNumber++;
+  importState.line[importState.lineLen] = '\0';
+  const char* start = importState.line;
+  const char* end = importState.line + importState.lineLen;
+  trimField(start, end);
+  bool overlong = importState.overlong;
+  importState.lineLen = 0;
+  importState.overlong = false;
+  if (start == end)
+    return;
+
+  importStats.rows++;
+  CardSlot slot;
+  if (overlong || !parseCardLine(importState.line, slot)) {
+    importStats.rejected++;
+    if (!importStats.firstRejectedLine)
+      importStats.firstRejectedLine = importState.lineNumber;
+    return;
+  }
+
+  uint8_t bucket = importBucket(slot.uid);
+  ImportBlock& block = importState.blocks[bucket];
+  block.slots[block.used++] = slot;
+  importStats.accepted++;
+  if (block.used == SOURCE_BLOCK_SLOTS && !importFlushBlock(bucket))
+    importStats.ok = false;
+}
+
+static bool importBegin() {
+  importFree();
+  memset(&importStats, 0, sizeof(importStats));
+  importState.blockCount = 0;
+  importState.blockCapacity = 0;
+  importState.lineLen = 0;
+  importState.overlong = false;
+  importState.lineNumber = 0;
+  importState.startMs = millis();
+
+  importState.blocks = (ImportBlock*)calloc(IMPORT_BUCKETS, sizeof(ImportBlock));
+  importState.stage = LittleFS.open(CARDS_STAGE_FILE, "w+");
+  if (!importState.blocks || !importState.stage) {
+    importFree();
+    return false;
+  }
+
+  importStats.active = true;
+  importStats.ok = true;
+  return true;
+}
+
+static void importWrite(const uint8_t* data, size_t len) {
+  if (!importStats.active)
+    return;
+  for (size_t i = 0; i < len; i++) {
+    char c = data[i];
+    if (c == '\n') {
+      importLine();
+    } else if (importState.lineLen < MAX_LINE_LEN - 1) {
+      importState.line[importState.lineLen++] = c;
+    } else {
+      importState.overlong = true;
+    }
+  }
+}
+
+// Flush partial blocks and build the new table into the temp file. The live
+// store is untouched, so this runs without the store lock.
+static bool importBuild(uint32_t& live) {
+  if (!importStats.active)
+    return false;
+  if (importState.lineLen || importState.overlong)
+    importLine(); // last line without a trailing newline
+
+  for (uint8_t bucket = 0; importStats.ok && bucket < IMPORT_BUCKETS; bucket++) {
+    if (importState.blocks[bucket].used && !importFlushBlock(bucket))
+      importStats.ok = false;
+  }
+
+  // A pathological hash cluster can overflow the carry buffer; retry with more room
+  unsigned long buildStart = millis();
+  bool ok = false;
+  uint32_t capacity = capacityFor(importStats.accepted);
+  uint32_t built = 0;
+  for (uint32_t c = capacity; importStats.ok && !ok && c <= capacity * 4; c *= 2) {
+    ok = buildTable(importState.stage, 0, importState.blockBuckets, importState.blockCount, c, CARDS_IMPORT_TMP_FILE, live);
+    if (ok)
+      built = c;
+  }
+
+  importStats.buildMs = millis() - buildStart;
+  importFree();
+  LittleFS.remove(CARDS_STAGE_FILE);
+  importStats.ok = ok;
+  if (!ok)
+    Serial.println("Card store: import build failed");
+  else
+    importSlots = preloadTable(CARDS_IMPORT_TMP_FILE, built);
+  return ok;
+}
+
+static bool importSwap(uint32_t live) {
+  CardSlot* slots = importSlots;
+  importSlots = nullptr;
+  if (!importStats.ok) {
+    free(slots);
+    slots = nullptr;
+  }
+  if (!importStats.ok || !swapInTable(CARDS_IMPORT_TMP_FILE, slots)) {
+    importStats.ok = false;
+    Serial.println("Card store: import failed");
+    if (!stats.storeReady) openStore();
+    return false;
+  }
+
+  importStats.duplicates = importStats.accepted - live;
+  importStats.elapsedMs = millis() - importState.startMs;
+  importStats.rowsPerSec = importStats.elapsedMs ? importStats.rows * 1000ULL / importStats.elapsedMs : importStats.rows;
+  stats.lastRebuildMs = importStats.buildMs;
+  Serial.printf("Card store: imported %u cards (%u rejected, %u duplicate) in %u ms, build %u ms, %u rows/s\n",
+                live, importStats.rejected, importStats.duplicates, importStats.elapsedMs,
+                importStats.buildMs, importStats.rowsPerSec);
+  return true;
+}
+
+// Run a CSV file through the import pipeline; the caller holds the store lock
+static bool importFile(const char* csvPath) {
+  File csv = LittleFS.open(csvPath, "r");
+  if (!csv || !importBegin()) {
+    if (csv) csv.close();
+    return false;
+  }
+
+  uint8_t buf[256];
+  size_t n;
+  while ((n = csv.read(buf, sizeof(buf))) > 0)
+    importWrite(buf, n);
+  csv.close();
+
+  uint32_t live;
+  return importBuild(live) && importSwap(live);
+}
+
+static bool createEmptyStore() {
+  File out = LittleFS.open(CARDS_DB_TMP_FILE, "w");
+  if (!out)
+    return false;
+  DbHeader h = {DB_MAGIC, DB_VERSION, sizeof(CardSlot), 16, 0, 0};
+  CardSlot empty[16];
+  memset(empty, 0, sizeof(empty));
+  bool ok = writeHeader(out, h) && out.write((const uint8_t*)empty, sizeof(empty)) == sizeof(empty);
+  out.close();
+  return ok && swapInTable(CARDS_DB_TMP_FILE);
+}
+
+bool cardStoreBegin(size_t cacheBudget) {
+  if (!storeLock)
+    storeLock = xSemaphoreCreateMutex();
+  StoreLock lock;
+  closeStore();
+  stats.cacheBudget = cacheBudget;
+
+  // Finish a swap interrupted between removing the old table and renaming the new one
+  for (const char* tmpPath : {CARDS_IMPORT_TMP_FILE, CARDS_DB_TMP_FILE}) {
+    if (!LittleFS.exists(CARDS_DB_FILE) && LittleFS.exists(tmpPath))
+      LittleFS.rename(tmpPath, CARDS_DB_FILE);
+  }
+
+  if (openStore()) {
+    Serial.printf("Card store: %u cards loaded\n", header.live);
+    return true;
+  }
+
+  // First boot with the record store: migrate the old CSV list
+  if (LittleFS.exists(CARDS_FILE) && importFile(CARDS_FILE)) {
+    LittleFS.remove(CARDS_BACKUP_FILE);
+    LittleFS.rename(CARDS_FILE, CARDS_BACKUP_FILE);
+    LittleFS.remove(LEGACY_INDEX_FILE);
+    return true;
+  }
+
+  return createEmptyStore();
+}
+
+bool cardStoreImport(const char* csvPath) {
+  if (!storeLock)
+    return false;
+  StoreLock lock;
+  return importFile(csvPath);
+}
+
+bool cardImportBegin() {
+  return storeLock && !importStats.active && importBegin();
+}
+
+void cardImportWrite(const uint8_t* data, size_t len) {
+  importWrite(data, len);
+}
+
+bool cardImportEnd() {
+  uint32_t live;
+  if (!importBuild(live))
+    return false;
+  StoreLock lock;
+  return importSwap(live);
+}
+
+void cardImportAbort() {
+  if (!importStats.active)
+    return;
+  importFree();
+  LittleFS.remove(CARDS_STAGE_FILE);
+  importStats.ok = false;
+}
+
+const CardImportStats& cardImportStats() {
+  return importStats;
+}
+
+static ProbeResult probe(const CardUid& uid) {
+  ProbeResult result;
+  result.found = false;
+  result.freeIndex = NO_SLOT;
+  result.freeIsTombstone = false;
+
+  SlotReader reader;
+  reader.count = 0;
+  uint32_t mask = header.capacity - 1;
+  uint32_t i = cardUidHash(uid) & mask;
+  for (uint32_t n = 0; n < header.capacity; n++, i = (i + 1) & mask) {
+    CardSlot& slot = result.slot;
+    if (!reader.get(i, slot))
+      break;
+    if (slot.uid.length == SLOT_EMPTY) {
+      if (result.freeIndex == NO_SLOT)
+        result.freeIndex = i;
+      break;
+    }
+    if (slot.uid.length == SLOT_TOMBSTONE) {
+      if (result.freeIndex == NO_SLOT) {
+        result.freeIndex = i;
+        result.freeIsTombstone = true;
+      }
+      continue;
+    }
+    if (cardUidEquals(slot.uid, uid)) {
+      result.found = true;
+      result.index = i;
+      break;
+    }
+  }
+  return result;
+}
+
+// Write one slot and the header counts, committed by a single flush
+static bool writeSlot(uint32_t index, const CardSlot& slot) {
+  dbFile.seek(DB_HEADER_SIZE + index * sizeof(CardSlot), SeekSet);
+  bool ok = dbFile.write((const uint8_t*)&slot, sizeof(slot)) == sizeof(slot) &&
+            writeHeader(dbFile, header);
+  dbFile.flush();
+  if (cache)
+    cache[index] = slot;
+  updateStats();
+  return ok;
+}
+
+bool cardStoreFind(const CardUid& uid, CardInfo& card) {
+  if (!storeLock)
+    return false;
+  StoreLock lock;
+  if (!stats.storeReady)
+    return false;
+
+  unsigned long start = micros();
+  ProbeResult r = probe(uid);
+  if (r.found) {
+    card.color = r.slot.color;
+    card.animation = r.slot.animation;
+  }
+  stats.lastLookupUs = micros() - start;
+  return r.found;
+}
+
+// Add or update under the store lock. New cards are refused once the table is
+// past FULL_LOAD_PCT; cardStoreService() grows it.
+static bool putSlot(const CardUid& uid, const CardInfo& card) {
+  ProbeResult r = probe(uid);
+  if (!r.found) {
+    if (r.freeIndex == NO_SLOT || (header.live + header.tombstones + 1) * 100 > header.capacity * FULL_LOAD_PCT)
+      return false;
+    r.index = r.freeIndex;
+    if (r.freeIsTombstone)
+      header.tombstones--;
+    header.live++;
+  }
+
+  CardSlot slot;
+  memset(&slot, 0, sizeof(slot));
+  slot.uid = uid;
+  slot.color = card.color;
+  slot.animation = card.animation;
+  return writeSlot(r.index, slot);
+}
+
+static bool removeSlot(const CardUid& uid) {
+  ProbeResult r = probe(uid);
+  if (!r.found)
+    return false;
+
+  // A slot followed by an empty one ends every chain through it, so it can be
+  // emptied outright; otherwise leave a tombstone for compaction
+  SlotReader reader;
+  reader.count = 0;
+  CardSlot next;
+  bool endOfChain = reader.get((r.index + 1) & (header.capacity - 1), next) &&
+                    next.uid.length == SLOT_EMPTY;
+
+  CardSlot slot;
+  memset(&slot, 0, sizeof(slot));
+  slot.uid.length = endOfChain ? SLOT_EMPTY : SLOT_TOMBSTONE;
+  header.live--;
+  if (!endOfChain)
+    header.tombstones++;
+  return writeSlot(r.index, slot);
+}
+
+// Note an edit for the rebuild in progress, if any
+static void journalEdit(const CardUid& uid, const CardInfo* card) {
+  if (!rebuild.active)
+    return;
+  if (rebuild.count == REBUILD_JOURNAL_SIZE) {
+    rebuild.overflow = true;
+    return;
+  }
+  JournalEntry& e = rebuild.journal[rebuild.count++];
+  e.uid = uid;
+  e.remove = !card;
+  if (card)
+    e.card = *card;
+}
+
+bool cardStorePut(const CardUid& uid, const CardInfo& card) {
+  if (!storeLock)
+    return false;
+  StoreLock lock;
+  if (!stats.storeReady || !putSlot(uid, card))
+    return false;
+  journalEdit(uid, &card);
+  return true;
+}
+
+bool cardStoreRemove(const CardUid& uid) {
+  if (!storeLock)
+    return false;
+  StoreLock lock;
+  if (!stats.storeReady || !removeSlot(uid))
+    return false;
+  journalEdit(uid, nullptr);
+  return true;
+}
+
+// Build the new table from /cards.db through a handle of its own, and read it
+// into a cache buffer, all without the store lock: lookups keep using the old
+// table and its cache. Only the swap and the journal replay hold the lock.
+static bool rebuildStore(uint32_t capacity) {
+  unsigned long start = millis();
+  uint32_t live = 0;
+  File source = LittleFS.open(CARDS_DB_FILE, "r");
+  bool ok = source && buildTable(source, DB_HEADER_SIZE, nullptr, 0, capacity, CARDS_DB_TMP_FILE, live);
+  if (source)
+    source.close();
+
+  CardSlot* slots = ok ? preloadTable(CARDS_DB_TMP_FILE, capacity) : nullptr;
+
+  StoreLock lock;
+  unsigned long swapStart = micros();
+  rebuild.active = false;
+  // Replayed cards must fit; the build is also stale if an import swapped in meanwhile
+  if (ok && (rebuild.overflow || rebuild.generation != storeGeneration ||
+             (live + rebuild.count) * 100 > capacity * FULL_LOAD_PCT))
+    ok = false;
+  if (!ok) {
+    free(slots);
+    LittleFS.remove(CARDS_DB_TMP_FILE);
+    rebuild.retryAtMs = millis() + REBUILD_RETRY_MS;
+    Serial.println("Card store: rebuild failed");
+    return false;
+  }
+
+  if (!swapInTable(CARDS_DB_TMP_FILE, slots)) {
+    Serial.println("Card store: rebuild failed");
+    if (!stats.storeReady)
+      openStore();
+    return false;
+  }
+  for (uint32_t i = 0; i < rebuild.count; i++) {
+    const JournalEntry& e = rebuild.journal[i];
+    if (e.remove)
+      removeSlot(e.uid);
+    else
+      putSlot(e.uid, e.card);
+  }
+
+  stats.lastSwapUs = micros() - swapStart;
+  stats.lastRebuildMs = millis() - start;
+  Serial.printf("Card store: %u cards in %u slots, rebuilt in %u ms, %u edits replayed in %u us\n",
+                header.live, header.capacity, stats.lastRebuildMs, rebuild.count, stats.lastSwapUs);
+  return true;
+}
+
+void cardStoreService() {
+  // Unlocked peek; rechecked under the lock
+  if (!storeLock || !stats.storeReady || !stats.rebuildDue ||
+      (rebuild.retryAtMs && (long)(millis() - rebuild.retryAtMs) < 0))
+    return;
+
+  uint32_t capacity;
+  {
+    StoreLock lock;
+    if (!stats.storeReady || !rebuildDue())
+      return;
+    capacity = capacityFor(header.live + 1);
+    rebuild.active = true;
+    rebuild.retryAtMs = 0;
+    rebuild.overflow = false;
+    rebuild.count = 0;
+    rebuild.generation = storeGeneration;
+  }
+  rebuildStore(capacity);
+}
+
+// Streams from its own file handle, so a long listing never holds the lookup lock
+uint32_t cardStoreListNext(CardListCursor& cursor, const char* prefix, uint32_t max,
+                           CardVisitor visit, void* context) {
+  if (cursor.done)
+    return 0;
+  File file = LittleFS.open(CARDS_DB_FILE, "r");
+  if (!file) {
+    cursor.done = true;
+    return 0;
+  }
+
+  size_t prefixLen = strlen(prefix);
+  uint32_t visited = 0;
+  uint32_t scanned = 0;
+  CardSlot chunk[16];
+  CardText card;
+  size_t n = 0;
+
+  file.seek(DB_HEADER_SIZE + cursor.slot * sizeof(CardSlot), SeekSet);
+  while (visited < max && scanned < CARD_LIST_SCAN_SLOTS &&
+         (n = file.read((uint8_t*)chunk, sizeof(chunk)) / sizeof(CardSlot)) > 0) {
+    for (size_t i = 0; i < n && visited < max; i++) {
+      const CardSlot& slot = chunk[i];
+      cursor.slot++;
+      scanned++;
+      if (slot.uid.length == SLOT_EMPTY || slot.uid.length == SLOT_TOMBSTONE)
+        continue;
+
+      cardUidToHex(slot.uid, card.uid);
+      if (strncasecmp(card.uid, prefix, prefixLen) != 0)
+        continue;
+      if (cursor.skip) {
+        cursor.skip--;
+        continue;
+      }
+
+      snprintf(card.color, sizeof(card.color), "#%06X", (unsigned)(slot.color & 0xFFFFFF));
+      strncpy(card.animation, animationName(slot.animation), sizeof(card.animation) - 1);
+      card.animation[sizeof(card.animation) - 1] = '\0';
+      visit(card, context);
+      visited++;
+    }
+  }
+
+  if (n == 0)
+    cursor.done = true;
+  file.close();
+  return visited;
+}
+
+uint32_t cardStoreList(const char* prefix, uint32_t offset, uint32_t limit,
+                       CardVisitor visit, void* context) {
+  CardListCursor cursor = {0, offset, false};
+  uint32_t visited = 0;
+  while (!cursor.done && visited < limit)
+    visited += cardStoreListNext(cursor, prefix, limit - visited, visit, context);
+  return visited;
+}
+
+const CardStoreStats& cardStoreStats() {
+  return stats;
+}
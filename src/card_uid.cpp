@@ -0,0 +1,71 @@
+#include "card_uid.h"
+
+static int hexNibble(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+bool cardUidFromBytes(const uint8_t* bytes, uint8_t length, CardUid& out) {
+  if (length == 0 || length > CARD_UID_MAX_LEN)
+    return false;
+
+  out.length = length;
+  memcpy(out.bytes, bytes, length);
+  memset(out.bytes + length, 0, CARD_UID_MAX_LEN - length);
+  return true;
+}
+
+void cardKeyTagged(CardKeyTag tag, const uint8_t* id, size_t length, CardUid& out) {
+  memset(out.bytes, 0, CARD_UID_MAX_LEN);
+  out.length = CARD_KEY_TAGGED_LEN;
+  out.bytes[0] = tag;
+  if (length <= CARD_KEY_TAGGED_LEN - 1) {
+    memcpy(out.bytes + 1, id, length);
+    return;
+  }
+  uint64_t h = 14695981039346656037ull;
+  for (size_t i = 0; i < length; i++)
+    h = (h ^ id[i]) * 1099511628211ull;
+  for (int i = 0; i < 8; i++)
+    out.bytes[1 + i] = h >> (56 - i * 8);
+}
+
+bool cardUidFromHex(const char* hex, size_t len, CardUid& out) {
+  if (len == 0 || (len % 2) != 0 || len / 2 > CARD_UID_MAX_LEN)
+    return false;
+
+  out.length = len / 2;
+  memset(out.bytes, 0, CARD_UID_MAX_LEN);
+  for (size_t i = 0; i < out.length; i++) {
+    int hi = hexNibble(hex[i * 2]);
+    int lo = hexNibble(hex[i * 2 + 1]);
+    if (hi < 0 || lo < 0)
+      return false;
+    out.bytes[i] = (hi << 4) | lo;
+  }
+  return true;
+}
+
+void cardUidToHex(const CardUid& uid, char* out) {
+  static const char digits[] = "0123456789ABCDEF";
+  for (uint8_t i = 0; i < uid.length; i++) {
+    out[i * 2] = digits[uid.bytes[i] >> 4];
+    out[i * 2 + 1] = digits[uid.bytes[i] & 0x0F];
+  }
+  out[uid.length * 2] = '\0';
+}
+
+// FNV-1a over the length and UID bytes
+uint32_t cardUidHash(const CardUid& uid) {
+  uint32_t h = 2166136261u;
+  h = (h ^ uid.length) * 16777619u;
+  for (uint8_t i = 0; i < uid.length; i++)
+    h = (h ^ uid.bytes[i]) * 16777619u;
+  return h;
+}
+
+bool cardUidEquals(const CardUid& a, const CardUid& b) {
+  return a.length == b.length && memcmp(a.bytes, b.bytes, a.length) == 0;
+}
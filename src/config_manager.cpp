@@ -1,103 +1,325 @@
 #include "config_manager.h"
+#include "led_effects.h"
 #include <LittleFS.h>
 #include <ArduinoJson.h>
+#include <rom/crc.h>
+#include <stddef.h>
 
-bool loadDeviceConfig(DeviceConfig &config) {
-  File file = LittleFS.open("/config.json", "r");
-  if (!file) {
-    Serial.println("Failed to open config.json");
-    return false;
-  }
-
-  StaticJsonDocument<2048> doc; // Increased size to fit all fields
-  DeserializationError error = deserializeJson(doc, file);
-  file.close();
-
-  if (error) {
-    Serial.print("JSON parse error: ");
-    Serial.println(error.c_str());
-    return false;
-  }
+#define FIELD(section, key, type, group, member, min, max, def)                      \
+  {section, key, type, group, (uint16_t)offsetof(DeviceConfig, member),            \
+   (uint16_t)sizeof(((DeviceConfig*)nullptr)->member), min, max, def}
 
+const ConfigField configSchema[] = {
   // General
-  config.deviceName = doc["deviceName"] | "TapBox";
-  config.ledBrightness = doc["ledBrightness"] | 255;
-  config.mode = doc["mode"] | 0;
-  config.hotspotPassword = doc["hotspotPassword"] | "12345678";
+  FIELD(nullptr, "deviceName", CONFIG_STRING, CONFIG_IDENTITY, deviceName, 0, 0, "TapBox"),
+  FIELD(nullptr, "ledBrightness", CONFIG_INT, CONFIG_LEDS, ledBrightness, 0, 255, "255"),
+  FIELD(nullptr, "mode", CONFIG_INT, CONFIG_MODE, mode, 0, 3, "0"),
+  FIELD(nullptr, "hotspotPassword", CONFIG_STRING, CONFIG_IDENTITY, hotspotPassword, 0, 0, "12345678"),
+  FIELD(nullptr, "cardCacheBytes", CONFIG_INT, CONFIG_CARD_CACHE, cardCacheBytes, 0, 1 << 20, "65536"),
 
   // Light
-  config.light.knownDefaultColor = doc["light"]["knownDefaultColor"] | "#00FF00";
-  config.light.unknownDefaultColor = doc["light"]["unknownDefaultColor"] | "#FF00FF";
-  config.light.knownCardAnimation = doc["light"]["knownCardAnimation"] | "solid";
-  config.light.unknownCardAnimation = doc["light"]["unknownCardAnimation"] | "blink";
-  config.light.lightDuration = doc["light"]["lightDuration"] | 1000;
-  config.light.numberOfBlinks = doc["light"]["numberOfBlinks"] | 2;
+  FIELD("light", "knownDefaultColor", CONFIG_COLOR, CONFIG_LEDS, light.knownDefaultColor, 0, 0, "#00FF00"),
+  FIELD("light", "unknownDefaultColor", CONFIG_COLOR, CONFIG_LEDS, light.unknownDefaultColor, 0, 0, "#FF00FF"),
+  FIELD("light", "knownCardAnimation", CONFIG_ANIMATION, CONFIG_LEDS, light.knownCardAnimation, 0, 0, "solid"),
+  FIELD("light", "unknownCardAnimation", CONFIG_ANIMATION, CONFIG_LEDS, light.unknownCardAnimation, 0, 0, "blink"),
+  FIELD("light", "lightDuration", CONFIG_INT, CONFIG_LEDS, light.lightDuration, 0, 60000, "1000"),
+  FIELD("light", "numberOfBlinks", CONFIG_INT, CONFIG_LEDS, light.numberOfBlinks, 0, 50, "2"),
 
   // Sound
-  config.sound.tapDetection = doc["sound"]["tapDetection"] | false;
-  config.sound.volume = doc["sound"]["volume"] | 100;
-  config.sound.onStatus = doc["sound"]["onStatus"] | false;
-  config.sound.duration = doc["sound"]["duration"] | 10;
+  FIELD("sound", "tapDetection", CONFIG_BOOL, CONFIG_SOUND, sound.tapDetection, 0, 0, "false"),
+  FIELD("sound", "volume", CONFIG_INT, CONFIG_SOUND, sound.volume, 0, 100, "100"),
+  FIELD("sound", "onStatus", CONFIG_BOOL, CONFIG_SOUND, sound.onStatus, 0, 0, "false"),
+  FIELD("sound", "duration", CONFIG_INT, CONFIG_SOUND, sound.duration, 0, 5000, "10"),
 
   // WiFi
-  config.wifi.ssid = doc["wifi"]["ssid"] | "";
-  config.wifi.password = doc["wifi"]["password"] | "";
+  FIELD("wifi", "ssid", CONFIG_STRING, CONFIG_WIFI, wifi.ssid, 0, 0, ""),
+  FIELD("wifi", "password", CONFIG_STRING, CONFIG_WIFI, wifi.password, 0, 0, ""),
 
   // Server
-  config.server.address = doc["server"]["address"] | "";
-  config.server.port = doc["server"]["port"] | 80;
+  FIELD("server", "address", CONFIG_STRING, CONFIG_SERVER, server.address, 0, 0, ""),
+  FIELD("server", "port", CONFIG_INT, CONFIG_SERVER, server.port, 1, 65535, "80"),
 
   // MQTT
-  config.mqtt.enable = doc["mqtt"]["enable"] | false;
-  config.mqtt.host = doc["mqtt"]["host"] | "";
-  config.mqtt.port = doc["mqtt"]["port"] | 1883;
-  config.mqtt.topic = doc["mqtt"]["topic"] | "";
-  config.mqtt.user = doc["mqtt"]["user"] | "";
-  config.mqtt.pass = doc["mqtt"]["pass"] | "";
+  FIELD("mqtt", "enable", CONFIG_BOOL, CONFIG_MQTT, mqtt.enable, 0, 0, "false"),
+  FIELD("mqtt", "host", CONFIG_STRING, CONFIG_MQTT, mqtt.host, 0, 0, ""),
+  FIELD("mqtt", "port", CONFIG_INT, CONFIG_MQTT, mqtt.port, 1, 65535, "1883"),
+  FIELD("mqtt", "topic", CONFIG_STRING, CONFIG_MQTT, mqtt.topic, 0, 0, ""),
+  FIELD("mqtt", "user", CONFIG_STRING, CONFIG_MQTT, mqtt.user, 0, 0, ""),
+  FIELD("mqtt", "pass", CONFIG_STRING, CONFIG_MQTT, mqtt.pass, 0, 0, ""),
+
+  // Cellular
+  FIELD("cellular", "enable", CONFIG_BOOL, CONFIG_CELLULAR, cellular.enable, 0, 0, "false"),
+  FIELD("cellular", "apn", CONFIG_STRING, CONFIG_CELLULAR, cellular.apn, 0, 0, "internet"),
+  FIELD("cellular", "baud", CONFIG_INT, CONFIG_CELLULAR, cellular.baud, 1200, 115200, "9600"),
+
+  // NFC
+  FIELD("nfc", "eventDriven", CONFIG_BOOL, CONFIG_NFC, nfc.eventDriven, 0, 0, "true"),
+  FIELD("nfc", "irqPin", CONFIG_INT, CONFIG_NFC, nfc.irqPin, -1, 39, "-1"),
+  FIELD("nfc", "readyPollMs", CONFIG_INT, CONFIG_NFC, nfc.readyPollMs, 1, 1000, "20"),
+  FIELD("nfc", "felica", CONFIG_BOOL, CONFIG_NFC, nfc.felica, 0, 0, "false"),
+  FIELD("nfc", "readNdef", CONFIG_BOOL, CONFIG_NFC, nfc.readNdef, 0, 0, "false"),
+  FIELD("nfc", "desfireAid", CONFIG_INT, CONFIG_NFC, nfc.desfireAid, 0, 0xFFFFFF, "0"),
+  FIELD("nfc", "desfireFile", CONFIG_INT, CONFIG_NFC, nfc.desfireFile, 0, 31, "1"),
+
+  // Debounce
+  FIELD("debounce", "knownCooldownMs", CONFIG_INT, CONFIG_DEBOUNCE, debounce.knownCooldownMs, 0, 600000, "3000"),
+  FIELD("debounce", "unknownCooldownMs", CONFIG_INT, CONFIG_DEBOUNCE, debounce.unknownCooldownMs, 0, 600000, "3000"),
+
+  // Online verification cache
+  FIELD("verify", "allowTtlSec", CONFIG_INT, CONFIG_VERIFY, verify.allowTtlSec, 0, 86400, "600"),
+  FIELD("verify", "denyTtlSec", CONFIG_INT, CONFIG_VERIFY, verify.denyTtlSec, 0, 86400, "60"),
+  FIELD("verify", "staleSec", CONFIG_INT, CONFIG_VERIFY, verify.staleSec, 0, 86400, "300"),
 
   // IoT
-  config.iot.enabled = doc["iot"]["enabled"] | false;
+  FIELD("iot", "enabled", CONFIG_BOOL, CONFIG_IOT, iot.enabled, 0, 0, "false"),
+};
+
+const size_t configSchemaSize = sizeof(configSchema) / sizeof(configSchema[0]);
+
+struct SnapshotHeader {
+  char magic[4];       // "JCFG"
+  uint16_t version;    // CONFIG_SCHEMA_VERSION
+  uint16_t configSize; // sizeof(DeviceConfig)
+  uint32_t jsonSize;   // config.json this snapshot was parsed from
+  uint32_t jsonCrc;
+  uint32_t configCrc;  // over the DeviceConfig bytes that follow
+};
+
+static ConfigLoadStats loadStats = {"none", 0, 0, 0, 0};
+
+static uint8_t* fieldPtr(DeviceConfig& config, const ConfigField& f) {
+  return (uint8_t*)&config + f.offset;
+}
+
+static const uint8_t* fieldPtr(const DeviceConfig& config, const ConfigField& f) {
+  return (const uint8_t*)&config + f.offset;
+}
+
+// Parse text into the field; false leaves it untouched
+static bool setField(DeviceConfig& config, const ConfigField& f, const char* text) {
+  uint8_t* p = fieldPtr(config, f);
+  size_t len = strlen(text);
+
+  switch (f.type) {
+    case CONFIG_BOOL: {
+      if (strcmp(text, "true") == 0 || strcmp(text, "false") == 0) {
+        *(bool*)p = text[0] == 't';
+        return true;
+      }
+      char* end;
+      long n = strtol(text, &end, 10);
+      if (len == 0 || *end)
+        return false;
+      *(bool*)p = n != 0;
+      return true;
+    }
+    case CONFIG_INT: {
+      char* end;
+      long n = strtol(text, &end, 0);
+      if (len == 0 || *end || n < f.min || n > f.max)
+        return false;
+      *(int*)p = (int)n;
+      return true;
+    }
+    case CONFIG_STRING:
+      if (len >= f.size)
+        return false;
+      memcpy(p, text, len + 1);
+      return true;
+    case CONFIG_COLOR:
+      if (!isValidColor(text, len))
+        return false;
+      *(uint32_t*)p = parseColor(text, len);
+      return true;
+    case CONFIG_ANIMATION:
+      if (!isValidAnimation(text, len))
+        return false;
+      *(uint8_t*)p = parseAnimation(text, len);
+      return true;
+  }
+  return false;
+}
+
+void defaultDeviceConfig(DeviceConfig& config) {
+  memset(&config, 0, sizeof(config));
+  for (size_t i = 0; i < configSchemaSize; i++)
+    setField(config, configSchema[i], configSchema[i].defaultValue);
+}
+
+// A JSON value as the text setField() parses; numbers and booleans are accepted for any type
+static const char* valueText(JsonVariantConst value, char* buf, size_t cap) {
+  if (value.is<const char*>())
+    return value.as<const char*>();
+  if (value.is<bool>())
+    return value.as<bool>() ? "true" : "false";
+  if (value.is<long>()) {
+    snprintf(buf, cap, "%ld", value.as<long>());
+    return buf;
+  }
+  return nullptr;
+}
+
+static bool parseJson(File& file, DeviceConfig& config) {
+  StaticJsonDocument<2048> doc; // on the stack, and only when the snapshot is stale
+  DeserializationError error = deserializeJson(doc, file);
+  if (error) {
+    Serial.print("JSON parse error: ");
+    Serial.println(error.c_str());
+    return false;
+  }
 
+  defaultDeviceConfig(config);
+  loadStats.invalidFields = 0;
+  for (size_t i = 0; i < configSchemaSize; i++) {
+    const ConfigField& f = configSchema[i];
+    JsonVariantConst value = f.section ? doc[f.section][f.key] : doc[f.key];
+    if (value.isNull())
+      continue;
+    char buf[16];
+    const char* text = valueText(value, buf, sizeof(buf));
+    if (!text || !setField(config, f, text)) {
+      Serial.printf("Config: invalid %s%s%s, using the default\n", f.section ? f.section : "",
+                    f.section ? "." : "", f.key);
+      loadStats.invalidFields++;
+    }
+  }
   return true;
 }
 
+static uint32_t fileCrc(File& file) {
+  uint8_t buf[256];
+  uint32_t crc = 0;
+  size_t n;
+  while ((n = file.read(buf, sizeof(buf))) > 0)
+    crc = crc32_le(crc, buf, n);
+  return crc;
+}
+
+static bool readSnapshot(DeviceConfig& config, uint32_t jsonSize, uint32_t jsonCrc) {
+  File file = LittleFS.open(CONFIG_SNAPSHOT_FILE, "r");
+  if (!file)
+    return false;
+
+  SnapshotHeader h;
+  DeviceConfig snapshot;
+  bool ok = file.read((uint8_t*)&h, sizeof(h)) == sizeof(h) && memcmp(h.magic, "JCFG", 4) == 0 &&
+            h.version == CONFIG_SCHEMA_VERSION && h.configSize == sizeof(DeviceConfig) &&
+            h.jsonSize == jsonSize && h.jsonCrc == jsonCrc &&
+            file.read((uint8_t*)&snapshot, sizeof(snapshot)) == sizeof(snapshot) &&
+            crc32_le(0, (const uint8_t*)&snapshot, sizeof(snapshot)) == h.configCrc;
+  file.close();
+  if (ok)
+    config = snapshot;
+  return ok;
+}
+
+static bool writeSnapshot(const DeviceConfig& config, uint32_t jsonSize, uint32_t jsonCrc) {
+  SnapshotHeader h;
+  memcpy(h.magic, "JCFG", 4);
+  h.version = CONFIG_SCHEMA_VERSION;
+  h.configSize = sizeof(DeviceConfig);
+  h.jsonSize = jsonSize;
+  h.jsonCrc = jsonCrc;
+  h.configCrc = crc32_le(0, (const uint8_t*)&config, sizeof(config));
+
+  File file = LittleFS.open(CONFIG_SNAPSHOT_FILE, "w");
+  if (!file)
+    return false;
+  bool ok = file.write((const uint8_t*)&h, sizeof(h)) == sizeof(h) &&
+            file.write((const uint8_t*)&config, sizeof(config)) == sizeof(config);
+  file.close();
+  if (!ok)
+    LittleFS.remove(CONFIG_SNAPSHOT_FILE);
+  return ok;
+}
+
+bool loadDeviceConfig(DeviceConfig &config) {
+  unsigned long start = micros();
+  uint32_t heapBefore = ESP.getFreeHeap();
+  loadStats.source = "none";
+
+  File file = LittleFS.open(CONFIG_JSON_FILE, "r");
+  if (!file) {
+    Serial.println("Failed to open config.json");
+    return false;
+  }
+
+  // Hashing the JSON costs a read, far less than parsing it
+  uint32_t jsonSize = file.size();
+  uint32_t jsonCrc = fileCrc(file);
+  bool ok = true;
+  if (readSnapshot(config, jsonSize, jsonCrc)) {
+    loadStats.source = "snapshot";
+  } else {
+    file.seek(0, SeekSet);
+    ok = parseJson(file, config);
+    if (ok) {
+      loadStats.source = "json";
+      writeSnapshot(config, jsonSize, jsonCrc);
+    }
+  }
+  file.close();
+
+  loadStats.jsonBytes = jsonSize;
+  loadStats.loadUs = micros() - start;
+  loadStats.heapDelta = (int32_t)heapBefore - (int32_t)ESP.getFreeHeap();
+  return ok;
+}
+
+const ConfigLoadStats& configLoadStats() {
+  return loadStats;
+}
+
 void printDeviceConfig(const DeviceConfig &config) {
   Serial.println("------ DEVICE CONFIGURATION ------");
-  Serial.println("Device Name: " + config.deviceName);
-  Serial.println("LED Brightness: " + String(config.ledBrightness));
-  Serial.println("Mode: " + String(config.mode));
-  Serial.println("Hotspot Password: " + config.hotspotPassword);
-
-  Serial.println("Light:");
-  Serial.println("  Known Color: " + config.light.knownDefaultColor);
-  Serial.println("  Unknown Color: " + config.light.unknownDefaultColor);
-  Serial.println("  Known Animation: " + config.light.knownCardAnimation);
-  Serial.println("  Unknown Animation: " + config.light.unknownCardAnimation);
-  Serial.println("  Duration: " + String(config.light.lightDuration));
-  Serial.println("  Blinks: " + String(config.light.numberOfBlinks));
-
-  Serial.println("Sound:");
-  Serial.println("  Tap Detection: " + String(config.sound.tapDetection));
-  Serial.println("  Volume: " + String(config.sound.volume));
-  Serial.println("  On Status: " + String(config.sound.onStatus));
-  Serial.println("  Duration: " + String(config.sound.duration));
-
-  Serial.println("WiFi:");
-  Serial.println("  SSID: " + config.wifi.ssid);
-  Serial.println("  Password: " + config.wifi.password);
-
-  Serial.println("Server:");
-  Serial.println("  Address: " + config.server.address);
-  Serial.println("  Port: " + String(config.server.port));
-
-  Serial.println("MQTT:");
-  Serial.println("  Enabled: " + String(config.mqtt.enable));
-  Serial.println("  Host: " + config.mqtt.host);
-  Serial.println("  Port: " + String(config.mqtt.port));
-  Serial.println("  Topic: " + config.mqtt.topic);
-  Serial.println("  User: " + config.mqtt.user);
-  Serial.println("  Pass: " + config.mqtt.pass);
-
-  Serial.println("IoT Enabled: " + String(config.iot.enabled));
+  for (size_t i = 0; i < configSchemaSize; i++) {
+    const ConfigField& f = configSchema[i];
+    const uint8_t* p = fieldPtr(config, f);
+    if (f.section)
+      Serial.printf("  %s.%s: ", f.section, f.key);
+    else
+      Serial.printf("%s: ", f.key);
+
+    switch (f.type) {
+      case CONFIG_BOOL: Serial.println(*(const bool*)p ? "true" : "false"); break;
+      case CONFIG_INT: Serial.println(*(const int*)p); break;
+      case CONFIG_STRING: Serial.println((const char*)p); break;
+      case CONFIG_COLOR: Serial.printf("#%06X\n", (unsigned)*(const uint32_t*)p); break;
+      case CONFIG_ANIMATION: Serial.println(animationName(*p)); break;
+    }
+  }
+  Serial.printf("(from %s in %u us)\n", loadStats.source, (unsigned)loadStats.loadUs);
   Serial.println("----------------------------------");
 }
+
+uint16_t diffDeviceConfig(const DeviceConfig &a, const DeviceConfig &b) {
+  uint16_t changed = 0;
+  for (size_t i = 0; i < configSchemaSize; i++) {
+    const ConfigField& f = configSchema[i];
+    bool differs = f.type == CONFIG_STRING
+                       ? strncmp((const char*)fieldPtr(a, f), (const char*)fieldPtr(b, f), f.size) != 0
+                       : memcmp(fieldPtr(a, f), fieldPtr(b, f), f.size) != 0;
+    if (differs)
+      changed |= f.group;
+  }
+  return changed;
+}
+
+const char *configSectionName(uint16_t section) {
+  switch (section) {
+    case CONFIG_IDENTITY: return "identity";
+    case CONFIG_LEDS: return "leds";
+    case CONFIG_MODE: return "mode";
+    case CONFIG_SOUND: return "sound";
+    case CONFIG_WIFI: return "wifi";
+    case CONFIG_SERVER: return "server";
+    case CONFIG_MQTT: return "mqtt";
+    case CONFIG_CELLULAR: return "cellular";
+    case CONFIG_CARD_CACHE: return "card_cache";
+    case CONFIG_IOT: return "iot";
+    case CONFIG_NFC: return "nfc";
+    case CONFIG_DEBOUNCE: return "debounce";
+    case CONFIG_VERIFY: return "verify";
+    default: return "unknown";
+  }
+}
@@ -0,0 +1,266 @@
+#include "event_uploader.h"
+#include <HTTPClient.h>
+#include <WiFi.h>
+#include <atomic>
+
+#define RATE_WINDOW_MS 10000
+
+// Settings copied by eventUploaderBegin() and picked up by the service task
+struct UploaderSettings {
+  bool enable;
+  char host[64];
+  uint16_t port;
+  char device[33];
+};
+
+static UploaderSettings pendingSettings;
+static UploaderSettings settings;
+static std::atomic<bool> settingsChanged(false);
+
+static WiFiClient client; // kept open between batches for keep-alive
+static HTTPClient http;
+static int wifiResult = 0;
+
+static const UploadTransport* transports[UPLOAD_MAX_TRANSPORTS];
+static uint8_t transportCount = 0;
+static const UploadTransport* posting = nullptr; // transport running the current batch
+static uint32_t postEnd = 0;
+static uint16_t postCount = 0;
+static unsigned long postStartMs = 0;
+
+static uint32_t sendSeq = 0; // cursor: first seq not acknowledged
+static bool cursorReady = false;
+static bool waiting = false; // a partial batch is lingering
+static unsigned long waitingSinceMs = 0;
+static unsigned long nextAttemptMs = 0;
+static unsigned long rateStartMs = 0;
+static uint32_t rateEvents = 0;
+
+static UploadStats stats = {false, "none", 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+
+// Header + UPLOAD_BATCH worst-case records
+static uint8_t body[4 + 1 + 32 + 2 + UPLOAD_BATCH * (5 + 5 + 1 + CARD_UID_MAX_LEN)];
+
+static size_t putVarint(uint8_t* out, uint32_t value) {
+  size_t n = 0;
+  while (value >= 0x80) {
+    out[n++] = (value & 0x7F) | 0x80;
+    value >>= 7;
+  }
+  out[n++] = value;
+  return n;
+}
+
+static uint32_t zigzag(int32_t value) {
+  return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+void eventUploaderBegin(const ServerConfig& config, const char* deviceName) {
+  UploaderSettings& s = pendingSettings;
+  s.enable = config.address[0] != 0;
+  strlcpy(s.host, config.address, sizeof(s.host));
+  s.port = config.port;
+  strlcpy(s.device, deviceName, sizeof(s.device));
+  settingsChanged = true;
+}
+
+static void applySettings(unsigned long now) {
+  http.end();
+  client.stop();
+  settings = pendingSettings;
+  stats.enabled = settings.enable;
+  stats.backoffMs = 0;
+  nextAttemptMs = now;
+
+  // Start at the saved cursor, or at the end of the log on first use
+  if (!cursorReady) {
+    ActivityLogStats log = activityLogStats();
+    if (!activityCursorLoad(UPLOAD_CURSOR_FILE, sendSeq) || sendSeq > log.nextSeq)
+      sendSeq = log.nextSeq;
+    cursorReady = true;
+  }
+}
+
+// Encode up to UPLOAD_BATCH records from sendSeq; end receives the seq after the last one read
+static size_t encodeBatch(uint32_t limit, uint32_t& end, uint16_t& count) {
+  size_t n = 0;
+  body[n++] = 'J';
+  body[n++] = 'T';
+  body[n++] = 'B';
+  body[n++] = 1;
+  size_t nameLen = strlen(settings.device);
+  body[n++] = nameLen;
+  memcpy(body + n, settings.device, nameLen);
+  n += nameLen;
+  size_t countAt = n;
+  n += 2;
+
+  count = 0;
+  uint32_t prevSeq = 0;
+  uint32_t prevTime = 0;
+  ActivityRecord records[16];
+  end = sendSeq;
+
+  while (end < limit && count < UPLOAD_BATCH) {
+    size_t got = activityLogReadRange(end, records, min((uint32_t)16, (uint32_t)(UPLOAD_BATCH - count)));
+    if (got == 0)
+      break;
+    for (size_t i = 0; i < got; i++) {
+      const ActivityRecord& r = records[i];
+      if (r.seq == 0xFFFFFFFF || r.uidLength == 0 || r.uidLength > CARD_UID_MAX_LEN)
+        continue; // damaged slot; nothing to deliver
+      n += putVarint(body + n, r.seq - prevSeq);
+      n += putVarint(body + n, zigzag((int32_t)(r.time - prevTime)));
+      body[n++] = (r.status << 4) | r.uidLength;
+      memcpy(body + n, r.uid, r.uidLength);
+      n += r.uidLength;
+      prevSeq = r.seq;
+      prevTime = r.time;
+      count++;
+    }
+    end += got;
+  }
+
+  body[countAt] = count & 0xFF;
+  body[countAt + 1] = count >> 8;
+  return count ? n : 0;
+}
+
+static bool wifiAvailable() {
+  return WiFi.status() == WL_CONNECTED;
+}
+
+// Blocking POST; the result is ready for wifiPoll() on return
+static bool wifiStart(const char* host, uint16_t port, const uint8_t* data, size_t len) {
+  http.setReuse(true);
+  http.setTimeout(UPLOAD_TIMEOUT_MS);
+  if (!http.begin(client, host, port, UPLOAD_PATH)) {
+    wifiResult = HTTPC_ERROR_CONNECTION_REFUSED;
+    return true;
+  }
+  http.addHeader("Content-Type", UPLOAD_CONTENT_TYPE);
+  wifiResult = http.POST((uint8_t*)data, len);
+  http.end(); // keeps the socket when the server allows keep-alive
+  return true;
+}
+
+static int wifiPoll() {
+  return wifiResult;
+}
+
+static const UploadTransport wifiTransport = {"wifi", wifiAvailable, wifiStart, wifiPoll};
+
+// Wi-Fi always comes first
+static void addWifiTransport() {
+  if (transportCount == 0)
+    transports[transportCount++] = &wifiTransport;
+}
+
+void eventUploaderAddTransport(const UploadTransport* transport) {
+  addWifiTransport();
+  if (transportCount < UPLOAD_MAX_TRANSPORTS)
+    transports[transportCount++] = transport;
+}
+
+static const UploadTransport* pickTransport() {
+  addWifiTransport();
+  for (uint8_t i = 0; i < transportCount; i++) {
+    if (transports[i]->available())
+      return transports[i];
+  }
+  return nullptr;
+}
+
+static void finishBatch(int status, unsigned long now) {
+  posting = nullptr;
+  stats.lastStatus = status;
+  stats.lastBatchMs = now - postStartMs;
+
+  if (status < 200 || status >= 300) {
+    stats.failures++;
+    stats.backoffMs = stats.backoffMs ? min(stats.backoffMs * 2, (uint32_t)UPLOAD_BACKOFF_MAX_MS)
+                                      : UPLOAD_BACKOFF_MIN_MS;
+    nextAttemptMs = now + stats.backoffMs;
+    Serial.printf("Event upload over %s failed (%d), retrying in %u ms\n",
+                  stats.transport, status, stats.backoffMs);
+    return;
+  }
+
+  // Acknowledged: move the cursor past the batch
+  sendSeq = postEnd;
+  activityCursorSave(UPLOAD_CURSOR_FILE, sendSeq);
+  stats.events += postCount;
+  stats.batches++;
+  rateEvents += postCount;
+  stats.backoffMs = 0;
+  waiting = false;
+}
+
+static void updateRate(unsigned long now) {
+  if (now - rateStartMs < RATE_WINDOW_MS)
+    return;
+  stats.eventsPerSec = rateEvents * 1000 / (now - rateStartMs);
+  rateEvents = 0;
+  rateStartMs = now;
+}
+
+void eventUploaderService(unsigned long now) {
+  if (posting) {
+    int status = posting->poll();
+    if (status != 0)
+      finishBatch(status, now);
+    return;
+  }
+
+  if (settingsChanged.exchange(false))
+    applySettings(now);
+  updateRate(now);
+  if (!stats.enabled)
+    return;
+
+  ActivityLogStats log = activityLogStats();
+  if (sendSeq < log.firstSeq) {
+    stats.lost += log.firstSeq - sendSeq;
+    sendSeq = log.firstSeq;
+  }
+  uint32_t ready = log.nextSeq - sendSeq;
+  stats.backlog = ready + log.pending;
+
+  if (ready == 0) {
+    waiting = false;
+    return;
+  }
+  if (!waiting) {
+    waiting = true;
+    waitingSinceMs = now;
+  }
+  if (ready < UPLOAD_BATCH && now - waitingSinceMs < UPLOAD_LINGER_MS)
+    return;
+  if ((long)(now - nextAttemptMs) < 0)
+    return;
+  const UploadTransport* transport = pickTransport();
+  if (!transport)
+    return;
+
+  size_t len = encodeBatch(log.nextSeq, postEnd, postCount);
+  if (len == 0) {
+    sendSeq = postEnd; // only damaged slots in range; nothing to deliver
+    return;
+  }
+
+  stats.transport = transport->name;
+  stats.lastBatchBytes = len;
+  postStartMs = millis();
+  if (!transport->start(settings.host, settings.port, body, len)) {
+    finishBatch(-1, millis());
+    return;
+  }
+  posting = transport;
+  int status = transport->poll();
+  if (status != 0)
+    finishBatch(status, millis());
+}
+
+UploadStats eventUploaderStats() {
+  return stats;
+}
@@ -0,0 +1,29 @@
+#include "latency_histogram.h"
+
+void latencyRecord(LatencyHistogram& h, uint32_t us) {
+  uint8_t bucket = 0;
+  for (uint32_t limit = LATENCY_BUCKET0_US; us >= limit && bucket < LATENCY_BUCKETS - 1; limit <<= 1)
+    bucket++;
+  h.counts[bucket]++;
+  h.total++;
+  if (us > h.maxUs)
+    h.maxUs = us;
+}
+
+uint32_t latencyBucketLimit(uint8_t bucket) {
+  return (uint32_t)LATENCY_BUCKET0_US << bucket;
+}
+
+uint32_t latencyPercentile(const LatencyHistogram& h, uint8_t percent) {
+  if (h.total == 0)
+    return 0;
+  // Rank of the percentile sample, rounded up
+  uint32_t rank = ((uint64_t)h.total * percent + 99) / 100;
+  uint32_t seen = 0;
+  for (uint8_t i = 0; i < LATENCY_BUCKETS - 1; i++) {
+    seen += h.counts[i];
+    if (seen >= rank)
+      return min(latencyBucketLimit(i), h.maxUs);
+  }
+  return h.maxUs;
+}
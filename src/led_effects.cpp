@@ -1,12 +1,228 @@
 #include "led_effects.h"
+#include <math.h>
 
-void showSolidEffect(uint32_t color, unsigned long durationMs, Adafruit_NeoPixel& strip) {
-  strip.clear();
-  for (int i = 0; i < strip.numPixels(); i++) {
-    strip.setPixelColor(i, color);
+struct LedEffectState {
+  LedAnimation animation;
+  uint32_t color;
+  unsigned long startMs;
+  unsigned long durationMs;
+  unsigned long lastFrameMs;
+  uint8_t cycles;
+  bool active;
+  bool dirty; // frame needs one more push (e.g. the final clear)
+};
+
+static LedEffectState effect = {LED_ANIM_NONE, 0, 0, 0, 0, 1, false, false};
+static uint16_t pixelCount = 0;
+static uint32_t frame[LED_MAX_PIXELS];
+static uint8_t gammaTable[256];      // perceptual intensity for fades
+static uint8_t brightnessTable[256]; // global brightness scaling
+
+static void renderFrame(unsigned long elapsed);
+
+static int hexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+uint32_t parseColor(const char* hex, size_t len) {
+  if (len < 3)
+    return 0;
+
+  if (hex[0] == '#') {
+    hex++;
+    len--;
   }
-  strip.show();
-  delay(durationMs);
-  strip.clear();
+
+  uint32_t number = 0;
+  for (size_t i = 0; i < len; i++) {
+    int v = hexValue(hex[i]);
+    if (v < 0)
+      return 0;
+    // Handle 3-digit hex (#RGB -> RRGGBB)
+    number = (len == 3) ? (number << 8) | (v << 4) | v : (number << 4) | v;
+  }
+  return number & 0xFFFFFF;
+}
+
+bool isValidColor(const char* hex, size_t len) {
+  if (len > 0 && hex[0] == '#') {
+    hex++;
+    len--;
+  }
+  if (len != 3 && len != 6)
+    return false;
+  for (size_t i = 0; i < len; i++) {
+    if (hexValue(hex[i]) < 0)
+      return false;
+  }
+  return true;
+}
+
+// Indexed by LedAnimation
+static const char* const animationNames[] = {"none", "solid", "blink", "pulse", "spin", "rainbow"};
+
+LedAnimation parseAnimation(const char* name, size_t len) {
+  for (size_t i = LED_ANIM_SOLID; i < sizeof(animationNames) / sizeof(animationNames[0]); i++) {
+    if (strlen(animationNames[i]) == len && strncmp(animationNames[i], name, len) == 0)
+      return (LedAnimation)i;
+  }
+  return LED_ANIM_NONE;
+}
+
+bool isValidAnimation(const char* name, size_t len) {
+  for (size_t i = 0; i < sizeof(animationNames) / sizeof(animationNames[0]); i++) {
+    if (strlen(animationNames[i]) == len && strncmp(animationNames[i], name, len) == 0)
+      return true;
+  }
+  return false;
+}
+
+const char* animationName(uint8_t animation) {
+  if (animation >= sizeof(animationNames) / sizeof(animationNames[0]))
+    return animationNames[LED_ANIM_NONE];
+  return animationNames[animation];
+}
+
+void ledEngineBegin(uint16_t numPixels, uint8_t brightness) {
+  pixelCount = min(numPixels, (uint16_t)LED_MAX_PIXELS);
+  for (int i = 0; i < 256; i++)
+    gammaTable[i] = (uint8_t)(powf(i / 255.0f, 2.6f) * 255.0f + 0.5f);
+  ledEngineSetBrightness(brightness);
+  memset(frame, 0, sizeof(frame));
+}
+
+void ledEngineSetBrightness(uint8_t brightness) {
+  for (int i = 0; i < 256; i++)
+    brightnessTable[i] = (i * (brightness + 1)) >> 8;
+  // Frames hold scaled colors; re-render so a held frame (solid) picks up the change
+  if (effect.active)
+    renderFrame(effect.lastFrameMs - effect.startMs);
+  effect.dirty = true;
+}
+
+// Scale a packed color by an 8-bit level, then by the global brightness
+static uint32_t scaleColor(uint32_t color, uint8_t level) {
+  uint8_t r = brightnessTable[(((color >> 16) & 0xFF) * (level + 1)) >> 8];
+  uint8_t g = brightnessTable[(((color >> 8) & 0xFF) * (level + 1)) >> 8];
+  uint8_t b = brightnessTable[((color & 0xFF) * (level + 1)) >> 8];
+  return ((uint32_t)r << 16) | ((uint32_t)g << 8) | b;
+}
+
+// Colour wheel: position 0..1535 through red, green and blue
+static uint32_t wheel(uint16_t pos) {
+  pos %= 1536;
+  uint8_t v = pos & 0xFF;
+  switch (pos >> 8) {
+    case 0: return 0xFF0000 | ((uint32_t)v << 8);
+    case 1: return ((uint32_t)(255 - v) << 16) | 0x00FF00;
+    case 2: return 0x00FF00 | v;
+    case 3: return ((uint32_t)(255 - v) << 8) | 0x0000FF;
+    case 4: return ((uint32_t)v << 16) | 0x0000FF;
+    default: return 0xFF0000 | (255 - v);
+  }
+}
+
+static void fillFrame(uint32_t color) {
+  for (uint16_t i = 0; i < pixelCount; i++)
+    frame[i] = color;
+}
+
+static void renderFrame(unsigned long elapsed) {
+  // Period of one blink/pulse cycle; continuous effects use a fixed one
+  unsigned long period = effect.durationMs ? max(effect.durationMs / effect.cycles, 1UL) : 1000;
+  unsigned long phase = elapsed % period;
+
+  switch (effect.animation) {
+    case LED_ANIM_SOLID:
+      fillFrame(scaleColor(effect.color, 255));
+      break;
+
+    case LED_ANIM_BLINK:
+      fillFrame(phase < period / 2 ? scaleColor(effect.color, 255) : 0);
+      break;
+
+    case LED_ANIM_PULSE: {
+      // Triangle wave through the gamma table
+      uint32_t ramp = (phase * 510) / period;
+      uint8_t level = ramp < 256 ? ramp : 510 - ramp;
+      fillFrame(scaleColor(effect.color, gammaTable[level]));
+      break;
+    }
+
+    case LED_ANIM_SPIN: {
+      // One lit head with a fading tail, one pixel per frame
+      uint16_t head = (elapsed / LED_FRAME_MS) % pixelCount;
+      fillFrame(0);
+      for (uint8_t t = 0; t < 4 && t < pixelCount; t++) {
+        uint16_t i = (head + pixelCount - t) % pixelCount;
+        frame[i] = scaleColor(effect.color, gammaTable[255 >> t]);
+      }
+      break;
+    }
+
+    case LED_ANIM_RAINBOW: {
+      uint16_t offset = (elapsed * 1536 / 2000) % 1536; // one turn every 2 s
+      for (uint16_t i = 0; i < pixelCount; i++)
+        frame[i] = scaleColor(wheel(offset + i * 1536 / pixelCount), 255);
+      break;
+    }
+
+    default:
+      fillFrame(0);
+      break;
+  }
+}
+
+void ledEffectStart(LedAnimation animation, uint32_t color, unsigned long durationMs,
+                    uint8_t cycles, unsigned long now) {
+  effect.animation = animation;
+  effect.color = color;
+  effect.startMs = now;
+  effect.durationMs = durationMs;
+  effect.cycles = cycles ? cycles : 1;
+  effect.active = animation != LED_ANIM_NONE;
+  effect.lastFrameMs = now;
+  renderFrame(0);
+  effect.dirty = true;
+}
+
+void ledEffectStop() {
+  if (effect.active || frame[0] != 0)
+    effect.dirty = true;
+  effect.active = false;
+  fillFrame(0);
+}
+
+bool ledEffectActive() {
+  return effect.active;
+}
+
+bool ledEffectTick(unsigned long now) {
+  if (effect.active) {
+    unsigned long elapsed = now - effect.startMs;
+    if (effect.durationMs && elapsed >= effect.durationMs) {
+      ledEffectStop();
+    } else if (effect.animation != LED_ANIM_SOLID && now - effect.lastFrameMs >= LED_FRAME_MS) {
+      effect.lastFrameMs = now;
+      renderFrame(elapsed);
+      effect.dirty = true;
+    }
+  }
+
+  bool changed = effect.dirty;
+  effect.dirty = false;
+  return changed;
+}
+
+const uint32_t* ledFrame() {
+  return frame;
+}
+
+void ledEffectShow(Adafruit_NeoPixel& strip) {
+  for (uint16_t i = 0; i < pixelCount; i++)
+    strip.setPixelColor(i, frame[i]);
   strip.show();
 }
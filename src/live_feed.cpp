@@ -0,0 +1,155 @@
+#include "live_feed.h"
+#include "spsc_queue.h"
+#include <atomic>
+
+// A tap handed over by the NFC task
+struct FeedTap {
+  uint32_t seq;
+  uint32_t time;
+  uint8_t status;
+  bool logged;
+  CardUid uid;
+};
+
+static AsyncEventSource source(LIVE_FEED_PATH);
+static LiveStatusFn statusFn = nullptr;
+
+static SpscQueue<FeedTap, 16> tapQueue;
+static std::atomic<bool> logCleared(false);
+
+static char lastStatus[256] = "";  // latest digest, also sent to new clients
+static bool statusDirty = false;   // lastStatus has not been broadcast yet
+static unsigned long lastStatusCheckMs = 0;
+static unsigned long lastStatusSentMs = 0;
+
+static LiveFeedStats stats = {0, 0, 0, 0, 0, 0, 0};
+
+// Taps the client missed, from the id it last saw; runs in the connect callback
+static void replay(AsyncEventSourceClient* client) {
+  uint32_t lastId = client->lastId();
+  if (lastId == 0)
+    return;
+
+  ActivityLogStats log = activityLogStats();
+  uint32_t seq = max(lastId, log.firstSeq);
+  if (log.nextSeq - seq > LIVE_FEED_REPLAY_MAX)
+    seq = log.nextSeq - LIVE_FEED_REPLAY_MAX;
+
+  ActivityRecord records[8];
+  char json[128];
+  while (seq < log.nextSeq) {
+    size_t n = activityLogReadRange(seq, records, min((uint32_t)8, log.nextSeq - seq));
+    if (n == 0)
+      break;
+    for (size_t i = 0; i < n; i++) {
+      if (records[i].seq == 0xFFFFFFFF)
+        continue;
+      activityRecordToJson(records[i], json, sizeof(json));
+      client->send(json, "tap", records[i].seq + 1);
+      stats.replayed++;
+    }
+    seq += n;
+  }
+}
+
+void liveFeedBegin(AsyncWebServer& server, LiveStatusFn status) {
+  statusFn = status;
+
+  source.onConnect([](AsyncEventSourceClient* client) {
+    if (source.count() > LIVE_FEED_MAX_CLIENTS) {
+      stats.rejected++;
+      client->close();
+      return;
+    }
+    stats.connects++;
+    client->send("hello", nullptr, 0, 3000); // retry after 3 s when the connection drops
+    replay(client);
+    if (lastStatus[0])
+      client->send(lastStatus, "status");
+  });
+
+  server.addHandler(&source);
+}
+
+void liveFeedTap(const CardUid& uid, uint32_t time, ActivityStatus status, bool logged, uint32_t seq) {
+  FeedTap tap = {seq, time, status, logged, uid};
+  if (!tapQueue.push(tap))
+    stats.dropped++;
+}
+
+void liveFeedLogCleared() {
+  logCleared = true;
+}
+
+static void sendTap(const FeedTap& tap) {
+  char json[128];
+  if (tap.logged) {
+    ActivityRecord record;
+    memset(&record, 0, sizeof(record));
+    record.seq = tap.seq;
+    record.time = tap.time;
+    record.status = tap.status;
+    record.uidLength = tap.uid.length;
+    memcpy(record.uid, tap.uid.bytes, tap.uid.length);
+    activityRecordToJson(record, json, sizeof(json));
+    source.send(json, "tap", tap.seq + 1);
+  } else {
+    char uidHex[CARD_UID_HEX_SIZE];
+    cardUidToHex(tap.uid, uidHex);
+    snprintf(json, sizeof(json), "{\"time\":%u,\"uid\":\"%s\"}", (unsigned)tap.time, uidHex);
+    source.send(json, "tap");
+  }
+  stats.events++;
+}
+
+// Send the digest when it changed or the heartbeat is due; held back while
+// clients are not draining, since a newer digest replaces it anyway
+static void serviceStatus(unsigned long now) {
+  if (!statusFn || now - lastStatusCheckMs < LIVE_FEED_STATUS_MS)
+    return;
+  lastStatusCheckMs = now;
+
+  char json[sizeof(lastStatus)];
+  size_t len = statusFn(json, sizeof(json));
+  if (len == 0 || len >= sizeof(json))
+    return;
+  if (strcmp(json, lastStatus) != 0) {
+    memcpy(lastStatus, json, len + 1);
+    statusDirty = true;
+  }
+  if (!statusDirty && now - lastStatusSentMs < LIVE_FEED_HEARTBEAT_MS)
+    return;
+  if (source.avgPacketsWaiting() >= LIVE_FEED_SLOW_QUEUE) {
+    stats.deferred++;
+    return;
+  }
+  source.send(lastStatus, "status");
+  lastStatusSentMs = now;
+  statusDirty = false;
+  stats.events++;
+}
+
+void liveFeedService(unsigned long now) {
+  stats.clients = source.count();
+
+  // With nobody listening the queue is just drained
+  FeedTap tap;
+  while (tapQueue.pop(tap)) {
+    if (stats.clients)
+      sendTap(tap);
+  }
+
+  if (logCleared.exchange(false) && stats.clients) {
+    char json[48];
+    snprintf(json, sizeof(json), "{\"cleared\":true,\"next_seq\":%u}", (unsigned)activityLogStats().nextSeq);
+    source.send(json, "log");
+    stats.events++;
+  }
+
+  if (stats.clients)
+    serviceStatus(now);
+}
+
+LiveFeedStats liveFeedStats() {
+  return stats;
+}
@@ -5,33 +5,140 @@
 #include <LittleFS.h>
 #include <ArduinoJson.h>
 #include "config_manager.h"
+#include "card_store.h"
+#include "led_effects.h"
+#include "spsc_queue.h"
+#include "task_runner.h"
+#include "activity_log.h"
+#include "mqtt_publisher.h"
+#include "event_uploader.h"
+#include "sim800_modem.h"
+#include "web_ui.h"
+#include "live_feed.h"
+#include "boot_timeline.h"
+#include "nfc_reader.h"
+#include "tap_debounce.h"
+#include "buzzer.h"
+#include "tap_pipeline.h"
+#include "online_verify.h"
+#include "verify_cache.h"
+#include "attendance.h"
 #include <HardwareSerial.h>
 #include <WiFi.h>
-#include <WebServer.h>
+#include <AsyncTCP.h>
+#include <ESPAsyncWebServer.h>
+#include <memory>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 #include <time.h>
 #include "esp_wifi.h" // for esp_wifi_set_ps()
 
 #define SDA_PIN 21
 #define SCL_PIN 22
+#define PN532_RESET_PIN -1 // not wired; the IRQ pin comes from config
 #define LED_PIN 13
 #define NUM_PIXELS 24
 #define BUZZER_PIN 5   // or GPIO14
 #define BATTERY_PIN 36 // Use GPIO36 / ADC1_CH0
+#define MODEM_RX_PIN 16
+#define MODEM_TX_PIN 17
 
-Adafruit_PN532 nfc(SDA_PIN, SCL_PIN);
+Adafruit_PN532 *nfc = nullptr; // created in setup() with the configured IRQ pin
 Adafruit_NeoPixel pixels(NUM_PIXELS, LED_PIN, NEO_GRB + NEO_KHZ800);
 
 DeviceConfig deviceConfig;
 
-WebServer server(80); // ✅ Synchronous server
-
-bool effectActive = false;
-unsigned long effectStartTime = 0;
-uint32_t currentColor = 0;
-String lastCardUID = "";
-String lastCard = "";
+HardwareSerial modemSerial(2); // SIM800L on Serial2
+
+AsyncWebServer server(80); // requests are handled on the async_tcp task, many connections at once
+unsigned long restartAtMs = 0;                // set by /save; the web task restarts once the reply is out
+
+// Card imports: rows are staged as the request body arrives on async_tcp; the
+// build and swap run on the web task while the reply waits for the result
+AsyncWebServerRequest *importOwner = nullptr;   // request whose import is staging or building, until answered
+std::atomic<bool> importBuildPending(false);    // staged rows wait for the web task
+AsyncWebServerRequest *importRefused = nullptr; // last upload turned away at its first chunk
+int importRefusedStatus = 0;
+
+// /save: the web task validates, writes and applies the posted config
+struct ConfigSaveJob {
+  String json;     // handed over before configSavePending is set
+  char reply[256]; // outcome page, written by the web task
+};
+ConfigSaveJob configSave;
+std::atomic<bool> configSavePending(false);
+AsyncWebServerRequest *configSaveOwner = nullptr; // request waiting for the outcome
+
+// Set by the NFC task when it queues an effect, cleared by the output task when it ends;
+// NFC polling pauses while it is set
+std::atomic<bool> effectActive(false);
+bool effectPlaying = false;             // output task: the current effect came from a tap
+CardInfo unknownCard = {0, LED_ANIM_NONE}; // pre-parsed unknown-card defaults
+
+// Hot config reload. /save applies only the sections that changed. The web task
+// replaces deviceConfig under configLock; the tap tasks keep copies of what they
+// read per tap and refresh them under the lock when flagged.
+const uint16_t CONFIG_RESTART_SECTIONS = CONFIG_CELLULAR | CONFIG_CARD_CACHE | CONFIG_NFC; // need a reboot
+SemaphoreHandle_t configLock = nullptr;
+
+struct ConfigLock {
+  ConfigLock() { xSemaphoreTake(configLock, portMAX_DELAY); }
+  ~ConfigLock() { xSemaphoreGive(configLock); }
+};
+
+// NFC task copy
+struct TapConfig {
+  LightConfig light;
+  SoundConfig sound;
+};
+TapConfig tapConfig;
+std::atomic<uint16_t> tapConfigChanged(0);    // ConfigSection bits the NFC task has not picked up
+LightConfig effectLight;                      // output task copy, for effect timings
+std::atomic<bool> outputConfigChanged(false); // the output task re-reads brightness and timings
+unsigned long wifiReconnectAtMs = 0;          // the web task rejoins once the reply is out
+unsigned long apRestartAtMs = 0;              // the web task restarts the soft AP once the reply is out
+
+struct ConfigApplyStats {
+  uint32_t applies;
+  uint16_t lastChanged; // ConfigSection bits
+  uint32_t lastApplyUs; // diff plus every affected subsystem updated
+};
+ConfigApplyStats configApplyStats = {0, 0, 0};
+CardUid lastCard = {0, {0}}; // last card seen, for /lastuid
+
+// Per-tap free-heap delta, to verify the tap path does not allocate
+struct TapStats {
+  uint32_t taps;
+  int32_t lastHeapDelta;
+  int32_t worstHeapDelta;
+};
+TapStats tapStats = {0, 0, 0};
+
+// NFC task -> output task
+enum OutputKind : uint8_t { OUTPUT_TAP, OUTPUT_REPEAT };
+struct OutputEvent {
+  OutputKind kind;
+  CardInfo card;
+  uint8_t sound; // BuzzerSound
+};
+
+SpscQueue<OutputEvent, 8> outputQueue;
+
+AppTask nfcTask;
+AppTask outputTask;
+AppTask logTask;
+AppTask webTask;
+AppTask mqttTask;
+AppTask uploadTask;
+AppTask verifyTask;
 
 bool timeReady = false;
+bool configLoaded = false;
+bool nfcReady = false;           // PN532 answered and is configured
+unsigned long lastNfcProbeMs = 0;
+const unsigned long NFC_PROBE_INTERVAL_MS = 500;
+uint32_t wifiStartMs = 0;        // station start, for the wifi_ip boot phase
+bool wifiIpMarked = false;
 unsigned long ntpStartTime = 0;
 const unsigned long ntpTimeout = 10000; // 10 seconds
 
@@ -54,51 +161,18 @@ int batteryPercentage(float voltage){
     return (int)(((voltage - 3.0) / (4.2 - 3.0)) * 100);
 }
 
-void beep(int duration = 50){
-  digitalWrite(BUZZER_PIN, HIGH);
-  delay(duration);
-  digitalWrite(BUZZER_PIN, LOW);
-}
-
-uint32_t parseHexColor(const String &hexColor){
-  if (hexColor.length() < 3)
-    return pixels.Color(0, 0, 0); // Default black
-
-  String hex = hexColor;
-  if (hex.charAt(0) == '#')
-    hex = hex.substring(1);
-
-  // Handle 3-digit hex (#RGB -> RRGGBB)
-  if (hex.length() == 3)
+// Raw config for the editor page, streamed from the file
+void handleConfigJson(AsyncWebServerRequest *request){
+  if (!LittleFS.exists(CONFIG_JSON_FILE))
   {
-    hex = String(hex[0]) + hex[0] + hex[1] + hex[1] + hex[2] + hex[2];
-  }
-
-  // Validate hex
-  for (unsigned int i = 0; i < hex.length(); i++)
-  {
-    if (!isxdigit(hex[i]))
-      return pixels.Color(0, 0, 0);
+    request->send(200, "application/json", "{}");
+    return;
   }
-
-  long number = strtol(hex.c_str(), NULL, 16);
-  byte r = (number >> 16) & 0xFF;
-  byte g = (number >> 8) & 0xFF;
-  byte b = number & 0xFF;
-  return pixels.Color(r, g, b);
-}
-
-String loadConfigAsString(){
-  File configFile = LittleFS.open("/config.json", "r");
-  if (!configFile)
-    return "{}";
-  String content = configFile.readString();
-  configFile.close();
-  return content;
+  request->send(LittleFS, CONFIG_JSON_FILE, "application/json");
 }
 
 bool saveConfigFromString(const String &jsonString){
-  File configFile = LittleFS.open("/config.json", "w");
+  File configFile = LittleFS.open(CONFIG_JSON_FILE, "w");
   if (!configFile)
     return false;
   configFile.print(jsonString);
@@ -106,61 +180,16 @@ bool saveConfigFromString(const String &jsonString){
   return true;
 }
 
-void logActivity(const String &uid, const String &status){
-  File f = LittleFS.open("/activities.log", "a");
-  if (!f)
-  {
-    Serial.println("❌ Failed to open activities.log for writing");
-    return;
-  }
-
-  char ts[32];
-  if (timeReady)
-  {
-    struct tm timeinfo;
-    if (getLocalTime(&timeinfo))
-    {
-      strftime(ts, sizeof(ts), "%Y-%m-%d %H:%M:%S", &timeinfo);
-    }
-    else
-    {
-      strcpy(ts, "unknown");
-    }
-  }
-  else
-  {
-    strcpy(ts, "unknown");
-  }
-
-  // One compact JSON object per line
-  f.printf("{\"time\":\"%s\",\"uid\":\"%s\",\"status\":\"%s\"}\n",
-           ts, uid.c_str(), status.c_str());
-
-  f.flush(); // ensure data is written to flash
-  f.close();
-  Serial.printf("📄 Logged activity: %s %s\n", uid.c_str(), status.c_str());
-}
-
-void startSolidEffect(uint32_t color){
-  // Ensure brightness is within safe bounds
-  uint8_t brightness = constrain(deviceConfig.ledBrightness, 5, 255);
-  pixels.setBrightness(brightness);
-
-  for (int i = 0; i < NUM_PIXELS; i++)
-  {
-    pixels.setPixelColor(i, color);
-  }
-  pixels.show();
-  effectStartTime = millis();
-  effectActive = true;
-  currentColor = color;
+void startCardEffect(const CardInfo &card){
+  ledEffectStart((LedAnimation)card.animation, card.color, effectLight.lightDuration,
+                 effectLight.numberOfBlinks, millis());
+  effectPlaying = ledEffectActive();
 }
 
 void clearLEDs(){
-  pixels.clear();
-  pixels.show();
+  ledEffectStop();
+  effectPlaying = false;
   effectActive = false;
-  lastCardUID = "";
 }
 
 // Start the Access Point with static IP and stability tweaks
@@ -202,11 +231,13 @@ void ensureAPAlive(const char *ssid, const char *pass){
   }
 }
 
+// Reads deviceConfig unlocked: it runs at boot, before /save is served, or on the
+// web task, which is the only writer
 void connectToWiFi(){
   Serial.println("Setting up AP + STA...");
   WiFi.mode(WIFI_AP_STA);
 
-  WiFi.begin(deviceConfig.wifi.ssid.c_str(), deviceConfig.wifi.password.c_str());
+  WiFi.begin(deviceConfig.wifi.ssid, deviceConfig.wifi.password);
 
   // unsigned long startTime = millis();
   // const unsigned long timeout = 10000;
@@ -227,356 +258,500 @@ void connectToWiFi(){
   }
 }
 
-void handleRoot(){
-  String html = "<html><body><h2>Edit Config</h2>";
-  html += "<form method='POST' action='/save'>";
-  html += "<textarea name='config' rows='30' cols='80'>";
-  html += loadConfigAsString();
-  html += "</textarea><br><br>";
-  html += "<input type='submit' value='Save & Reboot'>";
-  html += "</form></body>";
-  html += "<a href='/status'>See Main Details</a>&nbsp;<a href='/'>reload page</a>&nbsp;";
-  html += "<a href='/card'>card raw editor</a>&nbsp;<a href='/cards'>see all cards</a>&nbsp;<a href='/cards/manage'>Manage cards</a>&nbsp;";
-  html += "<a href='/activities'>See all logs</a>&nbsp;";
-  html += "<a href='/activities/delete'>Delete all logs</a>&nbsp;";
-  html += "<a href='/update'>Add update</a></html>";
-  server.send(200, "text/html", html);
+// Adopt next as the running config and re-initialize only what changed.
+// Runs on the web task, from a /save handed over by the async server.
+uint16_t applyDeviceConfig(const DeviceConfig &next){
+  unsigned long start = micros();
+  uint16_t changed = diffDeviceConfig(deviceConfig, next);
+  {
+    ConfigLock lock;
+    deviceConfig = next;
+  }
+
+  // Light, sound, mode, debounce and verify settings are picked up by the NFC task
+  tapConfigChanged |= changed;
+  if (changed & CONFIG_LEDS)
+    outputConfigChanged = true;
+  if (changed & CONFIG_SOUND)
+    buzzerConfigure(next.sound);
+  if (changed & (CONFIG_MQTT | CONFIG_IDENTITY))
+    mqttPublisherBegin(next.mqtt, next.deviceName);
+  if (changed & (CONFIG_SERVER | CONFIG_IDENTITY))
+  {
+    eventUploaderBegin(next.server, next.deviceName);
+    onlineVerifyBegin(next.server, next.deviceName);
+  }
+  if (changed & CONFIG_WIFI)
+    wifiReconnectAtMs = millis() + 500;
+  if (changed & CONFIG_IDENTITY)
+    apRestartAtMs = millis() + 1500; // the SSID and password; the reply may be going out over the AP
+
+  configApplyStats.applies++;
+  configApplyStats.lastChanged = changed;
+  configApplyStats.lastApplyUs = micros() - start;
+  return changed;
 }
 
-void handleSave(){
-  if (!server.hasArg("config"))
+// Comma-separated names of the ConfigSection bits in changed
+String configSectionList(uint16_t changed){
+  String names;
+  for (uint16_t bit = 1; bit < (1 << CONFIG_SECTION_COUNT); bit <<= 1)
   {
-    server.send(400, "text/plain", "Missing config data.");
-    return;
+    if (!(changed & bit))
+      continue;
+    if (names.length())
+      names += ", ";
+    names += configSectionName(bit);
   }
+  return names;
+}
+
+void handleRoot(AsyncWebServerRequest *request){
+  serveWebAsset(request, "index.html");
+}
+
+// Buffer behind a chunked response: the state's fill() appends the next piece
+// and the response copies it out as the connection accepts data
+struct ChunkStream {
+  char buf[1024];
+  size_t used;
+  size_t pos;
+  bool first;
+  bool done;
+  bool waiting; // fill() had nothing yet; the response retries on the next poll
+};
+
+// Chunked response driven by state->fill(), which sets stream.done after the last piece
+// or stream.waiting when its data is not ready
+template <typename State>
+AsyncWebServerResponse *beginStream(AsyncWebServerRequest *request, const char *contentType,
+                                    std::shared_ptr<State> state){
+  return request->beginChunkedResponse(contentType, [state](uint8_t *out, size_t maxLen, size_t index) -> size_t {
+    ChunkStream &stream = state->stream;
+    while (stream.pos == stream.used)
+    {
+      if (stream.done)
+        return 0;
+      stream.used = 0;
+      stream.pos = 0;
+      stream.waiting = false;
+      state->fill();
+      if (stream.waiting && stream.used == 0)
+        return RESPONSE_TRY_AGAIN;
+    }
+    size_t n = min(maxLen, stream.used - stream.pos);
+    memcpy(out, stream.buf + stream.pos, n);
+    stream.pos += n;
+    return n;
+  });
+}
 
-  String raw = server.arg("config");
-  StaticJsonDocument<2048> test;
-  auto err = deserializeJson(test, raw);
+// Web task: the /save work, kept off async_tcp because it writes flash
+void runConfigSave(){
+  char *reply = configSave.reply;
+  size_t cap = sizeof(configSave.reply);
+  DynamicJsonDocument test(2048);
+  auto err = deserializeJson(test, configSave.json);
   if (err)
   {
-    server.send(400, "text/plain", String("Invalid JSON: ") + err.c_str());
+    snprintf(reply, cap, "<html><body><h3>Invalid JSON: %s <a href='/'> <back</a></h3></body></html>", err.c_str());
     return;
   }
   // optionally check test["wifi"]["ssid"] etc.
   // then write file
 
-  if (saveConfigFromString(raw))
+  if (!saveConfigFromString(configSave.json))
   {
-    server.send(200, "text/html", "<html><body><h3>Saved! Rebooting... <a href='/'> <back</a></h3></body></html>");
-    delay(500);
-    server.client().stop();
-    ESP.restart();
+    snprintf(reply, cap, "<html><body><h3>Failed to save config. <a href='/'> <back</a></h3></body></html>");
+    return;
   }
-  else
+
+  DeviceConfig next;
+  if (!loadDeviceConfig(next))
   {
-    server.send(500, "text/plain", "Failed to save config.");
-  }
-}
-
-void handleManageUI(){
-  String html = R"rawliteral(
-    <html><body>
-    <h2>Add New Card</h2>
-    <form onsubmit="addCard(event)">
-      UID: <input name="uid" id="uid"><br>
-      Color: <input name="color" id="color" value="#00FF00"><br>
-      Animation: 
-      <select id="animation">
-        <option value="solid">Solid</option>
-      </select><br>
-      <input type="submit" value="Add Card">
-    </form>
-
-    <hr>
-    <h2>Registered Cards</h2>
-    <div id="card-list">Loading...</div>
-
-    <script>
-    async function fetchLastUID() {
-      const res = await fetch('/lastuid');
-      const uid = await res.text();
-      document.getElementById('uid').value = uid;
-    }
+    snprintf(reply, cap, "<html><body><h3>Saved, but the config did not load back. <a href='/'> <back</a></h3></body></html>");
+    return;
+  }
 
-    async function fetchCards() {
-      const res = await fetch('/cards');
-      const cards = await res.json();
-      let html = "<ul>";
-      for (let c of cards) {
-        html += `<li><b>${c.uid}</b> - ${c.color} - ${c.animation}
-          <button onclick="del('${c.uid}')">Delete</button></li>`;
-      }
-      html += "</ul>";
-      document.getElementById('card-list').innerHTML = html;
-    }
+  uint16_t changed = applyDeviceConfig(next);
+  String sections = changed ? configSectionList(changed) : String("nothing changed");
+  if (changed & CONFIG_RESTART_SECTIONS)
+  {
+    snprintf(reply, cap, "<html><body><h3>Saved! Rebooting to apply %s... <a href='/'> <back</a></h3></body></html>",
+             sections.c_str());
+    restartAtMs = millis() + 1500; // the waiting reply goes out on the next poll
+    return;
+  }
 
-    async function addCard(e) {
-      e.preventDefault();
-      const uid = document.getElementById('uid').value;
-      const color = document.getElementById('color').value;
-      const animation = document.getElementById('animation').value;
+  snprintf(reply, cap, "<html><body><h3>Saved and applied in %u us: %s <a href='/'> <back</a></h3></body></html>",
+           configApplyStats.lastApplyUs, sections.c_str());
+}
 
-      const params = new URLSearchParams({ uid, color, animation });
-      await fetch('/cards/add', { method: 'POST', body: params });
-      fetchCards();
-    }
+// Reply to /save once the web task is done with it
+struct ConfigSaveReplyStream {
+  ChunkStream stream;
+  AsyncWebServerRequest *request;
 
-    async function del(uid) {
-      const params = new URLSearchParams({ uid });
-      await fetch('/cards/delete', {
-        method: 'POST',
-        headers: {
-          'Content-Type': 'application/x-www-form-urlencoded'
-        },
-        body: params.toString()
-      });
-      fetchCards();
+  void fill(){
+    if (configSavePending)
+    {
+      stream.waiting = true;
+      return;
     }
+    stream.used = min(strlen(configSave.reply), sizeof(stream.buf));
+    memcpy(stream.buf, configSave.reply, stream.used);
+    if (configSaveOwner == request)
+      configSaveOwner = nullptr;
+    stream.done = true;
+  }
+};
 
+void handleSave(AsyncWebServerRequest *request){
+  if (!request->hasArg("config"))
+  {
+    request->send(400, "text/plain", "Missing config data.");
+    return;
+  }
+  if (configSaveOwner || configSavePending)
+  {
+    request->send(409, "text/plain", "Another save is in progress.");
+    return;
+  }
 
-    fetchLastUID();
-    fetchCards();
-    </script>
-    </body></html>
-  )rawliteral";
+  configSave.json = request->arg("config");
+  configSaveOwner = request;
+  request->onDisconnect([request]()
+                        {
+    if (configSaveOwner == request)
+      configSaveOwner = nullptr; });
+  configSavePending = true;
+
+  std::shared_ptr<ConfigSaveReplyStream> state = std::make_shared<ConfigSaveReplyStream>();
+  memset(&state->stream, 0, sizeof(state->stream));
+  state->request = request;
+  request->send(beginStream(request, "text/html", state));
+}
 
-  server.send(200, "text/html", html);
+void handleManageUI(AsyncWebServerRequest *request){
+  serveWebAsset(request, "manage.html");
 }
 
-void handleLastUID(){
-  if (lastCard == "")
+void handleLastUID(AsyncWebServerRequest *request){
+  if (lastCard.length == 0)
   {
-    server.send(200, "text/plain", "NO CARD"); // or optionally send "none"
+    request->send(200, "text/plain", "NO CARD"); // or optionally send "none"
   }
   else
   {
-    server.send(200, "text/plain", lastCard);
+    char uidHex[CARD_UID_HEX_SIZE];
+    cardUidToHex(lastCard, uidHex);
+    request->send(200, "text/plain", uidHex);
   }
 }
 
-// Find a card in CSV file
-bool loadCardColorAndAnimation(String uidStr, String &colorHex, String &animation){
-  File file = LittleFS.open("/cards.txt", "r");
-  if (!file)
-    return false;
-
-  while (file.available())
+// Append text as a JSON string body, escaping quotes, backslashes and control characters
+void jsonStreamEscaped(ChunkStream &out, const char *text){
+  for (; *text && out.used < sizeof(out.buf) - 2; text++)
   {
-    String line = file.readStringUntil('\n');
-    line.trim();
-    if (line.length() == 0)
-      continue;
-
-    int firstComma = line.indexOf(',');
-    int secondComma = line.indexOf(',', firstComma + 1);
-    if (firstComma == -1 || secondComma == -1)
-      continue;
-
-    String fileUID = line.substring(0, firstComma);
-    if (fileUID.equalsIgnoreCase(uidStr))
+    char c = *text;
+    if (c == '"' || c == '\\')
     {
-      colorHex = line.substring(firstComma + 1, secondComma);
-      animation = line.substring(secondComma + 1);
-      file.close();
-      return true;
+      out.buf[out.used++] = '\\';
+      out.buf[out.used++] = c;
+    }
+    else
+    {
+      out.buf[out.used++] = ((uint8_t)c < 0x20) ? ' ' : c;
     }
   }
-
-  file.close();
-  return false;
 }
 
-// List all cards as JSON for UI
-void handleListCards(){
-  File file = LittleFS.open("/cards.txt", "r");
-  if (!file)
-  {
-    server.send(200, "application/json", "[]");
-    return;
-  }
-
-  String output = "[";
-  bool first = true;
-
-  while (file.available())
-  {
-    String line = file.readStringUntil('\n');
-    line.trim();
-    if (line.length() == 0)
-      continue;
+// Room one card needs in a chunk, as escaped JSON
+const size_t CARD_CHUNK_SIZE = 2 * sizeof(CardText) + 48;
+
+void streamCardJson(const CardText &card, void *context){
+  ChunkStream &out = *(ChunkStream *)context;
+  out.used += snprintf(out.buf + out.used, sizeof(out.buf) - out.used, "%s{\"uid\":\"", out.first ? "" : ",");
+  jsonStreamEscaped(out, card.uid);
+  out.used += snprintf(out.buf + out.used, sizeof(out.buf) - out.used, "\",\"color\":\"");
+  jsonStreamEscaped(out, card.color);
+  out.used += snprintf(out.buf + out.used, sizeof(out.buf) - out.used, "\",\"animation\":\"");
+  jsonStreamEscaped(out, card.animation);
+  out.used += snprintf(out.buf + out.used, sizeof(out.buf) - out.used, "\"}");
+  out.first = false;
+}
 
-    int firstComma = line.indexOf(',');
-    int secondComma = line.indexOf(',', firstComma + 1);
-    if (firstComma == -1 || secondComma == -1)
-      continue;
+void streamCardCsv(const CardText &card, void *context){
+  ChunkStream &out = *(ChunkStream *)context;
+  out.used += snprintf(out.buf + out.used, sizeof(out.buf) - out.used, "%s,%s,%s\n",
+                       card.uid, card.color, card.animation);
+}
 
-    String uid = line.substring(0, firstComma);
-    String color = line.substring(firstComma + 1, secondComma);
-    String animation = line.substring(secondComma + 1);
+// Cards as a JSON array or CSV lines, as many per chunk as fit. With a cursor
+// (?next=) the array is wrapped as {"cards":[...],"next":<slot or null>}.
+struct CardListStream {
+  ChunkStream stream;
+  CardListCursor cursor;
+  char prefix[CARD_UID_HEX_SIZE];
+  uint32_t remaining;
+  bool json;
+  bool paged;
+  bool started;
+
+  void fill(){
+    if (json && !started)
+    {
+      const char *open = paged ? "{\"cards\":[" : "[";
+      stream.used += strlcpy(stream.buf, open, sizeof(stream.buf));
+    }
+    started = true;
 
-    if (!first)
-      output += ",";
-    first = false;
+    uint32_t fit = (sizeof(stream.buf) - stream.used - 32) / CARD_CHUNK_SIZE;
+    uint32_t batch = min(remaining, fit);
+    uint32_t visited = 0;
+    if (batch)
+      visited = cardStoreListNext(cursor, prefix, batch, json ? streamCardJson : streamCardCsv, &stream);
+    remaining -= visited;
 
-    output += "{\"uid\":\"" + uid + "\",\"color\":\"" + color + "\",\"animation\":\"" + animation + "\"}";
+    if (cursor.done || remaining == 0)
+    {
+      if (json && paged && cursor.done)
+        stream.used += snprintf(stream.buf + stream.used, sizeof(stream.buf) - stream.used, "],\"next\":null}");
+      else if (json && paged)
+        stream.used += snprintf(stream.buf + stream.used, sizeof(stream.buf) - stream.used, "],\"next\":%u}",
+                                (unsigned)cursor.slot);
+      else if (json)
+        stream.buf[stream.used++] = ']';
+      stream.done = true;
+    }
+    else if (visited == 0 && stream.used == 0)
+    {
+      stream.waiting = true; // a slot scan ran out without a match; go on at the next poll
+    }
   }
-
-  file.close();
-  output += "]";
-  server.send(200, "application/json", output);
+};
+
+std::shared_ptr<CardListStream> newCardListStream(const String &prefix, uint32_t slot, uint32_t offset, uint32_t limit,
+                                                  bool json, bool paged){
+  std::shared_ptr<CardListStream> state = std::make_shared<CardListStream>();
+  memset(&state->stream, 0, sizeof(state->stream));
+  state->stream.first = true;
+  state->cursor = {slot, offset, false};
+  strlcpy(state->prefix, prefix.c_str(), sizeof(state->prefix));
+  state->remaining = limit;
+  state->json = json;
+  state->paged = paged;
+  state->started = false;
+  return state;
 }
 
-// Add a card to CSV
-void handleAddCard(){
-  if (!server.hasArg("uid") || !server.hasArg("color") || !server.hasArg("animation"))
-  {
-    server.send(400, "text/plain", "Missing uid/color/animation");
-    return;
-  }
+// Export every card as "uid,color,animation" lines, the format the editor and upload accept
+void handleExportCards(AsyncWebServerRequest *request){
+  request->send(beginStream(request, "text/plain", newCardListStream("", 0, 0, UINT32_MAX, false, false)));
+}
 
-  String uid = server.arg("uid");
-  uid.toUpperCase();
+// List cards as JSON for UI, streamed in chunks straight from the card store:
+// ?prefix=<uid prefix>&limit=<n> and either offset=<n> (rescans from the start)
+// or next=<token from the previous page> (resumes where it stopped; start at 0)
+void handleListCards(AsyncWebServerRequest *request){
+  String prefix = request->hasArg("prefix") ? request->arg("prefix") : "";
+  uint32_t offset = request->hasArg("offset") ? request->arg("offset").toInt() : 0;
+  uint32_t limit = request->hasArg("limit") ? request->arg("limit").toInt() : UINT32_MAX;
+  bool paged = request->hasArg("next");
+  uint32_t slot = paged ? request->arg("next").toInt() : 0;
+  if (paged)
+    offset = 0;
+
+  request->send(beginStream(request, "application/json", newCardListStream(prefix, slot, offset, limit, true, paged)));
+}
 
-  // Open in append mode
-  File file = LittleFS.open("/cards.txt", "a");
-  if (!file)
+// Add or update a card in the store
+void handleAddCard(AsyncWebServerRequest *request){
+  if (!request->hasArg("uid") || !request->hasArg("color") || !request->hasArg("animation"))
   {
-    server.send(500, "text/plain", "Failed to open file for writing");
+    request->send(400, "text/plain", "Missing uid/color/animation");
     return;
   }
 
-  // ✅ Ensure file ends with a newline before appending
-  if (file.size() > 0)
+  String uid = request->arg("uid");
+  uid.trim();
+  CardUid cardUid;
+  if (!cardUidFromHex(uid.c_str(), uid.length(), cardUid))
   {
-    file.seek(file.size() - 1, SeekSet);
-    if (file.read() != '\n')
-    {
-      file.println(); // Add newline if missing
-    }
+    request->send(400, "text/plain", "Invalid uid");
+    return;
   }
 
-  file.println(uid + "," + server.arg("color") + "," + server.arg("animation"));
-  file.close();
-
-  server.send(200, "text/plain", "Card saved.");
-}
+  String color = request->arg("color");
+  String animation = request->arg("animation");
+  CardInfo card;
+  card.color = parseColor(color.c_str(), color.length());
+  card.animation = parseAnimation(animation.c_str(), animation.length());
 
-// Delete a card from CSV
-void handleDeleteCard(){
-  if (!server.hasArg("uid"))
+  if (!cardStorePut(cardUid, card))
   {
-    server.send(400, "text/plain", "Missing uid");
+    // A full table is grown by the web task, never here on async_tcp
+    if (cardStoreStats().rebuildDue)
+      request->send(503, "text/plain", "Card store is growing, try again");
+    else
+      request->send(500, "text/plain", "Failed to save card");
     return;
   }
 
-  String uid = server.arg("uid");
-  uid.toUpperCase();
+  request->send(200, "text/plain", "Card saved.");
+}
 
-  File file = LittleFS.open("/cards.txt", "r");
-  if (!file)
+// Delete a card from the store
+void handleDeleteCard(AsyncWebServerRequest *request){
+  if (!request->hasArg("uid"))
   {
-    server.send(404, "text/plain", "No cards found");
+    request->send(400, "text/plain", "Missing uid");
     return;
   }
 
-  String newData = "";
-  while (file.available())
+  String uid = request->arg("uid");
+  uid.trim();
+  CardUid cardUid;
+  if (!cardUidFromHex(uid.c_str(), uid.length(), cardUid) || !cardStoreRemove(cardUid))
   {
-    String line = file.readStringUntil('\n');
-    line.trim();
-    if (line.length() == 0)
-      continue;
-
-    String fileUID = line.substring(0, line.indexOf(','));
-    if (!fileUID.equalsIgnoreCase(uid))
-    {
-      newData += line + "\n";
-    }
+    request->send(404, "text/plain", "Card not found");
+    return;
   }
-  file.close();
 
-  file = LittleFS.open("/cards.txt", "w");
-  file.print(newData);
-  file.close();
+  request->send(200, "text/plain", "Card deleted.");
+}
 
-  server.send(200, "text/plain", "Card deleted.");
+// Bulk CSV editor; the text is fetched from /cards.txt
+void handleCardsPage(AsyncWebServerRequest *request){
+  serveWebAsset(request, "cards.html");
 }
 
-// Show bulk CSV editor (stream large file safely)
-void handleCardsPage(){
-  String html = R"rawliteral(
-    <html>
-    <body>
-    <h2>Edit Cards CSV</h2>
-    <textarea id="cards" rows="30" cols="80"></textarea><br>
-    <button onclick="saveFile()">Save</button>
+// Import result as JSON: rows, accepted, rejected, duplicates, timings
+size_t importResultJson(char *out, size_t cap){
+  const CardImportStats &result = cardImportStats();
+  int len = snprintf(out, cap,
+                     "{\"ok\":%s,\"rows\":%u,\"accepted\":%u,\"rejected\":%u,\"duplicates\":%u,"
+                     "\"first_rejected_line\":%u,\"elapsed_ms\":%u,\"build_ms\":%u,\"rows_per_sec\":%u}",
+                     result.ok ? "true" : "false", result.rows, result.accepted, result.rejected, result.duplicates,
+                     result.firstRejectedLine, result.elapsedMs, result.buildMs, result.rowsPerSec);
+  return len < 0 ? 0 : min((size_t)len, cap - 1);
+}
 
-    <script>
-    async function loadCards() {
-        const res = await fetch('/cards.txt');
-        const text = await res.text();
-        document.getElementById('cards').value = text;
-    }
+// Start a card import for request; 0, or the status to refuse it with:
+// 409 while another import runs, 500 when staging could not be set up
+int startCardImport(AsyncWebServerRequest *request){
+  if (importOwner || importBuildPending)
+    return 409;
+  if (!cardImportBegin())
+    return 500;
+  importOwner = request;
+  request->onDisconnect([request]()
+                        {
+    if (importOwner != request)
+      return;
+    importOwner = nullptr;
+    // Once handed to the web task, the build runs to the end
+    if (!importBuildPending && cardImportStats().active)
+    {
+      Serial.println("Upload aborted, keeping current cards");
+      cardImportAbort();
+    } });
+  return 0;
+}
 
-    async function saveFile() {
-        const text = document.getElementById('cards').value;
-        const formData = new URLSearchParams();
-        formData.append('cards', text);
+const char *importRefusalText(int status){
+  return status == 409 ? "Another card import is running" : "Could not start the card import";
+}
 
-        await fetch('/card', {
-            method: 'POST',
-            headers: { 'Content-Type': 'application/x-www-form-urlencoded' },
-            body: formData
-        });
+// Reply to an import once the web task has built and swapped it in. The status
+// line goes out first, so the outcome is in the body (and in /status).
+struct ImportReplyStream {
+  ChunkStream stream;
+  AsyncWebServerRequest *request;
+  bool html;
 
-        alert('Saved!');
-        loadCards(); // ✅ Refresh textarea after saving
+  void fill(){
+    if (importBuildPending)
+    {
+      stream.waiting = true;
+      return;
     }
-
-    loadCards();
-    </script>
-    </body>
-    </html>
-    )rawliteral";
-
-  server.send(200, "text/html", html);
+    const CardImportStats &result = cardImportStats();
+    if (html && result.ok)
+      stream.used = snprintf(stream.buf, sizeof(stream.buf),
+                             "<html><body><h2>Saved!</h2><p>%u cards, %u rejected rows</p><a href='/card'>Back</a></body></html>",
+                             result.accepted - result.duplicates, result.rejected);
+    else
+      stream.used = importResultJson(stream.buf, sizeof(stream.buf));
+    if (importOwner == request)
+      importOwner = nullptr;
+    stream.done = true;
+  }
+};
+
+AsyncWebServerResponse *beginImportReply(AsyncWebServerRequest *request, bool html){
+  std::shared_ptr<ImportReplyStream> state = std::make_shared<ImportReplyStream>();
+  memset(&state->stream, 0, sizeof(state->stream));
+  state->request = request;
+  state->html = html;
+  return beginStream(request, html ? "text/html" : "application/json", state);
 }
 
-// Save bulk CSV edits without huge RAM usage
-void handleCardsSave(){
-  if (!server.hasArg("cards"))
+// Save bulk CSV edits through the streaming importer
+void handleCardsSave(AsyncWebServerRequest *request){
+  if (!request->hasArg("cards"))
   {
-    server.send(400, "text/plain", "Missing cards content");
+    request->send(400, "text/plain", "Missing cards content");
     return;
   }
 
-  // Open file for writing (will overwrite old file)
-  File file = LittleFS.open("/cards.txt", "w");
-  if (!file)
+  int refused = startCardImport(request);
+  if (refused)
   {
-    server.send(500, "text/plain", "Failed to open cards.txt for writing");
+    request->send(refused, "text/plain", importRefusalText(refused));
     return;
   }
 
-  // Stream-write in chunks to save RAM
-  const String &cardsData = server.arg("cards");
-  const size_t chunkSize = 512; // bytes per write
+  const String &cardsData = request->arg("cards");
+  const size_t chunkSize = 512;
   for (size_t i = 0; i < cardsData.length(); i += chunkSize)
   {
     size_t len = min(chunkSize, cardsData.length() - i);
-    file.write((const uint8_t *)cardsData.c_str() + i, len);
+    cardImportWrite((const uint8_t *)cardsData.c_str() + i, len);
   }
-  file.close();
 
-  server.send(200, "text/html",
-              "<html><body><h2>Saved!</h2><a href='/card'>Back</a></body></html>");
+  importBuildPending = true;
+  request->send(beginImportReply(request, true));
+}
+
+// Status digest for the live feed: only fields whose change is worth a push
+size_t liveStatusJson(char *out, size_t cap){
+  MqttStats mqtt = mqttPublisherStats();
+  UploadStats upload = eventUploaderStats();
+  int len = snprintf(out, cap,
+                     "{\"wifi\":%s,\"time_ready\":%s,\"mqtt_connected\":%s,\"mqtt_backlog\":%u,"
+                     "\"upload_backlog\":%u,\"upload_status\":%d,\"cards\":%u}",
+                     WiFi.isConnected() ? "true" : "false", timeReady ? "true" : "false",
+                     mqtt.connected ? "true" : "false", (unsigned)mqtt.backlog, (unsigned)upload.backlog,
+                     upload.lastStatus, (unsigned)cardStoreStats().cardCount);
+  return len < 0 ? 0 : (size_t)len;
 }
 
-void handleStatus(){
-  DynamicJsonDocument doc(512);
+void handleStatus(AsyncWebServerRequest *request){
+  DynamicJsonDocument doc(8192);
+  char deviceName[sizeof(deviceConfig.deviceName)];
+  char serverAddress[sizeof(deviceConfig.server.address)];
+  int lightDuration;
+  bool cellularEnabled;
+  {
+    ConfigLock lock;
+    strlcpy(deviceName, deviceConfig.deviceName, sizeof(deviceName));
+    strlcpy(serverAddress, deviceConfig.server.address, sizeof(serverAddress));
+    lightDuration = deviceConfig.light.lightDuration;
+    cellularEnabled = deviceConfig.cellular.enable;
+  }
 
-  doc["device_name"] = deviceConfig.deviceName;
+  doc["device_name"] = deviceName;
   doc["ip_address"] = WiFi.localIP().toString();
   doc["mac_address"] = WiFi.macAddress();
   doc["wifi"] = WiFi.SSID();
@@ -598,76 +773,432 @@ void handleStatus(){
   doc["uptime_seconds"] = uptime;
   doc["uptime_hms"] = String(uptime / 3600) + "h " + String((uptime % 3600) / 60) + "m " + String(uptime % 60) + "s";
 
-  doc["light_duration"] = deviceConfig.light.lightDuration;
+  doc["light_duration"] = lightDuration;
   float vbat = readBatteryVoltage();
   int percent = batteryPercentage(vbat);
   doc["battery_level"] = percent; // Placeholder for now
 
-  doc["server_address"] = deviceConfig.server.address;
+  doc["server_address"] = serverAddress;
+
+  const CardStoreStats &cards = cardStoreStats();
+  doc["card_count"] = cards.cardCount;
+  doc["card_store_ready"] = cards.storeReady;
+  doc["card_slots"] = cards.slotCount;
+  doc["card_tombstones"] = cards.tombstones;
+  doc["card_rebuild_due"] = cards.rebuildDue;
+  doc["card_rebuild_ms"] = cards.lastRebuildMs;
+  doc["card_swap_us"] = cards.lastSwapUs;
+  doc["card_lookup_us"] = cards.lastLookupUs;
+  doc["card_cache_active"] = cards.cacheReady;
+  doc["card_cache_bytes"] = cards.cacheBytes;
+  doc["card_cache_budget"] = cards.cacheBudget;
+
+  const CardImportStats &importResult = cardImportStats();
+  doc["card_import_pending"] = importBuildPending.load();
+  doc["card_import_ok"] = importResult.ok;
+  doc["card_import_rows"] = importResult.rows;
+  doc["card_import_rejected"] = importResult.rejected;
+  doc["card_import_ms"] = importResult.elapsedMs;
+  doc["card_import_rows_per_sec"] = importResult.rowsPerSec;
+
+  doc["tap_count"] = tapStats.taps;
+  doc["tap_heap_delta"] = tapStats.lastHeapDelta;
+  doc["tap_heap_delta_max"] = tapStats.worstHeapDelta;
+  const TapDebounceStats &debounce = tapDebounceStats();
+  doc["tap_accepted"] = debounce.accepted;
+  doc["tap_suppressed"] = debounce.suppressed;
+  doc["tap_repeat_feedbacks"] = debounce.feedbacks;
+  doc["tap_debounce_evictions"] = debounce.evictions;
+  doc["tap_debounce_entries"] = debounce.entries;
+  BuzzerStats buzzer = buzzerStats();
+  doc["sound_played"] = buzzer.played;
+  doc["sound_dropped"] = buzzer.dropped;
+  doc["sound_queue_us"] = buzzer.lastQueueUs;
+  doc["output_queue_dropped"] = outputQueue.dropped();
+
+  // Per mode handler: card read to decision, as log2 buckets from LATENCY_BUCKET0_US
+  doc["tap_mode"] = tapPipelineMode();
+  JsonArray handlers = doc.createNestedArray("tap_handlers");
+  for (uint8_t mode = 0; mode < TAP_MODE_COUNT; mode++)
+  {
+    TapHandlerStats h;
+    if (!tapPipelineStats(mode, h))
+      continue;
+    JsonObject entry = handlers.createNestedObject();
+    entry["mode"] = mode;
+    entry["name"] = h.name;
+    entry["taps"] = h.taps;
+    entry["pending"] = h.pending;
+    entry["p50_us"] = latencyPercentile(h.latency, 50);
+    entry["p99_us"] = latencyPercentile(h.latency, 99);
+    entry["max_us"] = h.latency.maxUs;
+    if (h.latency.total == 0)
+      continue;
+    JsonArray buckets = entry.createNestedArray("histogram");
+    for (uint8_t i = 0; i < LATENCY_BUCKETS; i++)
+      buckets.add(h.latency.counts[i]);
+  }
+
+  OnlineVerifyStats verify = onlineVerifyStats();
+  doc["verify_enabled"] = verify.enabled;
+  doc["verify_requests"] = verify.requests;
+  doc["verify_allowed"] = verify.allowed;
+  doc["verify_denied"] = verify.denied;
+  doc["verify_errors"] = verify.errors;
+  doc["verify_dropped"] = verify.dropped;
+  doc["verify_last_status"] = verify.lastStatus;
+  doc["verify_request_ms"] = verify.lastRequestMs;
+  doc["verify_round_trip_p50_us"] = latencyPercentile(verify.roundTrip, 50);
+  doc["verify_round_trip_p99_us"] = latencyPercentile(verify.roundTrip, 99);
+  const VerifyCacheStats &verifyCache = verifyCacheStats();
+  uint32_t lookups = verifyCache.hits + verifyCache.staleHits + verifyCache.misses;
+  doc["verify_cache_hits"] = verifyCache.hits;
+  doc["verify_cache_stale_hits"] = verifyCache.staleHits;
+  doc["verify_cache_misses"] = verifyCache.misses;
+  doc["verify_cache_hit_permille"] = lookups ? (uint64_t)(verifyCache.hits + verifyCache.staleHits) * 1000 / lookups : 0;
+  doc["verify_cache_refreshes"] = verifyCache.refreshes;
+  doc["verify_cache_evictions"] = verifyCache.evictions;
+  doc["verify_cache_entries"] = verifyCache.entries;
+
+  AttendanceStats attendance = attendanceStats();
+  doc["attendance_day"] = attendance.day;
+  doc["attendance_cards"] = attendance.cards;
+  doc["attendance_taps"] = attendance.taps;
+  doc["attendance_overflow"] = attendance.overflow;
+
+  ActivityLogStats log = activityLogStats();
+  doc["log_records"] = log.nextSeq - log.firstSeq;
+  doc["log_pending"] = log.pending;
+  doc["log_dropped"] = log.dropped;
+  doc["log_batches"] = log.batches;
+  doc["log_commit_us"] = log.lastCommitUs;
+
+  MqttStats mqtt = mqttPublisherStats();
+  doc["mqtt_enabled"] = mqtt.enabled;
+  doc["mqtt_connected"] = mqtt.connected;
+  doc["mqtt_connects"] = mqtt.connects;
+  doc["mqtt_published"] = mqtt.published;
+  doc["mqtt_acked"] = mqtt.acked;
+  doc["mqtt_backlog"] = mqtt.backlog;
+  doc["mqtt_inflight"] = mqtt.inflight;
+  doc["mqtt_lost"] = mqtt.lost;
+  doc["mqtt_latency_ms"] = mqtt.lastLatencyMs;
+  doc["mqtt_latency_max_ms"] = mqtt.maxLatencyMs;
+
+  UploadStats upload = eventUploaderStats();
+  doc["upload_enabled"] = upload.enabled;
+  doc["upload_events"] = upload.events;
+  doc["upload_batches"] = upload.batches;
+  doc["upload_failures"] = upload.failures;
+  doc["upload_last_status"] = upload.lastStatus;
+  doc["upload_backlog"] = upload.backlog;
+  doc["upload_lost"] = upload.lost;
+  doc["upload_events_per_sec"] = upload.eventsPerSec;
+  doc["upload_batch_bytes"] = upload.lastBatchBytes;
+  doc["upload_batch_ms"] = upload.lastBatchMs;
+  doc["upload_backoff_ms"] = upload.backoffMs;
+  doc["upload_transport"] = upload.transport;
+
+  if (cellularEnabled)
+  {
+    ModemStats modem = modemStats();
+    doc["modem_state"] = modemStateName(modem.state);
+    doc["modem_rssi"] = modem.rssi;
+    doc["modem_registered"] = modem.registered;
+    doc["modem_bearer"] = modem.bearerUp;
+    doc["modem_resets"] = modem.resets;
+    doc["modem_requests"] = modem.requests;
+    doc["modem_failures"] = modem.failures;
+    doc["modem_last_status"] = modem.lastStatus;
+    doc["modem_request_ms"] = modem.lastRequestMs;
+    doc["modem_bring_up_ms"] = modem.bringUpMs;
+  }
+
+  JsonArray tasks = doc.createNestedArray("tasks");
+  for (const AppTask *task : {&nfcTask, &outputTask, &webTask, &logTask, &mqttTask, &uploadTask, &verifyTask})
+  {
+    JsonObject t = tasks.createNestedObject();
+    t["name"] = task->name;
+    t["core"] = task->core;
+    t["stack_free"] = appTaskStackFree(*task);
+    t["loops"] = task->loops;
+    t["period_us"] = task->lastPeriodUs;
+    t["max_period_us"] = task->maxPeriodUs;
+    t["max_busy_us"] = task->maxBusyUs;
+  }
+
+  const WebUiStats &web = webUiStats();
+  doc["web_pages_served"] = web.served;
+  doc["web_pages_not_modified"] = web.notModified;
+  doc["web_page_serve_us"] = web.lastServeUs;
+  doc["web_page_heap_delta"] = web.lastHeapDelta;
+
+  doc["nfc_ready"] = nfcReady;
+  NfcReaderStats reader = nfcReaderStats();
+  doc["nfc_mode"] = nfcDetectModeName(reader.mode);
+  doc["nfc_arms"] = reader.arms;
+  doc["nfc_rearms"] = reader.rearms;
+  doc["nfc_detections"] = reader.detections;
+  doc["nfc_latency_us"] = reader.lastLatencyUs;
+  doc["nfc_max_latency_us"] = reader.maxLatencyUs;
+  doc["nfc_calls_per_sec"] = reader.callsPerSec;
+  doc["nfc_busy_permille"] = reader.busyPermille;
+  JsonObject nfcTypes = doc.createNestedObject("nfc_types");
+  for (uint8_t type = 0; type < NFC_CARD_TYPE_COUNT; type++)
+  {
+    NfcTypeStats t = nfcTypeStats(type);
+    if (t.reads == 0)
+      continue;
+    JsonObject entry = nfcTypes.createNestedObject(nfcCardTypeName(type));
+    entry["reads"] = t.reads;
+    entry["fallbacks"] = t.fallbacks;
+    entry["latency_us"] = t.lastUs;
+    entry["max_latency_us"] = t.maxUs;
+  }
+  BootPhase phases[BOOT_MAX_PHASES];
+  size_t phaseCount = bootPhases(phases, BOOT_MAX_PHASES);
+  JsonArray boot = doc.createNestedArray("boot_phases");
+  for (size_t i = 0; i < phaseCount; i++)
+  {
+    JsonObject phase = boot.createNestedObject();
+    phase["name"] = phases[i].name;
+    phase["start_ms"] = phases[i].startMs;
+    phase["ms"] = phases[i].durationMs;
+  }
+
+  LiveFeedStats live = liveFeedStats();
+  doc["live_clients"] = live.clients;
+  doc["live_connects"] = live.connects;
+  doc["live_rejected"] = live.rejected;
+  doc["live_events"] = live.events;
+  doc["live_dropped"] = live.dropped;
+  doc["live_deferred"] = live.deferred;
+  doc["live_replayed"] = live.replayed;
+
+  const ConfigLoadStats &configLoad = configLoadStats();
+  doc["config_source"] = configLoad.source;
+  doc["config_load_us"] = configLoad.loadUs;
+  doc["config_load_heap_delta"] = configLoad.heapDelta;
+  doc["config_invalid_fields"] = configLoad.invalidFields;
+  doc["config_applies"] = configApplyStats.applies;
+  doc["config_apply_us"] = configApplyStats.lastApplyUs;
+  doc["config_changed"] = configSectionList(configApplyStats.lastChanged);
 
   doc["free_heap"] = ESP.getFreeHeap();
   doc["flash_size"] = ESP.getFlashChipSize();
 
   String json;
   serializeJson(doc, json);
-  server.send(200, "application/json", json);
+  request->send(200, "application/json", json);
 }
 
-void showReadyAnimation(){
-  uint8_t brightness = constrain(deviceConfig.ledBrightness, 5, 255);
-  pixels.setBrightness(brightness);
+// Activity log as a JSON array, a few records per chunk
+const uint32_t ACTIVITY_SCAN_PER_FILL = 256; // records read per fill(): ~6 KB of flash
+
+struct ActivityStream {
+  ChunkStream stream;
+  uint32_t seq;
+  uint32_t end;
+  uint32_t since;
+  uint32_t offset;
+  uint32_t limit;
+  uint32_t sent;
+  CardUid uidFilter;
+  bool filterUid;
+  bool started;
+
+  void fill(){
+    if (!started)
+      stream.buf[stream.used++] = '[';
+    started = true;
+
+    // Each record is well under 128 bytes of JSON. A filter that matches little
+    // would otherwise read the whole log in one async_tcp callback, so at most
+    // ACTIVITY_SCAN_PER_FILL records are read before yielding.
+    ActivityRecord records[7];
+    uint32_t scanned = 0;
+    bool overwritten = false;
+    while (seq < end && sent < limit && scanned < ACTIVITY_SCAN_PER_FILL &&
+           sizeof(stream.buf) - stream.used > sizeof(records) / sizeof(records[0]) * 128 + 1)
+    {
+      size_t n = activityLogReadRange(seq, records, min((uint32_t)7, end - seq));
+      if (n == 0)
+      {
+        overwritten = true; // by newer records while streaming
+        break;
+      }
+
+      for (size_t i = 0; i < n && sent < limit; i++)
+      {
+        const ActivityRecord &r = records[i];
+        if (r.seq == 0xFFFFFFFF)
+          continue;
+        if (since && r.time < since)
+          continue;
+        if (filterUid && (r.uidLength != uidFilter.length || memcmp(r.uid, uidFilter.bytes, r.uidLength) != 0))
+          continue;
+        if (offset)
+        {
+          offset--;
+          continue;
+        }
 
-  // Spinning LED
-  for (int i = 0; i < NUM_PIXELS * 2; i++)
+        if (!stream.first)
+          stream.buf[stream.used++] = ',';
+        stream.used += activityRecordToJson(r, stream.buf + stream.used, sizeof(stream.buf) - stream.used);
+        stream.first = false;
+        sent++;
+      }
+      seq += n;
+      scanned += n;
+    }
+
+    if (overwritten || seq >= end || sent >= limit)
+    {
+      stream.buf[stream.used++] = ']';
+      stream.done = true;
+    }
+    else if (stream.used == 0)
+    {
+      stream.waiting = true; // scan budget spent without a match; go on at the next poll
+    }
+  }
+};
+
+// Stream the activity log as a JSON array in chunks, optionally filtered and paged:
+// ?since=<epoch seconds>&uid=<hex>&offset=<n>&limit=<n>
+void handleActivities(AsyncWebServerRequest *request){
+  ActivityLogStats log = activityLogStats();
+  std::shared_ptr<ActivityStream> state = std::make_shared<ActivityStream>();
+  memset(&state->stream, 0, sizeof(state->stream));
+  state->stream.first = true;
+  state->offset = request->hasArg("offset") ? request->arg("offset").toInt() : 0;
+  state->limit = request->hasArg("limit") ? request->arg("limit").toInt() : UINT32_MAX;
+  state->since = request->hasArg("since") ? request->arg("since").toInt() : 0;
+  state->sent = 0;
+  state->started = false;
+  state->end = log.nextSeq;
+
+  state->filterUid = request->hasArg("uid");
+  if (state->filterUid)
   {
-    pixels.clear();
-    pixels.setPixelColor(i % NUM_PIXELS, pixels.Color(0, 150, 0)); // green spin
-    pixels.show();
-    delay(20);
+    String uidArg = request->arg("uid");
+    if (!cardUidFromHex(uidArg.c_str(), uidArg.length(), state->uidFilter))
+    {
+      request->send(400, "application/json", "{\"error\":\"Invalid uid\"}");
+      return;
+    }
   }
 
-  // Solid glow at the end (optional)
-  uint32_t color = parseHexColor(deviceConfig.light.knownDefaultColor);
-  for (int i = 0; i < NUM_PIXELS; i++)
+  // Records are fixed-size and sequence-numbered, so both seeks avoid a rescan:
+  // since= by binary search on time, offset= (without a uid filter) by arithmetic
+  state->seq = state->since ? activityLogSeekTime(state->since) : log.firstSeq;
+  if (!state->filterUid)
   {
-    pixels.setPixelColor(i, color);
+    state->seq = (log.nextSeq - state->seq > state->offset) ? state->seq + state->offset : log.nextSeq;
+    state->offset = 0;
   }
-  pixels.show();
-  delay(100); // Keep it lit for a moment
-  clearLEDs();
+
+  AsyncWebServerResponse *response = beginStream(request, "application/json", state);
+  response->addHeader("X-Log-First-Seq", String(log.firstSeq));
+  response->addHeader("X-Log-Next-Seq", String(log.nextSeq));
+  request->send(response);
 }
 
-void handleCardFileUpload(){
-  HTTPUpload &upload = server.upload();
-  static File uploadFile;
+// Mode 3 counts for the current day
+struct AttendanceStream {
+  ChunkStream stream;
+  size_t next;
+  bool started;
+
+  void fill(){
+    if (!started)
+      stream.buf[stream.used++] = '[';
+    started = true;
+
+    // Each entry is under 100 bytes of JSON
+    AttendanceEntry entries[8];
+    size_t n = attendanceRead(next, entries, 8);
+    for (size_t i = 0; i < n; i++)
+    {
+      char uidHex[CARD_UID_HEX_SIZE];
+      cardUidToHex(entries[i].uid, uidHex);
+      stream.used += snprintf(stream.buf + stream.used, sizeof(stream.buf) - stream.used,
+                              "%s{\"uid\":\"%s\",\"count\":%u,\"first\":%u,\"last\":%u}",
+                              stream.first ? "" : ",", uidHex, (unsigned)entries[i].count,
+                              (unsigned)entries[i].firstTime, (unsigned)entries[i].lastTime);
+      stream.first = false;
+    }
+    next += n;
 
-  if (upload.status == UPLOAD_FILE_START)
-  {
-    Serial.printf("Upload Start: %s\n", upload.filename.c_str());
-    uploadFile = LittleFS.open("/cards.txt", "w");
-    if (!uploadFile)
+    if (n == 0)
     {
-      Serial.println("Failed to open /cards.txt for writing");
+      stream.buf[stream.used++] = ']';
+      stream.done = true;
     }
   }
-  else if (upload.status == UPLOAD_FILE_WRITE)
+};
+
+void handleAttendance(AsyncWebServerRequest *request){
+  std::shared_ptr<AttendanceStream> state = std::make_shared<AttendanceStream>();
+  memset(&state->stream, 0, sizeof(state->stream));
+  state->stream.first = true;
+  state->next = 0;
+  state->started = false;
+
+  AttendanceStats stats = attendanceStats();
+  AsyncWebServerResponse *response = beginStream(request, "application/json", state);
+  response->addHeader("X-Attendance-Day", String(stats.day));
+  response->addHeader("X-Attendance-Taps", String(stats.taps));
+  request->send(response);
+}
+
+void showReadyAnimation(){
+  ledEffectStart(LED_ANIM_SPIN, pixels.Color(0, 150, 0), NUM_PIXELS * 2 * LED_FRAME_MS, 1, millis());
+}
+
+// Parse the upload as it arrives; the current cards stay live until the swap
+void handleCardFileUpload(AsyncWebServerRequest *request, const String &filename, size_t index,
+                          uint8_t *data, size_t len, bool final){
+  if (index == 0)
   {
-    // Write incoming chunk directly to file
-    if (uploadFile)
+    Serial.printf("Upload Start: %s\n", filename.c_str());
+    int refused = startCardImport(request);
+    if (refused)
     {
-      uploadFile.write(upload.buf, upload.currentSize);
+      Serial.printf("Card import refused: %s\n", importRefusalText(refused));
+      importRefused = request;
+      importRefusedStatus = refused;
+      return;
     }
   }
-  else if (upload.status == UPLOAD_FILE_END)
+  if (importOwner != request)
+    return;
+
+  cardImportWrite(data, len);
+  if (final)
   {
-    if (uploadFile)
-    {
-      uploadFile.close();
-      Serial.printf("Upload Complete: %s, %u bytes\n", upload.filename.c_str(), upload.totalSize);
-    }
+    Serial.printf("Upload Complete: %s, %u bytes\n", filename.c_str(), (unsigned)(index + len));
+    importBuildPending = true;
   }
 }
 
+void handleCardUploadDone(AsyncWebServerRequest *request){
+  if (importOwner == request && importBuildPending)
+  {
+    request->send(beginImportReply(request, false));
+    return;
+  }
+
+  if (importRefused == request)
+  {
+    importRefused = nullptr;
+    request->send(importRefusedStatus, "text/plain", importRefusalText(importRefusedStatus));
+    return;
+  }
+  request->send(400, "text/plain", "No card file in the upload");
+}
+
 void WiFiEvent(WiFiEvent_t event) {
   switch (event) {
     case ARDUINO_EVENT_WIFI_STA_CONNECTED:
@@ -691,239 +1222,524 @@ void WiFiEvent(WiFiEvent_t event) {
   }
 }
 
-void modeTwo(const String &uid){
-  Serial.println(uid);
-  delay(200);
-  Serial.println("##########");
-}
-void modeThree(const String &uid){
-  Serial.println(uid);
-  delay(200);
-  Serial.println("##########");
+// PN532 bring-up; the NFC task retries it until the reader answers
+bool nfcInit(){
+  NfcConfig config;
+  {
+    ConfigLock lock;
+    config = deviceConfig.nfc;
+  }
+  return nfcReaderBegin(*nfc, config);
 }
 
-void setup(){
-  Serial.begin(115200);
-  Serial.println("Starting NFC + LED Ring...");
+// Buzzer sound for a decided tap, per the sound config
+BuzzerSound tapSound(ActivityStatus status, bool logged){
+  if (tapConfig.sound.onStatus)
+  {
+    if (!logged)
+      return SOUND_ERROR;
+    return status == ACTIVITY_ALLOWED ? SOUND_ALLOWED : SOUND_UNKNOWN;
+  }
+  return tapConfig.sound.tapDetection ? SOUND_TAP : SOUND_NONE;
+}
 
-  pinMode(BUZZER_PIN, OUTPUT);
-  digitalWrite(BUZZER_PIN, LOW); // Ensure it's off
+// Feedback, logging and publishing for a decided tap; shared by the deciding modes
+void finishTap(const CardUid &uid, uint32_t tapTime, ActivityStatus status, const CardInfo &card){
+  if (card.animation != LED_ANIM_NONE)
+    effectActive = true;
+  tapDebounceAccept(uid, status, millis());
+  uint32_t seq = 0;
+  bool logged = activityLogAppend(uid, tapTime, status, &seq);
+  outputQueue.push({OUTPUT_TAP, card, tapSound(status, logged)});
+  if (logged)
+    mqttPublishTap(seq, uid, tapTime, status);
+  liveFeedTap(uid, tapTime, status, logged, seq);
+}
 
-  analogReadResolution(12);                       // 0..4095
-  analogSetPinAttenuation(BATTERY_PIN, ADC_11db); // extend range; calibrate later
+// Local decision from the card store; unknown cards get the unknown-card effect
+ActivityStatus decideLocally(const CardUid &uid, CardInfo &card){
+  if (cardStoreFind(uid, card))
+    return ACTIVITY_ALLOWED;
+  card = unknownCard;
+  return ACTIVITY_UNKNOWN;
+}
 
-  pixels.begin();
-  pixels.clear();
-  pixels.setBrightness(128);
-  pixels.show();
+// Mode 0: feedback and the live feed only
+TapOutcome readOnlyTap(const TapEvent &tap){
+  tapDebounceAccept(tap.uid, ACTIVITY_UNKNOWN, tap.nowMs);
+  outputQueue.push({OUTPUT_TAP, {0, LED_ANIM_NONE}, tapConfig.sound.tapDetection ? SOUND_TAP : SOUND_NONE});
+  liveFeedTap(tap.uid, tap.time, ACTIVITY_UNKNOWN, false, 0);
+  return TAP_DONE;
+}
+const TapHandler readOnlyHandler = {"read_only", readOnlyTap, nullptr};
+
+// Mode 1: the local card store decides
+TapOutcome localTap(const TapEvent &tap){
+  CardInfo card;
+  ActivityStatus status = decideLocally(tap.uid, card);
+  finishTap(tap.uid, tap.time, status, card);
+  return TAP_DONE;
+}
+const TapHandler localHandler = {"local", localTap, nullptr};
 
-  if (!LittleFS.begin())
+// Feedback for a server decision, fresh or cached; errors are decided locally
+void finishOnlineTap(const CardUid &uid, uint32_t tapTime, uint8_t decision){
+  CardInfo card;
+  ActivityStatus status;
+  if (decision == VERIFY_ALLOW)
   {
-    Serial.println("LittleFS mount failed!");
-    return;
+    status = ACTIVITY_ALLOWED;
+    if (!cardStoreFind(uid, card))
+      card = {tapConfig.light.knownDefaultColor, tapConfig.light.knownCardAnimation};
   }
-
-  if (!LittleFS.exists("/cards.txt"))
+  else if (decision == VERIFY_DENY)
   {
-    File f = LittleFS.open("/cards.txt", "w");
-    f.close();
+    status = ACTIVITY_UNKNOWN;
+    card = unknownCard;
   }
+  else
+  {
+    status = decideLocally(uid, card);
+  }
+  finishTap(uid, tapTime, status, card);
+}
 
-  // Use config values if loaded, otherwise defaults
-  const char *apSSID = deviceConfig.deviceName.length() > 0 ? deviceConfig.deviceName.c_str() : "JasTapBox 1";
-  const char *apPASS = deviceConfig.hotspotPassword.length() > 0 ? deviceConfig.hotspotPassword.c_str() : "12345678";
-
-  // Start AP before STA connection
-  startAP(apSSID, apPASS);
+// Mode 2: the server decides. Cached decisions answer at once (a due one is
+// refreshed in the background); a miss asks the server through the verify task.
+// The local store decides while the server is unreachable or the queue is full.
+TapOutcome onlineTap(const TapEvent &tap){
+  bool online = onlineVerifyAvailable();
+  bool allow = false;
+  bool refresh = false;
+  if (verifyCacheLookup(tap.uid, tap.nowMs, online, allow, refresh) != VERIFY_CACHE_MISS)
+  {
+    if (refresh && !onlineVerifyRequest(tap.uid, tap.time, tap.startUs, true))
+      verifyCacheRefreshFailed(tap.uid);
+    finishOnlineTap(tap.uid, tap.time, allow ? VERIFY_ALLOW : VERIFY_DENY);
+    return TAP_DONE;
+  }
 
-  if (loadDeviceConfig(deviceConfig))
+  if (online && onlineVerifyRequest(tap.uid, tap.time, tap.startUs, false))
   {
-    printDeviceConfig(deviceConfig);
-    pixels.setBrightness(deviceConfig.ledBrightness);
-    connectToWiFi();
+    // Held off until the answer, which records the real status
+    tapDebounceAccept(tap.uid, ACTIVITY_UNKNOWN, tap.nowMs);
+    return TAP_PENDING;
   }
+  return localTap(tap);
+}
 
-  Wire.begin(SDA_PIN, SCL_PIN);
-  nfc.begin();
-  if (!nfc.getFirmwareVersion())
+void onlineService(unsigned long);
+const TapHandler onlineHandler = {"online", onlineTap, onlineService};
+
+void onlineService(unsigned long now){
+  VerifyResult result;
+  while (onlineVerifyResult(result))
   {
-    Serial.println("PN532 not found.");
-    int retries = 0;
-    while (!nfc.getFirmwareVersion() && retries++ < 5)
+    if (result.decision == VERIFY_ERROR)
     {
-      Serial.println("PN532 not found, retrying...");
-      delay(500);
+      if (result.refresh)
+        verifyCacheRefreshFailed(result.uid);
     }
-    if (!nfc.getFirmwareVersion())
+    else
     {
-      Serial.println("PN532 not found after retries. Continuing without NFC.");
-      // set a flag nfcAvailable = false and skip NFC operations
+      verifyCacheStore(result.uid, result.decision == VERIFY_ALLOW, result.ttlMs, now);
     }
+
+    // A refresh had its tap answered from the cache already
+    if (result.refresh)
+      continue;
+    finishOnlineTap(result.uid, result.time, result.decision);
+    tapPipelineDone(&onlineHandler, result.startUs);
   }
+}
 
-  ElegantOTA.begin(&server, "admin", "admin@123");
-  Serial.println("HTTP server started with ElegantOTA");
+// Mode 3: attendance; every card is counted, and the card store still picks the feedback
+TapOutcome attendanceTap(const TapEvent &tap){
+  CardInfo card;
+  ActivityStatus status = decideLocally(tap.uid, card);
+  attendanceRecord(tap.uid, tap.time);
+  finishTap(tap.uid, tap.time, status, card);
+  return TAP_DONE;
+}
+const TapHandler attendanceHandler = {"attendance", attendanceTap, nullptr};
+
+// One handler per config "mode"
+void registerTapHandlers(){
+  tapPipelineRegister(0, &readOnlyHandler);
+  tapPipelineRegister(1, &localHandler);
+  tapPipelineRegister(2, &onlineHandler);
+  tapPipelineRegister(3, &attendanceHandler);
+}
 
-  // ✅ Replace Async handlers with sync server routes
-  server.on("/", HTTP_GET, handleRoot);
-  server.on("/save", HTTP_POST, handleSave);
-  Serial.println("HTTP server started");
-  server.on("/lastuid", HTTP_GET, handleLastUID);
-  server.on("/cards", HTTP_GET, handleListCards);
-  server.on("/cards/add", HTTP_POST, handleAddCard);
-  server.on("/cards/delete", HTTP_POST, handleDeleteCard);
-  server.on("/cards/manage", HTTP_GET, handleManageUI);
-  server.on("/card", HTTP_GET, handleCardsPage);
-  server.on("/card", HTTP_POST, handleCardsSave);
-  server.on("/card/upload", HTTP_POST, []()
-            { server.send(200, "text/plain", "Upload complete"); }, handleCardFileUpload);
-  server.on("/cards.txt", HTTP_GET, []()
-            {
-        if (!LittleFS.exists("/cards.txt")) {
-            server.send(404, "text/plain", "File not found");
-            return;
-        }
-        File file = LittleFS.open("/cards.txt", "r");
-        server.streamFile(file, "text/plain");
-        file.close(); });
-  server.on("/activities", HTTP_GET, []()
-            {
-    File f = LittleFS.open("/activities.log", "r");
-    if (!f) {
-      server.send(500, "application/json", "{\"error\":\"No log file\"}");
+// NFC task: refresh the config copies after a /save and reconfigure what changed
+void pickUpTapConfig(){
+  uint16_t changed = tapConfigChanged.exchange(0);
+  if (!changed)
+    return;
+  DebounceConfig debounce;
+  VerifyConfig verify;
+  int mode;
+  {
+    ConfigLock lock;
+    tapConfig.light = deviceConfig.light;
+    tapConfig.sound = deviceConfig.sound;
+    debounce = deviceConfig.debounce;
+    verify = deviceConfig.verify;
+    mode = deviceConfig.mode;
+  }
+
+  if (changed & CONFIG_LEDS)
+    unknownCard = {tapConfig.light.unknownDefaultColor, tapConfig.light.unknownCardAnimation};
+  if (changed & CONFIG_MODE)
+    tapPipelineSelect(mode);
+  if (changed & CONFIG_DEBOUNCE)
+    tapDebounceConfigure(debounce);
+  // A different server or TTLs: cached decisions are dropped
+  if (changed & (CONFIG_VERIFY | CONFIG_SERVER))
+    verifyCacheBegin(verify);
+}
+
+// NFC task: detect a card, decide, and hand feedback and logging to the other tasks
+void nfcTaskBody(){
+  pickUpTapConfig();
+
+  if (!nfcReady)
+  {
+    if (millis() - lastNfcProbeMs < NFC_PROBE_INTERVAL_MS)
       return;
+    lastNfcProbeMs = millis();
+    nfcReady = nfcInit();
+    if (nfcReady)
+    {
+      Serial.println("PN532 found");
+      bootPhaseMark("nfc_late", 0);
     }
+    return;
+  }
+
+  tapPipelineService(millis());
+
+  if (effectActive)
+  {
+    nfcReaderIdle();
+    return;
+  }
+
+  NfcCredential credential;
+  unsigned long now = millis();
+  if (!nfcReaderPoll(credential, now))
+    return;
+  uint32_t readUs = micros();
+  // Cards are stored and logged by key: the UID, or an id read from inside the card
+  CardUid tapUid = credential.key;
+
+  uint32_t heapBefore = ESP.getFreeHeap();
 
-    String output = "[";
-    bool first = true;
+  lastCard = tapUid;
 
-    while (f.available()) {
-      String line = f.readStringUntil('\n');
-      line.trim();
-      if (line.length() == 0) continue;
-      if (!first) output += ",";
-      output += line;
-      first = false;
+  // Cards seen again within their cooldown are not processed; the output task plays the repeat beeps
+  TapVerdict verdict = tapDebounceCheck(tapUid, now);
+  if (verdict != TAP_ACCEPT)
+  {
+    bool audible = tapConfig.sound.tapDetection || tapConfig.sound.onStatus;
+    if (verdict == TAP_REPEAT && audible)
+      outputQueue.push({OUTPUT_REPEAT, {0, LED_ANIM_NONE}, SOUND_REPEAT});
+    return;
+  }
+
+  // The selected mode's handler decides; see registerTapHandlers()
+  TapEvent tap = {tapUid, credential.type, timeReady ? (uint32_t)time(nullptr) : 0, now, readUs};
+  tapPipelineHandle(tap);
+
+  int32_t heapDelta = (int32_t)heapBefore - (int32_t)ESP.getFreeHeap();
+  tapStats.taps++;
+  tapStats.lastHeapDelta = heapDelta;
+  if (heapDelta > tapStats.worstHeapDelta)
+    tapStats.worstHeapDelta = heapDelta;
+}
+
+// Output task: LED frames, and sounds handed to the buzzer sequencer
+void outputTaskBody(){
+  if (outputConfigChanged.exchange(false))
+  {
+    int brightness;
+    {
+      ConfigLock lock;
+      effectLight = deviceConfig.light;
+      brightness = deviceConfig.ledBrightness;
     }
+    ledEngineSetBrightness(constrain(brightness, 5, 255));
+  }
 
-    output += "]";
-    f.close();
+  OutputEvent event;
+  while (outputQueue.pop(event))
+  {
+    if (event.sound != SOUND_NONE)
+      buzzerPlay((BuzzerSound)event.sound);
+    if (event.kind == OUTPUT_TAP)
+      startCardEffect(event.card);
+  }
 
-    server.send(200, "application/json", output); });
+  if (ledEffectTick(millis()))
+  {
+    ledEffectShow(pixels);
+  }
 
-  server.on("/activities/delete", HTTP_GET, []()
-            {
-    LittleFS.remove("/activities.json");
-    server.send(200, "text/plain", "Deleted"); });
-  server.on("/status", handleStatus);
-  server.begin();
+  if (effectPlaying && !ledEffectActive())
+  {
+    clearLEDs();
+  }
+}
 
-  nfc.SAMConfig();
+// Log task: batched flash writes stay off the tap path
+void logTaskBody(){
+  activityLogService(millis());
+}
 
-  Serial.println("Ready to read NFC cards...");
+// MQTT task: publishes taps and drains the outbox; connects block only this task
+void mqttTaskBody(){
+  mqttPublisherService(millis());
+}
 
-  WiFi.onEvent([](WiFiEvent_t event, WiFiEventInfo_t info)
-               {
-  if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP) {
-    Serial.println("Got IP - starting NTP");
-    configTime(3 * 3600, 0, "pool.ntp.org", "time.nist.gov");
-    ntpStartTime = millis();
-    } });
+// Upload task: batched POSTs of the activity log to the configured server, and
+// the modem state machine that backs the cellular transport
+void uploadTaskBody(){
+  unsigned long now = millis();
+  modemService(now);
+  eventUploaderService(now);
+}
 
-  showReadyAnimation();
+// Verify task: mode 2 server round trips, off the NFC task
+void verifyTaskBody(){
+  onlineVerifyService(millis());
 }
 
-void loop(){
+// Web task: card import builds, config saves, card store compaction, OTA reboot,
+// deferred restarts and NTP readiness;
+// HTTP clients are served by the async server itself
+void webTaskBody(){
+  if (importBuildPending)
+  {
+    cardImportEnd();
+    importBuildPending = false;
+  }
+  if (configSavePending)
+  {
+    runConfigSave();
+    configSave.json = String();
+    configSavePending = false;
+  }
+  cardStoreService();
+  liveFeedService(millis());
+  ElegantOTA.loop();
+
+  if (restartAtMs && (long)(millis() - restartAtMs) >= 0)
+  {
+    ESP.restart();
+  }
 
-  server.handleClient(); // ✅ Required for WebServer to handle requests
+  // Wi-Fi section changed by a hot reload
+  if (wifiReconnectAtMs && (long)(millis() - wifiReconnectAtMs) >= 0)
+  {
+    wifiReconnectAtMs = 0;
+    WiFi.disconnect();
+    connectToWiFi();
+  }
+
+  // Identity section changed by a hot reload; clients on the AP have to rejoin
+  if (apRestartAtMs && (long)(millis() - apRestartAtMs) >= 0)
+  {
+    apRestartAtMs = 0;
+    startAP(deviceConfig.deviceName[0] ? deviceConfig.deviceName : "JasTapBox 1",
+            deviceConfig.hotspotPassword[0] ? deviceConfig.hotspotPassword : "12345678");
+  }
 
   // Check NTP time availability once
   if (!timeReady && millis() - ntpStartTime < ntpTimeout)
   {
     struct tm timeinfo;
-    if (getLocalTime(&timeinfo))
+    if (getLocalTime(&timeinfo, 0))
     {
       char ts[64];
       strftime(ts, sizeof(ts), "%Y-%m-%d %H:%M:%S", &timeinfo);
       Serial.print("✅ NTP time received: ");
       Serial.println(ts);
       timeReady = true;
+      bootPhaseMark("ntp", ntpStartTime);
     }
   }
+}
 
-    if (!effectActive && nfc.inListPassiveTarget())
-  {
-    uint8_t uid[10];
-    uint8_t uidLength;
+void registerRoutes(){
+  ElegantOTA.begin(&server, "admin", "admin@123");
 
-    if (nfc.readPassiveTargetID(PN532_MIFARE_ISO14443A, uid, &uidLength, 100))
-    {
-      String uidStr = "";
-      char buf[3];
-      for (uint8_t i = 0; i < uidLength; i++)
-      {
-        sprintf(buf, "%02X", uid[i]); // uppercase, 2 digits
-        uidStr += buf;
-      }
-      uidStr.toUpperCase();
-      Serial.println("Card UID: " + uidStr);
-      lastCard = uidStr;
+  // A route also matches its subpaths (/cards catches /cards/manage),
+  // so the longer paths are registered first
+  server.on("/", HTTP_GET, handleRoot);
+  server.on("/config.json", HTTP_GET, handleConfigJson);
+  server.on("/save", HTTP_POST, handleSave);
+  server.on("/lastuid", HTTP_GET, handleLastUID);
+  server.on("/cards/add", HTTP_POST, handleAddCard);
+  server.on("/cards/delete", HTTP_POST, handleDeleteCard);
+  server.on("/cards/manage", HTTP_GET, handleManageUI);
+  server.on("/cards.txt", HTTP_GET, handleExportCards);
+  server.on("/cards", HTTP_GET, handleListCards);
+  server.on("/card/upload", HTTP_POST, handleCardUploadDone, handleCardFileUpload);
+  server.on("/card", HTTP_GET, handleCardsPage);
+  server.on("/card", HTTP_POST, handleCardsSave);
+  server.on("/activities/delete", HTTP_GET, [](AsyncWebServerRequest *request)
+            {
+    activityLogClear();
+    liveFeedLogCleared();
+    request->send(200, "text/plain", "Deleted"); });
+  server.on("/activities", HTTP_GET, handleActivities);
+  server.on("/attendance/clear", HTTP_POST, [](AsyncWebServerRequest *request)
+            {
+    attendanceClear();
+    request->send(200, "text/plain", "Cleared"); });
+  server.on("/attendance", HTTP_GET, handleAttendance);
+  server.on("/status", HTTP_ANY, handleStatus);
+  liveFeedBegin(server, liveStatusJson);
+}
 
-      // Avoid re-processing the same card repeatedly; skip this read but continue loop
-      if (uidStr == lastCardUID)
-      {
-        beep(100);
-        delay(100);
-        beep(100);
-        delay(100);
-        beep(100);
-        return;
-      }
-      lastCardUID = uidStr;
-      beep();
+// Second boot stage, on core 0 while taps are already being served:
+// AP and station, HTTP, uplinks, then the tasks that depend on them
+void netBringUpTask(void *){
+  uint32_t start = millis();
+  WiFi.onEvent([](WiFiEvent_t event, WiFiEventInfo_t info)
+               {
+  if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP) {
+    Serial.println("Got IP - starting NTP");
+    configTime(3 * 3600, 0, "pool.ntp.org", "time.nist.gov");
+    ntpStartTime = millis();
+    if (!wifiIpMarked) {
+      wifiIpMarked = true;
+      bootPhaseMark("wifi_ip", wifiStartMs);
+    }
+    } });
 
-      // Mode-selection
-      if (deviceConfig.mode == 1)
-      {
-        // existing behavior (Mode 1) - check cards.txt, color/animation as before
-         // keep your existing simple beep
-        String colorHex, animation;
-        bool known = loadCardColorAndAnimation(uidStr, colorHex, animation);
+  // Use config values if loaded, otherwise defaults
+  const char *apSSID = configLoaded && deviceConfig.deviceName[0] ? deviceConfig.deviceName : "JasTapBox 1";
+  const char *apPASS = configLoaded && deviceConfig.hotspotPassword[0] ? deviceConfig.hotspotPassword : "12345678";
 
-        if (!known)
-        {
-          colorHex = deviceConfig.light.unknownDefaultColor;
-          animation = deviceConfig.light.unknownCardAnimation;
-        }
+  // Start AP before STA connection
+  startAP(apSSID, apPASS);
+  bootPhaseMark("wifi_ap", start);
 
-        if (animation == "solid")
-        {
-          uint32_t color = parseHexColor(colorHex);
-          startSolidEffect(color);
-        }
+  start = wifiStartMs = millis();
+  if (configLoaded)
+    connectToWiFi();
+  bootPhaseMark("wifi_sta_start", start);
 
-        logActivity(uidStr, known ? "allowed" : "unknown");
-      }
-      else if (deviceConfig.mode == 2)
-      {
-        modeTwo(uidStr);
-      }
-      else if (deviceConfig.mode == 3)
-      {
-        modeThree(uidStr);
-      }
+  start = millis();
+  registerRoutes();
+  server.begin();
+  Serial.println("HTTP server started with ElegantOTA");
+  bootPhaseMark("http", start);
 
-      // other modes can be added here
+  start = millis();
+  {
+    ConfigLock lock; // /save is served from here on
+    mqttPublisherBegin(deviceConfig.mqtt, deviceConfig.deviceName);
+    eventUploaderBegin(deviceConfig.server, deviceConfig.deviceName);
+    onlineVerifyBegin(deviceConfig.server, deviceConfig.deviceName);
+    if (deviceConfig.cellular.enable)
+    {
+      modemSerial.begin(deviceConfig.cellular.baud, SERIAL_8N1, MODEM_RX_PIN, MODEM_TX_PIN);
+      modemBegin(modemSerial, deviceConfig.cellular.apn);
+      eventUploaderAddTransport(&cellularTransport);
     }
-    delay(10);
   }
+  startAppTask(webTask, "web", webTaskBody, 8192, 2, 0, 10);
+  startAppTask(mqttTask, "mqtt", mqttTaskBody, 4096, 1, 0, 20);
+  startAppTask(uploadTask, "upload", uploadTaskBody, 6144, 1, 0, 20);
+  startAppTask(verifyTask, "verify", verifyTaskBody, 6144, 2, 0, 10);
+  bootPhaseMark("uplinks", start);
+  bootPhaseMark("net_ready", 0);
+
+  vTaskDelete(NULL);
+}
 
-  if (effectActive)
+// Staged startup: everything a tap needs first, then networking in the background
+void setup(){
+  uint32_t start = millis();
+  Serial.begin(115200);
+  Serial.println("Starting NFC + LED Ring...");
+
+  pinMode(BUZZER_PIN, OUTPUT);
+  digitalWrite(BUZZER_PIN, LOW); // Ensure it's off
+
+  analogReadResolution(12);                       // 0..4095
+  analogSetPinAttenuation(BATTERY_PIN, ADC_11db); // extend range; calibrate later
+
+  pixels.begin();
+  pixels.clear();
+  pixels.show();
+  ledEngineBegin(NUM_PIXELS, 128); // brightness is applied by the engine's lookup table
+  bootPhaseMark("hardware", start);
+
+  start = millis();
+  if (!LittleFS.begin())
   {
-    unsigned long now = millis();
-    if (now - effectStartTime >= deviceConfig.light.lightDuration)
-    {
-      clearLEDs();
-    }
+    Serial.println("LittleFS mount failed!");
+    return;
   }
+  bootPhaseMark("fs_mount", start);
+
+  start = millis();
+  configLock = xSemaphoreCreateMutex();
+  defaultDeviceConfig(deviceConfig);
+  configLoaded = loadDeviceConfig(deviceConfig);
+  if (configLoaded)
+  {
+    printDeviceConfig(deviceConfig);
+    ledEngineSetBrightness(constrain(deviceConfig.ledBrightness, 5, 255));
+    unknownCard.color = deviceConfig.light.unknownDefaultColor;
+    unknownCard.animation = deviceConfig.light.unknownCardAnimation;
+  }
+  tapConfig.light = deviceConfig.light;
+  tapConfig.sound = deviceConfig.sound;
+  effectLight = deviceConfig.light;
+  tapDebounceBegin(deviceConfig.debounce);
+  verifyCacheBegin(deviceConfig.verify);
+  buzzerBegin(BUZZER_PIN, deviceConfig.sound);
+  bootPhaseMark("config", start);
+
+  start = millis();
+  activityLogBegin();
+  bootPhaseMark("activity_log", start);
+
+  start = millis();
+  cardStoreBegin(deviceConfig.cardCacheBytes);
+  bootPhaseMark("card_store", start);
+
+  attendanceBegin();
+  registerTapHandlers();
+  tapPipelineSelect(deviceConfig.mode);
+
+  // One probe here; a reader that is slow to answer is retried by the NFC task
+  start = millis();
+  Wire.begin(SDA_PIN, SCL_PIN);
+  nfc = new Adafruit_PN532((uint8_t)deviceConfig.nfc.irqPin, (uint8_t)PN532_RESET_PIN, &Wire);
+  nfc->begin();
+  nfcReady = nfcInit();
+  if (!nfcReady)
+    Serial.println("PN532 not found yet, the NFC task keeps retrying.");
+  bootPhaseMark("nfc_init", start);
+
+  showReadyAnimation();
+
+  // Tap detection and feedback on the app core, logging on core 0 with Wi-Fi
+  startAppTask(outputTask, "output", outputTaskBody, 3072, 4, 1, 5);
+  startAppTask(nfcTask, "nfc", nfcTaskBody, 4096, 3, 1, 10);
+  startAppTask(logTask, "log", logTaskBody, 4096, 1, 0, 50);
+  bootPhaseMark("tap_ready", 0);
+  Serial.println("Ready to read NFC cards...");
+
+  xTaskCreatePinnedToCore(netBringUpTask, "netup", 8192, nullptr, 1, nullptr, 0);
+}
+
+void loop(){
+  // All work runs in the tasks started by setup()
+  vTaskDelete(NULL);
 }
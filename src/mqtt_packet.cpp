@@ -0,0 +1,140 @@
+#include "mqtt_packet.h"
+#include <string.h>
+
+enum ReaderState : uint8_t { READ_HEADER, READ_LENGTH, READ_BODY };
+
+// Remaining length as the 1-4 byte variable-length integer
+static size_t putLength(uint8_t* out, uint32_t length) {
+  size_t n = 0;
+  do {
+    uint8_t digit = length % 128;
+    length /= 128;
+    out[n++] = length ? digit | 0x80 : digit;
+  } while (length);
+  return n;
+}
+
+static size_t putString(uint8_t* out, const char* text, size_t len) {
+  out[0] = len >> 8;
+  out[1] = len & 0xFF;
+  memcpy(out + 2, text, len);
+  return len + 2;
+}
+
+// Fixed header plus remaining length; 0 if a body of bodyLen would not fit
+static size_t putHeader(uint8_t* out, size_t cap, uint8_t first, size_t bodyLen) {
+  uint8_t len[4];
+  size_t n = putLength(len, bodyLen);
+  if (1 + n + bodyLen > cap)
+    return 0;
+  out[0] = first;
+  memcpy(out + 1, len, n);
+  return 1 + n;
+}
+
+size_t mqttEncodeConnect(uint8_t* out, size_t cap, const char* clientId, const char* user,
+                         const char* pass, uint16_t keepAliveSec) {
+  size_t idLen = strlen(clientId);
+  size_t userLen = user ? strlen(user) : 0;
+  size_t passLen = pass ? strlen(pass) : 0;
+
+  uint8_t flags = 0x02; // clean session; delivery state lives in our own cursor
+  size_t bodyLen = 10 + 2 + idLen;
+  if (userLen) {
+    flags |= 0x80;
+    bodyLen += 2 + userLen;
+    if (passLen) {
+      flags |= 0x40;
+      bodyLen += 2 + passLen;
+    }
+  }
+
+  size_t n = putHeader(out, cap, MQTT_CONNECT << 4, bodyLen);
+  if (!n)
+    return 0;
+  n += putString(out + n, "MQTT", 4);
+  out[n++] = 4; // protocol level 3.1.1
+  out[n++] = flags;
+  out[n++] = keepAliveSec >> 8;
+  out[n++] = keepAliveSec & 0xFF;
+  n += putString(out + n, clientId, idLen);
+  if (flags & 0x80)
+    n += putString(out + n, user, userLen);
+  if (flags & 0x40)
+    n += putString(out + n, pass, passLen);
+  return n;
+}
+
+size_t mqttEncodePublish(uint8_t* out, size_t cap, const char* topic, uint16_t packetId,
+                         const uint8_t* payload, size_t payloadLen, bool dup) {
+  size_t topicLen = strlen(topic);
+  uint8_t first = (MQTT_PUBLISH << 4) | 0x02; // QoS 1
+  if (dup)
+    first |= 0x08;
+
+  size_t n = putHeader(out, cap, first, 2 + topicLen + 2 + payloadLen);
+  if (!n)
+    return 0;
+  n += putString(out + n, topic, topicLen);
+  out[n++] = packetId >> 8;
+  out[n++] = packetId & 0xFF;
+  memcpy(out + n, payload, payloadLen);
+  return n + payloadLen;
+}
+
+size_t mqttEncodePingReq(uint8_t* out, size_t cap) {
+  return putHeader(out, cap, MQTT_PINGREQ << 4, 0);
+}
+
+size_t mqttEncodeDisconnect(uint8_t* out, size_t cap) {
+  return putHeader(out, cap, MQTT_DISCONNECT << 4, 0);
+}
+
+void mqttReaderReset(MqttReader& reader) {
+  memset(&reader, 0, sizeof(reader));
+  reader.state = READ_HEADER;
+}
+
+bool mqttReaderFeed(MqttReader& reader, uint8_t byte) {
+  switch (reader.state) {
+    case READ_HEADER:
+      reader.type = byte >> 4;
+      reader.flags = byte & 0x0F;
+      reader.length = 0;
+      reader.lengthShift = 0;
+      reader.received = 0;
+      reader.state = READ_LENGTH;
+      return false;
+
+    case READ_LENGTH:
+      reader.length |= (uint32_t)(byte & 0x7F) << reader.lengthShift;
+      reader.lengthShift += 7;
+      if (byte & 0x80) {
+        if (reader.lengthShift >= 28) // malformed; resynchronise on the next byte
+          reader.state = READ_HEADER;
+        return false;
+      }
+      if (reader.length == 0) {
+        reader.state = READ_HEADER;
+        return true;
+      }
+      reader.state = READ_BODY;
+      return false;
+
+    default:
+      if (reader.received < sizeof(reader.body))
+        reader.body[reader.received] = byte;
+      if (++reader.received < reader.length)
+        return false;
+      reader.state = READ_HEADER;
+      return true;
+  }
+}
+
+uint16_t mqttPacketId(const MqttReader& reader) {
+  return reader.length >= 2 ? (reader.body[0] << 8) | reader.body[1] : 0;
+}
+
+uint8_t mqttConnackCode(const MqttReader& reader) {
+  return reader.length >= 2 ? reader.body[1] : 0xFF;
+}
@@ -0,0 +1,340 @@
+#include "mqtt_publisher.h"
+#include "mqtt_packet.h"
+#include "spsc_queue.h"
+#include <WiFi.h>
+#include <atomic>
+
+#define MQTT_CONNECT_TIMEOUT_MS 3000
+#define MQTT_CONNACK_TIMEOUT_MS 10000
+
+// A tap handed over by the NFC task
+struct LiveTap {
+  uint32_t seq;
+  uint32_t time;
+  uint32_t tapMs;
+  uint8_t status;
+  CardUid uid;
+};
+
+struct Inflight {
+  uint32_t seq;
+  uint32_t startMs; // tap time for live taps, send time for backlog
+  uint32_t sentMs;
+  uint16_t packetId;
+};
+
+// Settings copied by mqttPublisherBegin() and picked up by the service task
+struct PublisherSettings {
+  bool enable;
+  char host[64];
+  uint16_t port;
+  char topic[96];
+  char user[32];
+  char pass[64];
+  char device[33];
+};
+
+static PublisherSettings pendingSettings;
+static PublisherSettings settings;
+static std::atomic<bool> settingsChanged(false);
+
+static SpscQueue<LiveTap, 16> liveQueue;
+static LiveTap held;
+static bool haveHeld = false;
+
+static WiFiClient client;
+static MqttReader reader;
+static bool sessionUp = false;   // CONNACK accepted
+static unsigned long connectedAtMs = 0;
+static unsigned long lastAttemptMs = 0;
+static unsigned long backoffMs = 0;
+static unsigned long lastSendMs = 0;
+static unsigned long pingSentMs = 0;
+static bool pingOutstanding = false;
+
+static Inflight inflight[MQTT_MAX_INFLIGHT];
+static uint8_t inflightCount = 0;
+static uint16_t nextPacketId = 1;
+
+static uint32_t sendSeq = 0;   // next seq to publish
+static uint32_t savedSeq = 0;  // cursor as last written to flash
+static unsigned long lastSaveMs = 0;
+static bool cursorReady = false;
+
+static MqttStats stats = {false, false, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+static uint8_t txBuf[256];
+
+// Everything below this seq has been acknowledged
+static uint32_t ackedSeq() {
+  uint32_t seq = sendSeq;
+  for (uint8_t i = 0; i < inflightCount; i++)
+    seq = min(seq, inflight[i].seq);
+  return seq;
+}
+
+static uint32_t oldestSentMs() {
+  uint32_t oldest = inflight[0].sentMs;
+  for (uint8_t i = 1; i < inflightCount; i++) {
+    if ((int32_t)(inflight[i].sentMs - oldest) < 0)
+      oldest = inflight[i].sentMs;
+  }
+  return oldest;
+}
+
+void mqttPublisherBegin(const MqttConfig& config, const char* deviceName) {
+  PublisherSettings& s = pendingSettings;
+  s.enable = config.enable && config.host[0] && config.topic[0];
+  strlcpy(s.host, config.host, sizeof(s.host));
+  s.port = config.port;
+  strlcpy(s.topic, config.topic, sizeof(s.topic));
+  strlcpy(s.user, config.user, sizeof(s.user));
+  strlcpy(s.pass, config.pass, sizeof(s.pass));
+
+  // The name goes into the JSON payload unescaped
+  strlcpy(s.device, deviceName, sizeof(s.device));
+  for (char* c = s.device; *c; c++) {
+    if (*c == '"' || *c == '\\' || (uint8_t)*c < 0x20)
+      *c = '_';
+  }
+  settingsChanged = true;
+}
+
+void mqttPublishTap(uint32_t seq, const CardUid& uid, uint32_t time, ActivityStatus status) {
+  if (!stats.enabled)
+    return;
+  LiveTap tap = {seq, time, (uint32_t)millis(), status, uid};
+  if (!liveQueue.push(tap))
+    stats.liveDropped++;
+}
+
+static void saveCursor(unsigned long now, bool force) {
+  uint32_t seq = ackedSeq();
+  if (seq == savedSeq || (!force && now - lastSaveMs < MQTT_CURSOR_SAVE_MS))
+    return;
+  if (activityCursorSave(MQTT_CURSOR_FILE, seq))
+    savedSeq = seq;
+  lastSaveMs = now;
+}
+
+// Unacknowledged publishes are sent again after the next connect
+static void disconnect(const char* reason) {
+  if (client.connected()) {
+    size_t n = mqttEncodeDisconnect(txBuf, sizeof(txBuf));
+    client.write(txBuf, n);
+  }
+  client.stop();
+  if (sessionUp || stats.connected)
+    Serial.printf("MQTT disconnected: %s\n", reason);
+  sendSeq = ackedSeq();
+  inflightCount = 0;
+  sessionUp = false;
+  stats.connected = false;
+  pingOutstanding = false;
+  haveHeld = false;
+  backoffMs = backoffMs ? min(backoffMs * 2, (unsigned long)MQTT_BACKOFF_MAX_MS) : MQTT_BACKOFF_MIN_MS;
+}
+
+static bool sendPacket(size_t n) {
+  if (n == 0 || client.write(txBuf, n) != n) {
+    disconnect("write failed");
+    return false;
+  }
+  lastSendMs = millis();
+  return true;
+}
+
+static void startConnect(unsigned long now) {
+  lastAttemptMs = now;
+  if (!client.connect(settings.host, settings.port, MQTT_CONNECT_TIMEOUT_MS)) {
+    backoffMs = backoffMs ? min(backoffMs * 2, (unsigned long)MQTT_BACKOFF_MAX_MS) : MQTT_BACKOFF_MIN_MS;
+    return;
+  }
+  client.setNoDelay(true);
+
+  char clientId[32];
+  snprintf(clientId, sizeof(clientId), "jastap-%06llx", (unsigned long long)(ESP.getEfuseMac() & 0xFFFFFF));
+  mqttReaderReset(reader);
+  connectedAtMs = now;
+  sendPacket(mqttEncodeConnect(txBuf, sizeof(txBuf), clientId, settings.user, settings.pass, MQTT_KEEPALIVE_S));
+}
+
+static bool publish(uint32_t seq, const CardUid& uid, uint32_t time, uint8_t status, uint32_t startMs) {
+  char uidHex[CARD_UID_HEX_SIZE];
+  cardUidToHex(uid, uidHex);
+
+  char payload[160];
+  int len = snprintf(payload, sizeof(payload),
+                     "{\"seq\":%u,\"device\":\"%s\",\"uid\":\"%s\",\"status\":\"%s\",\"time\":%u}",
+                     (unsigned)seq, settings.device, uidHex, activityStatusName(status), (unsigned)time);
+  if (len < 0 || len >= (int)sizeof(payload))
+    return false;
+
+  uint16_t packetId = nextPacketId++;
+  if (nextPacketId == 0)
+    nextPacketId = 1;
+  if (!sendPacket(mqttEncodePublish(txBuf, sizeof(txBuf), settings.topic, packetId,
+                                    (const uint8_t*)payload, len, false)))
+    return false;
+
+  inflight[inflightCount++] = {seq, startMs, (uint32_t)millis(), packetId};
+  stats.published++;
+  return true;
+}
+
+static void handleAck(uint16_t packetId, unsigned long now) {
+  for (uint8_t i = 0; i < inflightCount; i++) {
+    if (inflight[i].packetId != packetId)
+      continue;
+    stats.lastLatencyMs = now - inflight[i].startMs;
+    stats.maxLatencyMs = max(stats.maxLatencyMs, stats.lastLatencyMs);
+    stats.acked++;
+    inflight[i] = inflight[--inflightCount];
+    return;
+  }
+}
+
+static void readPackets(unsigned long now) {
+  uint8_t buf[64];
+  int available;
+  while ((available = client.available()) > 0) {
+    int n = client.read(buf, min(available, (int)sizeof(buf)));
+    if (n <= 0)
+      return;
+    for (int i = 0; i < n; i++) {
+      if (!mqttReaderFeed(reader, buf[i]))
+        continue;
+      if (reader.type == MQTT_CONNACK) {
+        if (mqttConnackCode(reader) != 0) {
+          Serial.printf("MQTT connection refused (%u)\n", mqttConnackCode(reader));
+          disconnect("refused");
+          return;
+        }
+        sessionUp = true;
+        stats.connected = true;
+        stats.connects++;
+        backoffMs = 0;
+        Serial.printf("MQTT connected to %s:%u\n", settings.host, settings.port);
+      } else if (reader.type == MQTT_PUBACK) {
+        handleAck(mqttPacketId(reader), now);
+      } else if (reader.type == MQTT_PINGRESP) {
+        pingOutstanding = false;
+      }
+    }
+  }
+}
+
+// Live taps go out straight away when the publisher has caught up with the log;
+// otherwise sendBacklog() picks them up once they are committed
+static void sendLive() {
+  while (inflightCount < MQTT_MAX_INFLIGHT) {
+    if (!haveHeld && !liveQueue.pop(held))
+      return;
+    haveHeld = true;
+    if (held.seq < sendSeq) {
+      haveHeld = false; // already sent from the log
+      continue;
+    }
+    if (held.seq > sendSeq)
+      return; // older records are still waiting in the log
+    haveHeld = false;
+    if (!publish(held.seq, held.uid, held.time, held.status, held.tapMs))
+      return;
+    sendSeq++;
+  }
+}
+
+static void sendBacklog(const ActivityLogStats& log) {
+  if (sendSeq < log.firstSeq) {
+    stats.lost += log.firstSeq - sendSeq;
+    sendSeq = log.firstSeq;
+  }
+
+  ActivityRecord records[MQTT_MAX_INFLIGHT];
+  while (sessionUp && inflightCount < MQTT_MAX_INFLIGHT && sendSeq < log.nextSeq) {
+    size_t n = activityLogReadRange(sendSeq, records, MQTT_MAX_INFLIGHT - inflightCount);
+    if (n == 0)
+      return;
+    for (size_t i = 0; i < n; i++) {
+      const ActivityRecord& r = records[i];
+      CardUid uid;
+      if (r.seq != 0xFFFFFFFF && cardUidFromBytes(r.uid, r.uidLength, uid) &&
+          !publish(r.seq, uid, r.time, r.status, millis()))
+        return;
+      sendSeq++;
+    }
+  }
+}
+
+static void applySettings(unsigned long now) {
+  if (client.connected() || sessionUp)
+    disconnect("config changed");
+  settings = pendingSettings;
+  stats.enabled = settings.enable;
+  backoffMs = 0;
+  lastAttemptMs = now - MQTT_BACKOFF_MAX_MS;
+
+  // The outbox starts at the cursor, or at the end of the log on first use
+  if (!cursorReady) {
+    ActivityLogStats log = activityLogStats();
+    if (!activityCursorLoad(MQTT_CURSOR_FILE, sendSeq) || sendSeq > log.nextSeq)
+      sendSeq = log.nextSeq;
+    savedSeq = sendSeq;
+    cursorReady = true;
+  }
+}
+
+void mqttPublisherService(unsigned long now) {
+  if (settingsChanged.exchange(false))
+    applySettings(now);
+
+  LiveTap drained;
+  if (!stats.enabled) {
+    while (liveQueue.pop(drained)) {}
+    return;
+  }
+
+  ActivityLogStats log = activityLogStats();
+  uint32_t head = log.nextSeq + log.pending;
+  stats.backlog = head - min(ackedSeq(), head);
+  stats.inflight = inflightCount;
+
+  if (!client.connected()) {
+    if (sessionUp || stats.connected)
+      disconnect("connection lost");
+    if (WiFi.status() == WL_CONNECTED && now - lastAttemptMs >= backoffMs)
+      startConnect(now);
+    saveCursor(now, false);
+    return;
+  }
+
+  readPackets(now);
+  if (!client.connected())
+    return;
+
+  if (!sessionUp) {
+    if (now - connectedAtMs > MQTT_CONNACK_TIMEOUT_MS)
+      disconnect("no CONNACK");
+    return;
+  }
+
+  sendBacklog(log);
+  sendLive();
+  if (!sessionUp)
+    return; // a write failed
+
+  if (inflightCount && now - oldestSentMs() > MQTT_ACK_TIMEOUT_MS)
+    disconnect("PUBACK timeout");
+  else if (pingOutstanding && now - pingSentMs > MQTT_ACK_TIMEOUT_MS)
+    disconnect("PINGRESP timeout");
+  else if (!pingOutstanding && now - lastSendMs >= MQTT_KEEPALIVE_S * 1000UL / 2 &&
+           sendPacket(mqttEncodePingReq(txBuf, sizeof(txBuf)))) {
+    pingOutstanding = true;
+    pingSentMs = now;
+  }
+
+  saveCursor(now, inflightCount == 0 && sendSeq == log.nextSeq);
+}
+
+MqttStats mqttPublisherStats() {
+  return stats;
+}
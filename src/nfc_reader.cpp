@@ -0,0 +1,568 @@
+#include "nfc_reader.h"
+#include <Wire.h>
+
+// PN532 frame bytes (user manual 6.2)
+#define PN532_FRAME_HOST 0xD4
+#define PN532_FRAME_READER 0xD5
+#define PN532_CMD_RF_CONFIGURATION 0x32
+#define PN532_CMD_IN_DATA_EXCHANGE 0x40
+#define PN532_CMD_IN_LIST_PASSIVE_TARGET 0x4A
+
+#define PN532_BAUD_ISO14443A 0x00
+#define PN532_BAUD_FELICA_212 0x01
+
+#define PN532_MAX_DATA 64     // largest response payload this reader asks for
+#define PN532_ACK_TIMEOUT_MS 10
+
+// Card commands sent through InDataExchange
+#define NTAG_READ 0x30
+#define DESFIRE_SELECT_APPLICATION 0x5A
+#define DESFIRE_READ_DATA 0xBD
+#define DESFIRE_OK 0x00
+
+static Adafruit_PN532* reader = nullptr;
+static uint8_t mode = NFC_DETECT_POLL;
+static int irqPin = -1;
+static uint32_t readyPollMs = 20;
+static bool felica = false;
+static bool readNdef = false;
+static uint32_t desfireAid = 0;
+static uint8_t desfireFile = 1;
+
+static bool armed = false;
+static uint8_t armedBaud = PN532_BAUD_ISO14443A;
+static unsigned long armedAtMs = 0;
+static unsigned long lastReadyPollMs = 0;
+static volatile bool irqFired = false;
+static volatile uint32_t irqAtUs = 0;
+
+static NfcReaderStats stats = {NFC_DETECT_POLL, 0, 0, 0, 0, 0, 0, 0};
+static NfcTypeStats typeStats[NFC_CARD_TYPE_COUNT];
+static unsigned long windowStartMs = 0;
+static uint32_t windowCalls = 0;
+static uint32_t windowBusyUs = 0;
+
+static void IRAM_ATTR onIrq() {
+  if (!irqFired) {
+    irqAtUs = micros();
+    irqFired = true;
+  }
+}
+
+// Account one blocking reader transaction towards the utilization window
+static void countCall(uint32_t startUs) {
+  windowBusyUs += micros() - startUs;
+  windowCalls++;
+}
+
+static void rollWindow(unsigned long now) {
+  unsigned long elapsed = now - windowStartMs;
+  if (elapsed < NFC_STATS_WINDOW_MS)
+    return;
+  stats.callsPerSec = (uint64_t)windowCalls * 1000 / elapsed;
+  stats.busyPermille = (uint64_t)windowBusyUs / elapsed; // us per ms is already permille
+  windowCalls = 0;
+  windowBusyUs = 0;
+  windowStartMs = now;
+}
+
+// The status byte the Adafruit driver reads internally when there is no IRQ pin
+static bool readyByte() {
+  uint32_t start = micros();
+  bool ready = Wire.requestFrom((uint8_t)PN532_I2C_ADDRESS, (uint8_t)1) == 1 && (Wire.read() & 0x01);
+  countCall(start);
+  return ready;
+}
+
+static void recordLatency(uint32_t latencyUs) {
+  stats.lastLatencyUs = latencyUs;
+  if (latencyUs > stats.maxLatencyUs)
+    stats.maxLatencyUs = latencyUs;
+}
+
+// --- PN532 frames over I2C ---
+// The Adafruit driver keeps the InListPassiveTarget response (ATQA, SAK) to
+// itself, so armed modes build and parse frames here.
+
+static bool writeCommand(const uint8_t* cmd, uint8_t len) {
+  uint8_t frame[8 + 16];
+  if (len > 16)
+    return false;
+  uint8_t frameLen = len + 1; // TFI + data
+  uint8_t sum = PN532_FRAME_HOST;
+  size_t n = 0;
+  frame[n++] = 0x00;
+  frame[n++] = 0x00;
+  frame[n++] = 0xFF;
+  frame[n++] = frameLen;
+  frame[n++] = (uint8_t)(~frameLen + 1);
+  frame[n++] = PN532_FRAME_HOST;
+  for (uint8_t i = 0; i < len; i++) {
+    frame[n++] = cmd[i];
+    sum += cmd[i];
+  }
+  frame[n++] = (uint8_t)(~sum + 1);
+  frame[n++] = 0x00;
+
+  uint32_t start = micros();
+  Wire.beginTransmission((uint8_t)PN532_I2C_ADDRESS);
+  Wire.write(frame, n);
+  bool ok = Wire.endTransmission() == 0;
+  countCall(start);
+  return ok;
+}
+
+// Blocking wait for the reader to have something to say, through whichever signal this mode uses
+static bool waitReady(uint32_t timeoutMs) {
+  unsigned long start = millis();
+  while (true) {
+    if (mode == NFC_DETECT_IRQ ? digitalRead(irqPin) == LOW : readyByte())
+      return true;
+    if (millis() - start >= timeoutMs)
+      return false;
+    delay(1);
+  }
+}
+
+static const uint8_t ackFrame[6] = {0x00, 0x00, 0xFF, 0x00, 0xFF, 0x00};
+
+static bool readAck() {
+  if (!waitReady(PN532_ACK_TIMEOUT_MS))
+    return false;
+  uint8_t buf[7];
+  uint32_t start = micros();
+  size_t n = Wire.requestFrom((uint8_t)PN532_I2C_ADDRESS, (uint8_t)sizeof(buf));
+  for (size_t i = 0; i < n; i++)
+    buf[i] = Wire.read();
+  countCall(start);
+  return n == sizeof(buf) && (buf[0] & 0x01) && memcmp(buf + 1, ackFrame, sizeof(ackFrame)) == 0;
+}
+
+// An ACK from the host aborts the command the reader is running (user manual 6.2.1.3)
+static void writeAbort() {
+  uint32_t start = micros();
+  Wire.beginTransmission((uint8_t)PN532_I2C_ADDRESS);
+  Wire.write(ackFrame, sizeof(ackFrame));
+  Wire.endTransmission();
+  countCall(start);
+}
+
+// Read and drop a frame the reader has ready, e.g. an answer to an aborted search
+static void discardPending() {
+  if (!waitReady(0))
+    return;
+  uint8_t want = 1 + 7 + PN532_MAX_DATA + 2;
+  uint32_t start = micros();
+  size_t n = Wire.requestFrom((uint8_t)PN532_I2C_ADDRESS, want);
+  for (size_t i = 0; i < n; i++)
+    Wire.read();
+  countCall(start);
+}
+
+// Read a ready response to cmd; returns its payload length (after D5 cmd+1), or -1
+static int readResponse(uint8_t cmd, uint8_t* out, size_t cap) {
+  uint8_t buf[1 + 7 + PN532_MAX_DATA + 2];
+  size_t want = min(sizeof(buf), cap + 10);
+  uint32_t start = micros();
+  size_t n = Wire.requestFrom((uint8_t)PN532_I2C_ADDRESS, (uint8_t)want);
+  for (size_t i = 0; i < n; i++)
+    buf[i] = Wire.read();
+  countCall(start);
+
+  // status, 00 00 FF, LEN, LCS, D5, cmd+1, data..., DCS
+  if (n < 9 || !(buf[0] & 0x01) || buf[1] != 0x00 || buf[2] != 0x00 || buf[3] != 0xFF)
+    return -1;
+  uint8_t len = buf[4];
+  if ((uint8_t)(len + buf[5]) != 0 || len < 2 || (size_t)len + 7 > n)
+    return -1;
+  if (buf[6] != PN532_FRAME_READER || buf[7] != cmd + 1)
+    return -1;
+  uint8_t sum = 0;
+  for (uint8_t i = 0; i <= len; i++)
+    sum += buf[6 + i];
+  if (sum != 0)
+    return -1;
+
+  size_t dataLen = len - 2;
+  if (dataLen > cap)
+    return -1;
+  memcpy(out, buf + 8, dataLen);
+  return dataLen;
+}
+
+// One blocking command/response round trip
+static int transceive(const uint8_t* cmd, uint8_t len, uint8_t* out, size_t cap, uint32_t timeoutMs) {
+  if (!writeCommand(cmd, len) || !readAck() || !waitReady(timeoutMs))
+    return -1;
+  return readResponse(cmd[0], out, cap);
+}
+
+// A card command through InDataExchange to target 1; returns the card's reply
+// length (after the PN532 status byte), or -1
+static int exchange(const uint8_t* apdu, uint8_t len, uint8_t* out, size_t cap) {
+  uint8_t cmd[16];
+  uint8_t resp[PN532_MAX_DATA];
+  if (len > sizeof(cmd) - 2)
+    return -1;
+  cmd[0] = PN532_CMD_IN_DATA_EXCHANGE;
+  cmd[1] = 1;
+  memcpy(cmd + 2, apdu, len);
+  int n = transceive(cmd, len + 2, resp, sizeof(resp), NFC_EXCHANGE_TIMEOUT_MS);
+  if (n < 1 || (resp[0] & 0x3F) != 0 || (size_t)(n - 1) > cap)
+    return -1;
+  memcpy(out, resp + 1, n - 1);
+  return n - 1;
+}
+
+// --- Per-type credential reads ---
+
+// First NDEF record in the capability-container layout of NTAG21x/Ultralight.
+// Text records give their text, URI records their URI without the prefix code,
+// anything else its whole payload.
+static bool readNtagNdef(uint8_t* id, size_t* idLength) {
+  uint8_t mem[NFC_NDEF_MAX_BYTES];
+  size_t have = 0;
+  // Reads come 16 bytes (4 pages) at a time, from page 4 on
+  auto ensure = [&](size_t n) {
+    while (have < n && have < sizeof(mem)) {
+      uint8_t cmd[2] = {NTAG_READ, (uint8_t)(4 + have / 4)};
+      if (exchange(cmd, sizeof(cmd), mem + have, 16) != 16)
+        return false;
+      have += 16;
+    }
+    return have >= n;
+  };
+
+  size_t i = 0;
+  while (true) {
+    if (!ensure(i + 2))
+      return false;
+    uint8_t tag = mem[i];
+    if (tag == 0x00) { // NULL TLV
+      i++;
+      continue;
+    }
+    if (tag == 0xFE) // terminator before any message
+      return false;
+    size_t len = mem[i + 1];
+    size_t header = 2;
+    if (len == 0xFF) {
+      if (!ensure(i + 4))
+        return false;
+      len = (mem[i + 2] << 8) | mem[i + 3];
+      header = 4;
+    }
+    if (tag == 0x03) {
+      i += header;
+      break;
+    }
+    i += header + len; // lock / memory control TLVs
+  }
+
+  // Record header: flags, type length, payload length (1 or 4 bytes), id length if IL
+  if (!ensure(i + 3))
+    return false;
+  uint8_t flags = mem[i];
+  uint8_t typeLen = mem[i + 1];
+  size_t p = i + 2;
+  size_t payloadLen;
+  if (flags & 0x10) {
+    payloadLen = mem[p++];
+  } else {
+    if (!ensure(p + 4))
+      return false;
+    payloadLen = ((uint32_t)mem[p] << 24) | ((uint32_t)mem[p + 1] << 16) | (mem[p + 2] << 8) | mem[p + 3];
+    p += 4;
+  }
+  uint8_t recordIdLen = 0;
+  if (flags & 0x08) {
+    if (!ensure(p + 1))
+      return false;
+    recordIdLen = mem[p++];
+  }
+  if (!ensure(p + typeLen))
+    return false;
+  bool wellKnown = (flags & 0x07) == 0x01 && typeLen == 1;
+  uint8_t type = typeLen ? mem[p] : 0;
+  p += typeLen + recordIdLen;
+
+  // A payload past the read window is keyed by what fits; it is hashed anyway
+  if (!ensure(min(p + payloadLen, sizeof(mem))) || p >= have)
+    return false;
+  payloadLen = min(payloadLen, have - p);
+  const uint8_t* payload = mem + p;
+  if (wellKnown && type == 'T' && payloadLen > 0) {
+    size_t skip = 1 + (payload[0] & 0x3F); // status byte, language code
+    if (skip > payloadLen)
+      return false;
+    payload += skip;
+    payloadLen -= skip;
+  } else if (wellKnown && type == 'U' && payloadLen > 0) {
+    payload++;
+    payloadLen--;
+  }
+  if (payloadLen == 0)
+    return false;
+  memcpy(id, payload, payloadLen);
+  *idLength = payloadLen;
+  return true;
+}
+
+// The first bytes of a free-read data file in the configured application
+static bool readDesfireFile(uint8_t* id, size_t* idLength) {
+  uint8_t select[4] = {DESFIRE_SELECT_APPLICATION, (uint8_t)desfireAid, (uint8_t)(desfireAid >> 8),
+                       (uint8_t)(desfireAid >> 16)};
+  uint8_t resp[1 + NFC_DESFIRE_READ_LEN];
+  if (exchange(select, sizeof(select), resp, sizeof(resp)) < 1 || resp[0] != DESFIRE_OK)
+    return false;
+
+  uint8_t read[8] = {DESFIRE_READ_DATA, desfireFile, 0, 0, 0, NFC_DESFIRE_READ_LEN, 0, 0};
+  int n = exchange(read, sizeof(read), resp, sizeof(resp));
+  if (n < 2 || resp[0] != DESFIRE_OK)
+    return false;
+  memcpy(id, resp + 1, n - 1);
+  *idLength = n - 1;
+  return true;
+}
+
+static uint8_t classify(uint16_t atqa, uint8_t sak) {
+  switch (sak) {
+    case 0x08: case 0x18: case 0x09: case 0x88:
+      return NFC_CARD_MIFARE_CLASSIC;
+    case 0x00:
+      return atqa == 0x0044 ? NFC_CARD_NTAG : NFC_CARD_UNKNOWN;
+  }
+  if (sak & 0x20)
+    return atqa == 0x0344 || atqa == 0x0304 ? NFC_CARD_DESFIRE : NFC_CARD_ISO_DEP;
+  return NFC_CARD_UNKNOWN;
+}
+
+// Fill the key from the card's type-specific read, falling back to the UID
+static void readCredential(NfcCredential& cred) {
+  uint8_t id[NFC_NDEF_MAX_BYTES];
+  size_t idLength = 0;
+  bool tried = false;
+  bool read = false;
+  if (cred.type == NFC_CARD_NTAG && readNdef) {
+    tried = true;
+    read = readNtagNdef(id, &idLength);
+    if (read)
+      cardKeyTagged(CARD_KEY_NDEF, id, idLength, cred.key);
+  } else if (cred.type == NFC_CARD_DESFIRE && desfireAid) {
+    tried = true;
+    read = readDesfireFile(id, &idLength);
+    if (read)
+      cardKeyTagged(CARD_KEY_DESFIRE, id, idLength, cred.key);
+  }
+  if (!read)
+    cred.key = cred.uid;
+  if (tried && !read)
+    typeStats[cred.type].fallbacks++;
+}
+
+// --- Detection ---
+
+bool nfcReaderBegin(Adafruit_PN532& nfc, const NfcConfig& config) {
+  reader = &nfc;
+  irqPin = config.irqPin;
+  readyPollMs = config.readyPollMs;
+  felica = config.felica;
+  readNdef = config.readNdef;
+  desfireAid = config.desfireAid;
+  desfireFile = config.desfireFile;
+  if (!config.eventDriven)
+    mode = NFC_DETECT_POLL;
+  else
+    mode = irqPin >= 0 ? NFC_DETECT_IRQ : NFC_DETECT_READY;
+  stats.mode = mode;
+
+  if (!reader->getFirmwareVersion())
+    return false;
+  reader->SAMConfig();
+
+  if (mode == NFC_DETECT_IRQ) {
+    pinMode(irqPin, INPUT_PULLUP);
+    attachInterrupt(digitalPinToInterrupt(irqPin), onIrq, FALLING);
+  }
+  if (mode != NFC_DETECT_POLL && felica) {
+    // Finite retries so an armed search gives up and the other type gets a turn
+    uint8_t cmd[5] = {PN532_CMD_RF_CONFIGURATION, 0x05, 0xFF, 0x01, NFC_ALTERNATE_RETRIES};
+    uint8_t resp[4];
+    transceive(cmd, sizeof(cmd), resp, sizeof(resp), PN532_ACK_TIMEOUT_MS);
+  }
+  armed = false;
+  armedBaud = PN532_BAUD_ISO14443A;
+  windowStartMs = millis();
+  return true;
+}
+
+void nfcReaderIdle() {
+  if (!armed)
+    return;
+  // Cancel the search, or its answer would be read as the next arm's ACK or detection
+  writeAbort();
+  armed = false;
+  irqFired = false;
+}
+
+// The old path: one blocking InListPassiveTarget round trip per call.
+// Adafruit's driver does not return ATQA/SAK, so these cards stay untyped.
+static bool pollOnce(NfcCredential& cred) {
+  uint32_t start = micros();
+  bool present = reader->inListPassiveTarget();
+  countCall(start);
+  if (!present)
+    return false;
+
+  uint8_t raw[CARD_UID_MAX_LEN + 1];
+  uint8_t rawLength = 0;
+  start = micros();
+  bool ok = reader->readPassiveTargetID(PN532_MIFARE_ISO14443A, raw, &rawLength, NFC_POLL_TIMEOUT_MS);
+  countCall(start);
+  if (!ok || !cardUidFromBytes(raw, rawLength, cred.uid))
+    return false;
+  cred.key = cred.uid;
+  cred.type = NFC_CARD_UNKNOWN;
+  cred.atqa = 0;
+  cred.sak = 0;
+  recordLatency(micros() - start);
+  return true;
+}
+
+// Send InListPassiveTarget once; the reader answers when a card enters the field
+static void arm(uint8_t baud, unsigned long now) {
+  // FeliCa polling request: system code FFFF (any), no request code, time slot 0
+  uint8_t cmd[8] = {PN532_CMD_IN_LIST_PASSIVE_TARGET, 1, baud, 0x00, 0xFF, 0xFF, 0x00, 0x00};
+  // A re-arm replaces the running search; a card can answer a cancelled one
+  // before the abort lands
+  if (armed)
+    writeAbort();
+  discardPending();
+  if (!writeCommand(cmd, baud == PN532_BAUD_FELICA_212 ? 8 : 3) || !readAck())
+    return;
+
+  if (armed)
+    stats.rearms++;
+  stats.arms++;
+  armed = true;
+  armedBaud = baud;
+  armedAtMs = now;
+  irqFired = false;
+}
+
+// Parse a ready InListPassiveTarget response into a credential; false when
+// the search ended without a card
+static bool parseTarget(const uint8_t* data, int n, NfcCredential& cred) {
+  if (n < 1 || data[0] == 0)
+    return false;
+  if (armedBaud == PN532_BAUD_FELICA_212) {
+    // NbTg, Tg, POL_RES length, response code 01, IDm[8], PMm[8]
+    if (n < 12 || data[3] != 0x01)
+      return false;
+    cardUidFromBytes(data + 4, 8, cred.uid);
+    cardKeyTagged(CARD_KEY_FELICA, data + 4, 8, cred.key);
+    cred.type = NFC_CARD_FELICA;
+    cred.atqa = 0;
+    cred.sak = 0;
+    return true;
+  }
+  // NbTg, Tg, ATQA[2], SAK, UID length, UID..., ATS...
+  if (n < 6 || 6 + data[5] > n || !cardUidFromBytes(data + 6, data[5], cred.uid))
+    return false;
+  cred.atqa = (data[2] << 8) | data[3];
+  cred.sak = data[4];
+  cred.type = classify(cred.atqa, cred.sak);
+  readCredential(cred);
+  return true;
+}
+
+// Armed modes: read only once the reader signals a response
+static bool readDetected(NfcCredential& cred, unsigned long now) {
+  uint32_t readyAtUs;
+  if (mode == NFC_DETECT_IRQ) {
+    // A card already in the field can answer before the flag was cleared in arm()
+    if (!irqFired && digitalRead(irqPin) == LOW) {
+      irqAtUs = micros();
+      irqFired = true;
+    }
+    if (!irqFired)
+      return false;
+    readyAtUs = irqAtUs;
+  } else {
+    if (now - lastReadyPollMs < readyPollMs)
+      return false;
+    lastReadyPollMs = now;
+    if (!readyByte())
+      return false;
+    readyAtUs = micros();
+  }
+
+  armed = false;
+  uint8_t data[PN532_MAX_DATA];
+  int n = readResponse(PN532_CMD_IN_LIST_PASSIVE_TARGET, data, sizeof(data));
+  if (!parseTarget(data, n, cred)) {
+    // The search ran out of retries: with FeliCa enabled the other type gets a turn
+    bool alternate = felica && armedBaud == PN532_BAUD_ISO14443A;
+    arm(alternate ? PN532_BAUD_FELICA_212 : PN532_BAUD_ISO14443A, now);
+    return false;
+  }
+
+  uint32_t latencyUs = micros() - readyAtUs;
+  recordLatency(latencyUs);
+  NfcTypeStats& t = typeStats[cred.type];
+  t.reads++;
+  t.lastUs = latencyUs;
+  if (latencyUs > t.maxUs)
+    t.maxUs = latencyUs;
+  return true;
+}
+
+bool nfcReaderPoll(NfcCredential& cred, unsigned long now) {
+  if (!reader)
+    return false;
+  rollWindow(now);
+
+  bool read;
+  if (mode == NFC_DETECT_POLL) {
+    read = pollOnce(cred);
+  } else {
+    if (!armed)
+      arm(PN532_BAUD_ISO14443A, now);
+    else if (now - armedAtMs >= NFC_REARM_MS)
+      arm(armedBaud, now);
+    read = armed && readDetected(cred, now);
+  }
+
+  if (!read)
+    return false;
+  stats.detections++;
+  return true;
+}
+
+const char* nfcDetectModeName(uint8_t detectMode) {
+  switch (detectMode) {
+    case NFC_DETECT_POLL: return "poll";
+    case NFC_DETECT_IRQ: return "irq";
+    case NFC_DETECT_READY: return "ready_poll";
+    default: return "unknown";
+  }
+}
+
+const char* nfcCardTypeName(uint8_t type) {
+  switch (type) {
+    case NFC_CARD_MIFARE_CLASSIC: return "mifare_classic";
+    case NFC_CARD_NTAG: return "ntag";
+    case NFC_CARD_DESFIRE: return "desfire";
+    case NFC_CARD_ISO_DEP: return "iso_dep";
+    case NFC_CARD_FELICA: return "felica";
+    default: return "unknown";
+  }
+}
+
+NfcReaderStats nfcReaderStats() {
+  return stats;
+}
+
+NfcTypeStats nfcTypeStats(uint8_t type) {
+  return type < NFC_CARD_TYPE_COUNT ? typeStats[type] : NfcTypeStats{0, 0, 0, 0};
+}
@@ -0,0 +1,151 @@
+#include "online_verify.h"
+#include "spsc_queue.h"
+#include <HTTPClient.h>
+#include <WiFi.h>
+#include <atomic>
+
+struct VerifyRequest {
+  CardUid uid;
+  uint32_t time;
+  uint32_t startUs;
+  bool refresh;
+};
+
+// Settings copied by onlineVerifyBegin() and picked up by the verify task
+struct VerifySettings {
+  bool enable;
+  char host[64];
+  uint16_t port;
+  char device[33];
+};
+
+static VerifySettings pendingSettings;
+static VerifySettings settings;
+static std::atomic<bool> settingsChanged(false);
+static std::atomic<bool> enabled(false);
+
+static SpscQueue<VerifyRequest, VERIFY_QUEUE_SIZE> requests; // NFC task -> verify task
+static SpscQueue<VerifyResult, VERIFY_QUEUE_SIZE> results;   // verify task -> NFC task
+
+static WiFiClient client; // kept open between requests for keep-alive
+static HTTPClient http;
+
+static OnlineVerifyStats stats = {false, 0, 0, 0, 0, 0, 0, 0, {{0}, 0, 0}};
+
+void onlineVerifyBegin(const ServerConfig& config, const char* deviceName) {
+  VerifySettings& s = pendingSettings;
+  s.enable = config.address[0] != 0;
+  strlcpy(s.host, config.address, sizeof(s.host));
+  s.port = config.port;
+  strlcpy(s.device, deviceName, sizeof(s.device));
+  enabled = s.enable;
+  settingsChanged = true;
+}
+
+bool onlineVerifyAvailable() {
+  return enabled && WiFi.status() == WL_CONNECTED;
+}
+
+bool onlineVerifyRequest(const CardUid& uid, uint32_t time, uint32_t startUs, bool refresh) {
+  VerifyRequest request = {uid, time, startUs, refresh};
+  if (!requests.push(request)) {
+    stats.dropped++;
+    return false;
+  }
+  return true;
+}
+
+bool onlineVerifyResult(VerifyResult& result) {
+  return results.pop(result);
+}
+
+// Query-string escaping for the device name; the UID is hex already
+static size_t urlEncode(const char* in, char* out, size_t cap) {
+  static const char digits[] = "0123456789ABCDEF";
+  size_t n = 0;
+  for (; *in && n + 4 < cap; in++) {
+    char c = *in;
+    if (isalnum((unsigned char)c) || c == '-' || c == '_' || c == '.') {
+      out[n++] = c;
+    } else {
+      out[n++] = '%';
+      out[n++] = digits[(uint8_t)c >> 4];
+      out[n++] = digits[c & 0x0F];
+    }
+  }
+  out[n] = '\0';
+  return n;
+}
+
+// Seconds from a Cache-Control max-age directive, as milliseconds; 0 without one
+static uint32_t maxAgeMs(const String& cacheControl) {
+  int at = cacheControl.indexOf("max-age=");
+  if (at < 0)
+    return 0;
+  long seconds = atol(cacheControl.c_str() + at + 8);
+  return seconds > 0 ? (uint32_t)min(seconds, 86400L) * 1000 : 0;
+}
+
+static VerifyDecision ask(const CardUid& uid, int& status, uint32_t& ttlMs) {
+  char device[3 * sizeof(settings.device)];
+  urlEncode(settings.device, device, sizeof(device));
+  char uidHex[CARD_UID_HEX_SIZE];
+  cardUidToHex(uid, uidHex);
+  char path[sizeof(VERIFY_PATH) + sizeof(device) + CARD_UID_HEX_SIZE + 16];
+  snprintf(path, sizeof(path), VERIFY_PATH "?device=%s&uid=%s", device, uidHex);
+
+  http.setReuse(true);
+  http.setTimeout(VERIFY_TIMEOUT_MS);
+  http.setConnectTimeout(VERIFY_TIMEOUT_MS);
+  if (!http.begin(client, settings.host, settings.port, path)) {
+    status = HTTPC_ERROR_CONNECTION_REFUSED;
+    return VERIFY_ERROR;
+  }
+  static const char* headers[] = {"Cache-Control"};
+  http.collectHeaders(headers, 1);
+  status = http.GET();
+  ttlMs = status > 0 ? maxAgeMs(http.header("Cache-Control")) : 0;
+  http.end(); // keeps the socket when the server allows keep-alive
+
+  if (status == 200)
+    return VERIFY_ALLOW;
+  if (status == 403 || status == 404)
+    return VERIFY_DENY;
+  return VERIFY_ERROR;
+}
+
+void onlineVerifyService(unsigned long now) {
+  (void)now;
+  if (settingsChanged.exchange(false)) {
+    http.end();
+    client.stop();
+    settings = pendingSettings;
+    stats.enabled = settings.enable;
+  }
+
+  VerifyRequest request;
+  while (requests.pop(request)) {
+    VerifyResult result = {request.uid, request.time, request.startUs, request.refresh, VERIFY_ERROR, 0, 0};
+    if (settings.enable && WiFi.status() == WL_CONNECTED) {
+      uint32_t start = micros();
+      result.decision = ask(request.uid, result.httpStatus, result.ttlMs);
+      uint32_t elapsedUs = micros() - start;
+      latencyRecord(stats.roundTrip, elapsedUs);
+      stats.lastRequestMs = elapsedUs / 1000;
+      stats.lastStatus = result.httpStatus;
+      stats.requests++;
+    }
+    if (result.decision == VERIFY_ALLOW)
+      stats.allowed++;
+    else if (result.decision == VERIFY_DENY)
+      stats.denied++;
+    else
+      stats.errors++;
+    // Same depth as the request queue, and the NFC task drains it every loop
+    results.push(result);
+  }
+}
+
+OnlineVerifyStats onlineVerifyStats() {
+  return stats;
+}
@@ -0,0 +1,317 @@
+#include "sim800_modem.h"
+
+#define MODEM_BODY_TIMEOUT_MS 12000
+#define MODEM_DATA_WINDOW_MS 10000 // HTTPDATA input window given to the modem
+
+static Stream* port = nullptr;
+static char apn[48];
+
+static ModemState state = MODEM_OFF;
+static unsigned long stateSinceMs = 0; // last command written
+static unsigned long phaseSinceMs = 0; // entered the current state from another
+static unsigned long bringUpStartMs = 0;
+static uint8_t probeAttempts = 0;
+static bool attached = false;
+
+static char line[MODEM_LINE_MAX];
+static size_t lineLen = 0;
+
+// Current request; the HTTP session keeps URL and content type between requests
+static char url[160];
+static char contentType[48];
+static bool urlSent = false;
+static bool contentSent = false;
+static const uint8_t* requestBody = nullptr;
+static size_t requestLen = 0;
+static int result = MODEM_RESULT_ERROR;
+static unsigned long requestStartMs = 0;
+
+static ModemStats stats = {MODEM_OFF, 99, false, false, 0, 0, 0, 0, 0, 0};
+
+static void command(const char* fmt, ...) {
+  char buf[224];
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(buf, sizeof(buf), fmt, args);
+  va_end(args);
+  port->print(buf);
+  port->print("\r\n");
+}
+
+static void enter(ModemState next, unsigned long now) {
+  if (next != state)
+    phaseSinceMs = now;
+  state = next;
+  stats.state = next;
+  stateSinceMs = now;
+
+  switch (next) {
+    case MODEM_PROBE: command("AT"); break;
+    case MODEM_ECHO_OFF: command("ATE0"); break;
+    case MODEM_SIGNAL: command("AT+CSQ"); break;
+    case MODEM_REGISTRATION: command("AT+CREG?"); break;
+    case MODEM_ATTACH: command("AT+CGATT?"); break;
+    case MODEM_BEARER_TYPE: command("AT+SAPBR=3,1,\"CONTYPE\",\"GPRS\""); break;
+    case MODEM_BEARER_APN: command("AT+SAPBR=3,1,\"APN\",\"%s\"", apn); break;
+    case MODEM_BEARER_OPEN: command("AT+SAPBR=1,1"); break;
+    case MODEM_BEARER_QUERY:
+      stats.bearerUp = false;
+      command("AT+SAPBR=2,1");
+      break;
+    case MODEM_HTTP_TERM: command("AT+HTTPTERM"); break;
+    case MODEM_HTTP_INIT: command("AT+HTTPINIT"); break;
+    case MODEM_HTTP_CID: command("AT+HTTPPARA=\"CID\",1"); break;
+    case MODEM_HTTP_URL: command("AT+HTTPPARA=\"URL\",\"%s\"", url); break;
+    case MODEM_HTTP_CONTENT: command("AT+HTTPPARA=\"CONTENT\",\"%s\"", contentType); break;
+    case MODEM_HTTP_DATA: command("AT+HTTPDATA=%u,%u", (unsigned)requestLen, (unsigned)MODEM_DATA_WINDOW_MS); break;
+    case MODEM_HTTP_BODY: port->write(requestBody, requestLen); break;
+    case MODEM_HTTP_ACTION: command("AT+HTTPACTION=1"); break;
+    default: break;
+  }
+}
+
+static unsigned long stateTimeout() {
+  switch (state) {
+    case MODEM_REGISTRATION:
+    case MODEM_ATTACH: return MODEM_REG_POLL_MS;
+    case MODEM_BEARER_OPEN: return MODEM_BEARER_TIMEOUT_MS;
+    case MODEM_HTTP_DATA:
+    case MODEM_HTTP_BODY: return MODEM_BODY_TIMEOUT_MS;
+    case MODEM_HTTP_ACTION: return MODEM_ACTION_TIMEOUT_MS;
+    case MODEM_RESET_WAIT: return MODEM_RESET_BACKOFF_MS;
+    default: return MODEM_CMD_TIMEOUT_MS;
+  }
+}
+
+static bool requestRunning() {
+  return state >= MODEM_HTTP_URL && state <= MODEM_HTTP_ACTION;
+}
+
+// Start the bring-up over after a back-off; a running request fails
+static void resetModem(const char* reason, unsigned long now) {
+  Serial.printf("Modem: %s in %s, restarting bring-up\n", reason, modemStateName(state));
+  if (requestRunning()) {
+    result = MODEM_RESULT_TIMEOUT;
+    stats.failures++;
+    stats.lastStatus = result;
+  }
+  stats.resets++;
+  stats.registered = false;
+  stats.bearerUp = false;
+  enter(MODEM_RESET_WAIT, now);
+}
+
+static void finishRequest(int status, unsigned long now) {
+  result = status;
+  stats.lastStatus = status;
+  stats.lastRequestMs = now - requestStartMs;
+  if (status < 200 || status >= 300)
+    stats.failures++;
+  // Errors and 6xx (SIM800 network errors) may mean the bearer dropped; check it first
+  enter(status > 0 && status < 600 ? MODEM_READY : MODEM_BEARER_QUERY, now);
+}
+
+// Next step of a request after the parameters already in the session
+static void requestNext(unsigned long now) {
+  if (!urlSent)
+    enter(MODEM_HTTP_URL, now);
+  else if (!contentSent)
+    enter(MODEM_HTTP_CONTENT, now);
+  else
+    enter(MODEM_HTTP_DATA, now);
+}
+
+// OK / ERROR for the command of the current state
+static void onFinal(bool ok, unsigned long now) {
+  switch (state) {
+    case MODEM_PROBE:
+      if (ok) enter(MODEM_ECHO_OFF, now);
+      break;
+    case MODEM_ECHO_OFF: enter(MODEM_SIGNAL, now); break;
+    case MODEM_SIGNAL: enter(MODEM_REGISTRATION, now); break;
+    case MODEM_REGISTRATION:
+      if (stats.registered) enter(MODEM_ATTACH, now);
+      break; // otherwise polled again on timeout
+    case MODEM_ATTACH:
+      if (attached) enter(MODEM_BEARER_TYPE, now);
+      break;
+    case MODEM_BEARER_TYPE:
+    case MODEM_BEARER_APN:
+      if (!ok) resetModem("bearer setup refused", now);
+      else enter(state == MODEM_BEARER_TYPE ? MODEM_BEARER_APN : MODEM_BEARER_OPEN, now);
+      break;
+    case MODEM_BEARER_OPEN:
+      enter(MODEM_BEARER_QUERY, now); // ERROR here usually means it is already open
+      break;
+    case MODEM_BEARER_QUERY:
+      if (stats.bearerUp) enter(MODEM_HTTP_TERM, now);
+      else resetModem("bearer down", now);
+      break;
+    case MODEM_HTTP_TERM:
+      urlSent = false;
+      contentSent = false;
+      enter(MODEM_HTTP_INIT, now);
+      break;
+    case MODEM_HTTP_INIT:
+    case MODEM_HTTP_CID:
+      if (!ok) resetModem("HTTP service refused", now);
+      else if (state == MODEM_HTTP_INIT) enter(MODEM_HTTP_CID, now);
+      else {
+        stats.bringUpMs = now - bringUpStartMs;
+        Serial.printf("Modem: ready in %u ms, signal %d\n", stats.bringUpMs, stats.rssi);
+        enter(MODEM_READY, now);
+      }
+      break;
+    case MODEM_HTTP_URL:
+      urlSent = ok;
+      if (ok) requestNext(now);
+      else finishRequest(MODEM_RESULT_ERROR, now);
+      break;
+    case MODEM_HTTP_CONTENT:
+      contentSent = ok;
+      if (ok) requestNext(now);
+      else finishRequest(MODEM_RESULT_ERROR, now);
+      break;
+    case MODEM_HTTP_BODY:
+      if (ok) enter(MODEM_HTTP_ACTION, now);
+      else finishRequest(MODEM_RESULT_ERROR, now);
+      break;
+    case MODEM_HTTP_DATA:
+    case MODEM_HTTP_ACTION:
+      if (!ok) finishRequest(MODEM_RESULT_ERROR, now);
+      break; // OK to HTTPACTION only means it started
+    default:
+      break;
+  }
+}
+
+static void onLine(unsigned long now) {
+  if (strcmp(line, "OK") == 0) {
+    onFinal(true, now);
+  } else if (strcmp(line, "ERROR") == 0 || strncmp(line, "+CME ERROR", 10) == 0) {
+    onFinal(false, now);
+  } else if (strcmp(line, "DOWNLOAD") == 0) {
+    if (state == MODEM_HTTP_DATA)
+      enter(MODEM_HTTP_BODY, now);
+  } else if (strncmp(line, "+CSQ:", 5) == 0) {
+    stats.rssi = atoi(line + 5);
+  } else if (strncmp(line, "+CREG:", 6) == 0) {
+    const char* comma = strchr(line, ',');
+    int stat = comma ? atoi(comma + 1) : 0;
+    stats.registered = stat == 1 || stat == 5; // home or roaming
+  } else if (strncmp(line, "+CGATT:", 7) == 0) {
+    attached = atoi(line + 7) == 1;
+  } else if (strncmp(line, "+SAPBR: 1,", 10) == 0) {
+    stats.bearerUp = atoi(line + 10) == 1; // 1 = connected
+  } else if (strncmp(line, "+HTTPACTION:", 12) == 0) {
+    // +HTTPACTION: <method>,<status>,<length>
+    const char* comma = strchr(line, ',');
+    if (state == MODEM_HTTP_ACTION && comma)
+      finishRequest(atoi(comma + 1), now);
+  }
+}
+
+void modemBegin(Stream& serial, const char* apnName) {
+  port = &serial;
+  strlcpy(apn, apnName, sizeof(apn));
+  lineLen = 0;
+  probeAttempts = 0;
+  bringUpStartMs = millis();
+  enter(MODEM_PROBE, bringUpStartMs);
+}
+
+void modemService(unsigned long now) {
+  if (!port)
+    return;
+
+  while (port->available() > 0) {
+    char c = port->read();
+    if (c == '\n') {
+      while (lineLen && line[lineLen - 1] == '\r')
+        lineLen--;
+      line[lineLen] = '\0';
+      if (lineLen)
+        onLine(now);
+      lineLen = 0;
+    } else if (lineLen < sizeof(line) - 1) {
+      line[lineLen++] = c;
+    }
+  }
+
+  if (state == MODEM_READY || now - stateSinceMs < stateTimeout())
+    return;
+
+  switch (state) {
+    case MODEM_PROBE:
+      if (++probeAttempts >= MODEM_PROBE_ATTEMPTS) resetModem("no answer", now);
+      else enter(MODEM_PROBE, now);
+      break;
+    case MODEM_REGISTRATION:
+    case MODEM_ATTACH:
+      if (now - phaseSinceMs > MODEM_REG_TIMEOUT_MS) resetModem("no network", now);
+      else enter(state, now); // poll again
+      break;
+    case MODEM_RESET_WAIT:
+      probeAttempts = 0;
+      bringUpStartMs = now;
+      enter(MODEM_PROBE, now);
+      break;
+    default:
+      resetModem("timeout", now);
+      break;
+  }
+}
+
+bool modemReady() {
+  return state == MODEM_READY;
+}
+
+bool modemHttpPost(const char* requestUrl, const char* type, const uint8_t* body, size_t len) {
+  if (state != MODEM_READY)
+    return false;
+
+  if (strcmp(url, requestUrl) != 0) {
+    strlcpy(url, requestUrl, sizeof(url));
+    urlSent = false;
+  }
+  if (strcmp(contentType, type) != 0) {
+    strlcpy(contentType, type, sizeof(contentType));
+    contentSent = false;
+  }
+  requestBody = body;
+  requestLen = len;
+  result = 0;
+  requestStartMs = millis();
+  stats.requests++;
+  requestNext(requestStartMs);
+  return true;
+}
+
+int modemHttpResult() {
+  return result;
+}
+
+const char* modemStateName(uint8_t s) {
+  static const char* const names[] = {
+    "off", "probe", "echo_off", "signal", "registration", "attach", "bearer_type",
+    "bearer_apn", "bearer_open", "bearer_query", "http_term", "http_init", "http_cid",
+    "ready", "http_url", "http_content", "http_data", "http_body", "http_action", "reset_wait",
+  };
+  return s < sizeof(names) / sizeof(names[0]) ? names[s] : "invalid";
+}
+
+ModemStats modemStats() {
+  return stats;
+}
+
+static bool cellularAvailable() {
+  return modemReady();
+}
+
+static bool cellularStart(const char* host, uint16_t hostPort, const uint8_t* body, size_t len) {
+  char requestUrl[sizeof(url)];
+  snprintf(requestUrl, sizeof(requestUrl), "http://%s:%u%s", host, hostPort, UPLOAD_PATH);
+  return modemHttpPost(requestUrl, UPLOAD_CONTENT_TYPE, body, len);
+}
+
+const UploadTransport cellularTransport = {"cellular", cellularAvailable, cellularStart, modemHttpResult};
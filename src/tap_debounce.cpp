@@ -0,0 +1,147 @@
+#include "tap_debounce.h"
+#include "activity_log.h"
+
+#define NO_SLOT -1
+
+struct DebounceEntry {
+  CardUid uid;
+  uint32_t hash;
+  uint8_t status;
+  int8_t chain;             // next entry in the same bucket
+  int8_t newer;             // LRU list neighbours
+  int8_t older;
+  unsigned long seenMs;     // last sighting; the cooldown runs from here
+  unsigned long feedbackMs; // last repeat feedback, or the accept
+};
+
+static DebounceEntry entries[TAP_DEBOUNCE_SLOTS];
+static int8_t buckets[TAP_DEBOUNCE_BUCKETS];
+static int8_t newest = NO_SLOT;
+static int8_t oldest = NO_SLOT;
+static uint8_t used = 0;
+
+static uint32_t knownCooldownMs = 3000;
+static uint32_t unknownCooldownMs = 3000;
+
+static TapDebounceStats stats = {0, 0, 0, 0, 0};
+
+static uint32_t cooldownFor(uint8_t status) {
+  return status == ACTIVITY_ALLOWED ? knownCooldownMs : unknownCooldownMs;
+}
+
+static int8_t find(const CardUid& uid, uint32_t hash) {
+  for (int8_t i = buckets[hash & (TAP_DEBOUNCE_BUCKETS - 1)]; i != NO_SLOT; i = entries[i].chain) {
+    if (entries[i].hash == hash && cardUidEquals(entries[i].uid, uid))
+      return i;
+  }
+  return NO_SLOT;
+}
+
+static void unlinkLru(int8_t i) {
+  DebounceEntry& e = entries[i];
+  if (e.newer != NO_SLOT)
+    entries[e.newer].older = e.older;
+  else
+    newest = e.older;
+  if (e.older != NO_SLOT)
+    entries[e.older].newer = e.newer;
+  else
+    oldest = e.newer;
+}
+
+static void pushNewest(int8_t i) {
+  entries[i].newer = NO_SLOT;
+  entries[i].older = newest;
+  if (newest != NO_SLOT)
+    entries[newest].newer = i;
+  newest = i;
+  if (oldest == NO_SLOT)
+    oldest = i;
+}
+
+static void touch(int8_t i) {
+  if (i == newest)
+    return;
+  unlinkLru(i);
+  pushNewest(i);
+}
+
+static void unlinkBucket(int8_t i) {
+  int8_t* link = &buckets[entries[i].hash & (TAP_DEBOUNCE_BUCKETS - 1)];
+  while (*link != i)
+    link = &entries[*link].chain;
+  *link = entries[i].chain;
+}
+
+void tapDebounceConfigure(const DebounceConfig& config) {
+  knownCooldownMs = config.knownCooldownMs;
+  unknownCooldownMs = config.unknownCooldownMs;
+}
+
+static void clearTable() {
+  memset(buckets, NO_SLOT, sizeof(buckets));
+  newest = oldest = NO_SLOT;
+  used = 0;
+  stats.entries = 0;
+}
+
+void tapDebounceBegin(const DebounceConfig& config) {
+  tapDebounceConfigure(config);
+  clearTable();
+}
+
+TapVerdict tapDebounceCheck(const CardUid& uid, unsigned long now) {
+  int8_t i = find(uid, cardUidHash(uid));
+  if (i == NO_SLOT)
+    return TAP_ACCEPT;
+  DebounceEntry& e = entries[i];
+  if (now - e.seenMs >= cooldownFor(e.status))
+    return TAP_ACCEPT;
+
+  e.seenMs = now;
+  touch(i);
+  stats.suppressed++;
+  if (now - e.feedbackMs < TAP_REPEAT_FEEDBACK_MS)
+    return TAP_REPEAT_SILENT;
+  e.feedbackMs = now;
+  stats.feedbacks++;
+  return TAP_REPEAT;
+}
+
+void tapDebounceAccept(const CardUid& uid, uint8_t status, unsigned long now) {
+  uint32_t hash = cardUidHash(uid);
+  int8_t i = find(uid, hash);
+  if (i != NO_SLOT) {
+    touch(i);
+  } else {
+    if (used < TAP_DEBOUNCE_SLOTS) {
+      i = used++;
+    } else {
+      // Reuse the least recently seen entry
+      i = oldest;
+      DebounceEntry& old = entries[i];
+      if (now - old.seenMs < cooldownFor(old.status))
+        stats.evictions++;
+      unlinkLru(i);
+      unlinkBucket(i);
+    }
+    DebounceEntry& e = entries[i];
+    e.uid = uid;
+    e.hash = hash;
+    int8_t* bucket = &buckets[hash & (TAP_DEBOUNCE_BUCKETS - 1)];
+    e.chain = *bucket;
+    *bucket = i;
+    pushNewest(i);
+  }
+
+  DebounceEntry& e = entries[i];
+  e.status = status;
+  e.seenMs = now;
+  e.feedbackMs = now;
+  stats.accepted++;
+  stats.entries = used;
+}
+
+const TapDebounceStats& tapDebounceStats() {
+  return stats;
+}
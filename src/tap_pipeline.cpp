@@ -0,0 +1,70 @@
+#include "tap_pipeline.h"
+
+static const TapHandler* handlers[TAP_MODE_COUNT];
+static TapHandlerStats stats[TAP_MODE_COUNT];
+static uint8_t activeMode = 0;
+
+// Taps for a mode without a handler are dropped, so the tap path never checks for one
+static TapOutcome ignoreTap(const TapEvent&) {
+  return TAP_DONE;
+}
+static const TapHandler noHandler = {"none", ignoreTap, nullptr};
+static const TapHandler* active = &noHandler;
+static TapHandlerStats noHandlerStats;
+static TapHandlerStats* activeStats = &noHandlerStats;
+
+void tapPipelineRegister(uint8_t mode, const TapHandler* handler) {
+  if (mode >= TAP_MODE_COUNT)
+    return;
+  handlers[mode] = handler;
+  memset(&stats[mode], 0, sizeof(stats[mode]));
+  stats[mode].name = handler->name;
+}
+
+bool tapPipelineSelect(uint8_t mode) {
+  if (mode >= TAP_MODE_COUNT || !handlers[mode])
+    return false;
+  activeMode = mode;
+  active = handlers[mode];
+  activeStats = &stats[mode];
+  return true;
+}
+
+uint8_t tapPipelineMode() {
+  return activeMode;
+}
+
+void tapPipelineHandle(const TapEvent& tap) {
+  TapHandlerStats& s = *activeStats;
+  s.taps++;
+  if (active->handle(tap) == TAP_PENDING)
+    s.pending++;
+  else
+    latencyRecord(s.latency, micros() - tap.startUs);
+}
+
+void tapPipelineService(unsigned long now) {
+  for (uint8_t mode = 0; mode < TAP_MODE_COUNT; mode++) {
+    if (handlers[mode] && handlers[mode]->service)
+      handlers[mode]->service(now);
+  }
+}
+
+void tapPipelineDone(const TapHandler* handler, uint32_t startUs) {
+  for (uint8_t mode = 0; mode < TAP_MODE_COUNT; mode++) {
+    if (handlers[mode] != handler)
+      continue;
+    TapHandlerStats& s = stats[mode];
+    if (s.pending)
+      s.pending--;
+    latencyRecord(s.latency, micros() - startUs);
+    return;
+  }
+}
+
+bool tapPipelineStats(uint8_t mode, TapHandlerStats& out) {
+  if (mode >= TAP_MODE_COUNT || !handlers[mode])
+    return false;
+  out = stats[mode];
+  return true;
+}
@@ -0,0 +1,49 @@
+#include "task_runner.h"
+
+static void runAppTask(void* arg) {
+  AppTask& task = *(AppTask*)arg;
+  uint32_t lastStart = micros();
+
+  while (true) {
+    uint32_t start = micros();
+    task.body();
+    uint32_t busy = micros() - start;
+
+    if (task.loops > 0) {
+      task.lastPeriodUs = start - lastStart;
+      if (task.lastPeriodUs > task.maxPeriodUs)
+        task.maxPeriodUs = task.lastPeriodUs;
+    }
+    if (busy > task.maxBusyUs)
+      task.maxBusyUs = busy;
+    lastStart = start;
+    task.loops++;
+
+    vTaskDelay(pdMS_TO_TICKS(task.periodMs));
+  }
+}
+
+bool startAppTask(AppTask& task, const char* name, void (*body)(), uint32_t stackSize,
+                  UBaseType_t priority, BaseType_t core, uint32_t periodMs) {
+  task.name = name;
+  task.body = body;
+  task.stackSize = stackSize;
+  task.periodMs = periodMs;
+  task.core = core;
+  task.loops = 0;
+  task.lastPeriodUs = 0;
+  task.maxPeriodUs = 0;
+  task.maxBusyUs = 0;
+
+  if (xTaskCreatePinnedToCore(runAppTask, name, stackSize, &task, priority, &task.handle, core) != pdPASS) {
+    Serial.printf("Failed to start task %s\n", name);
+    task.handle = nullptr;
+    return false;
+  }
+  return true;
+}
+
+uint32_t appTaskStackFree(const AppTask& task) {
+  // ESP-IDF reports the high-water mark in bytes
+  return task.handle ? uxTaskGetStackHighWaterMark(task.handle) : 0;
+}
@@ -0,0 +1,170 @@
+#include "verify_cache.h"
+
+#define NO_SLOT -1
+
+struct CacheEntry {
+  CardUid uid;
+  uint32_t hash;
+  bool allow;
+  bool refreshing;
+  int16_t chain;        // next entry in the same bucket
+  int16_t newer;        // LRU list neighbours
+  int16_t older;
+  unsigned long storedMs;
+  uint32_t ttlMs;
+};
+
+static CacheEntry entries[VERIFY_CACHE_SLOTS];
+static int16_t buckets[VERIFY_CACHE_BUCKETS];
+static int16_t newest = NO_SLOT;
+static int16_t oldest = NO_SLOT;
+static uint16_t used = 0;
+
+static uint32_t allowTtlMs = 0;
+static uint32_t denyTtlMs = 0;
+static uint32_t staleMs = 0;
+
+static VerifyCacheStats stats = {0, 0, 0, 0, 0, 0};
+
+static int16_t find(const CardUid& uid, uint32_t hash) {
+  for (int16_t i = buckets[hash & (VERIFY_CACHE_BUCKETS - 1)]; i != NO_SLOT; i = entries[i].chain) {
+    if (entries[i].hash == hash && cardUidEquals(entries[i].uid, uid))
+      return i;
+  }
+  return NO_SLOT;
+}
+
+static void unlinkLru(int16_t i) {
+  CacheEntry& e = entries[i];
+  if (e.newer != NO_SLOT)
+    entries[e.newer].older = e.older;
+  else
+    newest = e.older;
+  if (e.older != NO_SLOT)
+    entries[e.older].newer = e.newer;
+  else
+    oldest = e.newer;
+}
+
+static void pushNewest(int16_t i) {
+  entries[i].newer = NO_SLOT;
+  entries[i].older = newest;
+  if (newest != NO_SLOT)
+    entries[newest].newer = i;
+  newest = i;
+  if (oldest == NO_SLOT)
+    oldest = i;
+}
+
+static void touch(int16_t i) {
+  if (i == newest)
+    return;
+  unlinkLru(i);
+  pushNewest(i);
+}
+
+static void unlinkBucket(int16_t i) {
+  int16_t* link = &buckets[entries[i].hash & (VERIFY_CACHE_BUCKETS - 1)];
+  while (*link != i)
+    link = &entries[*link].chain;
+  *link = entries[i].chain;
+}
+
+void verifyCacheBegin(const VerifyConfig& config) {
+  allowTtlMs = (uint32_t)config.allowTtlSec * 1000;
+  denyTtlMs = (uint32_t)config.denyTtlSec * 1000;
+  staleMs = (uint32_t)config.staleSec * 1000;
+  memset(buckets, 0xFF, sizeof(buckets));
+  newest = oldest = NO_SLOT;
+  used = 0;
+  stats.entries = 0;
+}
+
+VerifyCacheState verifyCacheLookup(const CardUid& uid, unsigned long now, bool canRefresh,
+                                   bool& allow, bool& refresh) {
+  refresh = false;
+  int16_t i = find(uid, cardUidHash(uid));
+  if (i == NO_SLOT) {
+    stats.misses++;
+    return VERIFY_CACHE_MISS;
+  }
+  CacheEntry& e = entries[i];
+  uint32_t age = now - e.storedMs;
+  if (age >= e.ttlMs + staleMs) {
+    stats.misses++;
+    return VERIFY_CACHE_MISS;
+  }
+
+  touch(i);
+  allow = e.allow;
+  VerifyCacheState state;
+  if (age < e.ttlMs) {
+    stats.hits++;
+    state = VERIFY_CACHE_FRESH;
+  } else {
+    stats.staleHits++;
+    state = VERIFY_CACHE_STALE;
+  }
+  bool due = state == VERIFY_CACHE_STALE || (uint64_t)age * 100 >= (uint64_t)e.ttlMs * VERIFY_REFRESH_AHEAD_PERCENT;
+  if (canRefresh && due && !e.refreshing) {
+    e.refreshing = true;
+    refresh = true;
+    stats.refreshes++;
+  }
+  return state;
+}
+
+void verifyCacheStore(const CardUid& uid, bool allow, uint32_t ttlMs, unsigned long now) {
+  if (ttlMs == 0)
+    ttlMs = allow ? allowTtlMs : denyTtlMs;
+  uint32_t hash = cardUidHash(uid);
+  int16_t i = find(uid, hash);
+  if (ttlMs == 0) {
+    // Not to be cached: an entry already there is aged out of the stale window too
+    if (i != NO_SLOT) {
+      entries[i].ttlMs = 0;
+      entries[i].storedMs = now - staleMs - 1;
+      entries[i].refreshing = false;
+    }
+    return;
+  }
+  if (i != NO_SLOT) {
+    touch(i);
+  } else {
+    if (used < VERIFY_CACHE_SLOTS) {
+      i = used++;
+    } else {
+      // Reuse the least recently used entry
+      i = oldest;
+      CacheEntry& old = entries[i];
+      if (now - old.storedMs < old.ttlMs)
+        stats.evictions++;
+      unlinkLru(i);
+      unlinkBucket(i);
+    }
+    CacheEntry& e = entries[i];
+    e.uid = uid;
+    e.hash = hash;
+    int16_t* bucket = &buckets[hash & (VERIFY_CACHE_BUCKETS - 1)];
+    e.chain = *bucket;
+    *bucket = i;
+    pushNewest(i);
+  }
+
+  CacheEntry& e = entries[i];
+  e.allow = allow;
+  e.refreshing = false;
+  e.storedMs = now;
+  e.ttlMs = ttlMs;
+  stats.entries = used;
+}
+
+void verifyCacheRefreshFailed(const CardUid& uid) {
+  int16_t i = find(uid, cardUidHash(uid));
+  if (i != NO_SLOT)
+    entries[i].refreshing = false;
+}
+
+const VerifyCacheStats& verifyCacheStats() {
+  return stats;
+}
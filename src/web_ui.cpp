@@ -0,0 +1,46 @@
+#include "web_ui.h"
+#include "web_assets.h"
+
+static WebUiStats stats = {0, 0, 0, 0};
+
+static const WebAsset* findAsset(const char* name) {
+  for (const WebAsset& asset : webAssets) {
+    if (strcmp(asset.name, name) == 0)
+      return &asset;
+  }
+  return nullptr;
+}
+
+bool serveWebAsset(AsyncWebServerRequest* request, const char* name) {
+  unsigned long start = micros();
+  uint32_t heapBefore = ESP.getFreeHeap();
+
+  const WebAsset* asset = findAsset(name);
+  if (!asset) {
+    request->send(404, "text/plain", "Not found");
+    return false;
+  }
+
+  // Pages only change with the firmware, so the browser revalidates and gets a 304
+  AsyncWebServerResponse* response;
+  if (request->hasHeader("If-None-Match") && request->header("If-None-Match") == asset->etag) {
+    response = request->beginResponse(304);
+    stats.notModified++;
+  } else {
+    // Sent from flash in pieces as the socket drains, never copied to RAM
+    response = request->beginResponse(200, asset->contentType, asset->data, asset->length);
+    response->addHeader("Content-Encoding", "gzip");
+    stats.served++;
+  }
+  response->addHeader("ETag", asset->etag);
+  response->addHeader("Cache-Control", "no-cache");
+  request->send(response);
+
+  stats.lastServeUs = micros() - start;
+  stats.lastHeapDelta = (int32_t)heapBefore - (int32_t)ESP.getFreeHeap();
+  return true;
+}
+
+const WebUiStats& webUiStats() {
+  return stats;
+}
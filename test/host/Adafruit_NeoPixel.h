@@ -0,0 +1,38 @@
+#ifndef HOST_ADAFRUIT_NEOPIXEL_H
+#define HOST_ADAFRUIT_NEOPIXEL_H
+
+// A strip that keeps its pixels in memory, for the native test env
+
+#include <Arduino.h>
+#include <vector>
+
+#define NEO_GRB 0x52
+#define NEO_KHZ800 0x0000
+
+class Adafruit_NeoPixel {
+ public:
+  Adafruit_NeoPixel(uint16_t n, int16_t pin = 6, uint16_t type = NEO_GRB + NEO_KHZ800) : pixels(n) {
+    (void)pin;
+    (void)type;
+  }
+
+  void begin() {}
+  void show() { shows++; }
+  void clear() { std::fill(pixels.begin(), pixels.end(), 0); }
+  void setBrightness(uint8_t b) { brightness = b; }
+  void setPixelColor(uint16_t n, uint32_t c) {
+    if (n < pixels.size())
+      pixels[n] = c;
+  }
+  uint32_t getPixelColor(uint16_t n) const { return n < pixels.size() ? pixels[n] : 0; }
+  uint16_t numPixels() const { return pixels.size(); }
+  static uint32_t Color(uint8_t r, uint8_t g, uint8_t b) { return ((uint32_t)r << 16) | ((uint32_t)g << 8) | b; }
+
+  uint32_t shows = 0;
+  uint8_t brightness = 255;
+
+ private:
+  std::vector<uint32_t> pixels;
+};
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef HOST_ADAFRUIT_PN532_H
+#define HOST_ADAFRUIT_PN532_H
+
+// The slice of the Adafruit driver nfc_reader uses, for the native test env.
+// The blocking poll path is answered from cardUid; frames for the armed modes
+// go through Wire to whatever device the test attached.
+
+#include <Arduino.h>
+#include <Wire.h>
+
+#define PN532_I2C_ADDRESS (0x48 >> 1)
+#define PN532_MIFARE_ISO14443A 0x00
+
+class Adafruit_PN532 {
+ public:
+  Adafruit_PN532(uint8_t irq = 0, uint8_t reset = 0, TwoWire* wire = &Wire) {
+    (void)irq;
+    (void)reset;
+    (void)wire;
+  }
+
+  bool begin() { return true; }
+  uint32_t getFirmwareVersion() { return firmware; }
+  bool SAMConfig() { return true; }
+
+  bool inListPassiveTarget() {
+    calls++;
+    return uidLength > 0;
+  }
+
+  bool readPassiveTargetID(uint8_t baud, uint8_t* uid, uint8_t* length, uint16_t timeout) {
+    (void)baud;
+    (void)timeout;
+    calls++;
+    if (uidLength == 0)
+      return false;
+    memcpy(uid, cardUid, uidLength);
+    *length = uidLength;
+    return true;
+  }
+
+  uint32_t firmware = 0x32010607; // PN532 v1.6
+  uint8_t cardUid[10] = {0};
+  uint8_t uidLength = 0;           // 0: no card in the field
+  uint32_t calls = 0;
+};
+
+#endif
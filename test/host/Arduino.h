@@ -0,0 +1,166 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+// Just enough of the Arduino core to build the portable modules on a host for
+// the native test env. Time comes from the host clock; input pins are plain
+// levels a test drives with hostPinWrite().
+
+#include <algorithm>
+#include <chrono>
+#include <ctype.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <thread>
+
+using std::max;
+using std::min;
+
+#define IRAM_ATTR
+#define PROGMEM
+
+#define LOW 0x0
+#define HIGH 0x1
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+#define FALLING 0x02
+
+#if defined(__GLIBC__) && (__GLIBC__ == 2 && __GLIBC_MINOR__ < 38)
+inline size_t strlcpy(char* dst, const char* src, size_t size) {
+  size_t len = strlen(src);
+  if (size) {
+    size_t n = len < size - 1 ? len : size - 1;
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+  }
+  return len;
+}
+#endif
+
+inline std::chrono::steady_clock::time_point hostStartTime = std::chrono::steady_clock::now();
+inline uint64_t hostSkippedUs = 0;
+
+// Move the clock forward without waiting, for timeout tests
+inline void hostSkipMs(uint32_t ms) {
+  hostSkippedUs += (uint64_t)ms * 1000;
+}
+
+inline uint64_t hostElapsedUs() {
+  auto elapsed = std::chrono::steady_clock::now() - hostStartTime;
+  return std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() + hostSkippedUs;
+}
+
+// 32-bit like the ESP32, so wraparound arithmetic behaves the same
+inline unsigned long millis() {
+  return (uint32_t)(hostElapsedUs() / 1000);
+}
+
+inline unsigned long micros() {
+  return (uint32_t)hostElapsedUs();
+}
+
+inline void delay(uint32_t ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+// --- Pins ---
+
+#define HOST_PIN_COUNT 40
+
+struct HostPin {
+  int level = HIGH; // inputs idle pulled up
+  void (*isr)() = nullptr;
+  int isrMode = 0;
+};
+
+inline HostPin hostPins[HOST_PIN_COUNT];
+
+inline void pinMode(int, int) {}
+inline int digitalPinToInterrupt(int pin) { return pin; }
+
+inline int digitalRead(int pin) {
+  return pin >= 0 && pin < HOST_PIN_COUNT ? hostPins[pin].level : LOW;
+}
+
+inline void attachInterrupt(int pin, void (*isr)(), int mode) {
+  if (pin >= 0 && pin < HOST_PIN_COUNT) {
+    hostPins[pin].isr = isr;
+    hostPins[pin].isrMode = mode;
+  }
+}
+
+// Drive an input from a test; a falling edge runs an attached FALLING handler
+inline void hostPinWrite(int pin, int level) {
+  if (pin < 0 || pin >= HOST_PIN_COUNT)
+    return;
+  HostPin& p = hostPins[pin];
+  bool falling = p.level == HIGH && level == LOW;
+  p.level = level;
+  if (falling && p.isr && p.isrMode == FALLING)
+    p.isr();
+}
+
+// --- Print / Stream ---
+
+class Print {
+ public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* data, size_t len) {
+    size_t n = 0;
+    while (len--)
+      n += write(*data++);
+    return n;
+  }
+
+  size_t print(const char* text) { return write((const uint8_t*)text, strlen(text)); }
+  size_t println(const char* text = "") { return print(text) + print("\r\n"); }
+
+  size_t printf(const char* fmt, ...) __attribute__((format(printf, 2, 3))) {
+    char buf[256];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if (len < 0)
+      return 0;
+    return write((const uint8_t*)buf, min((size_t)len, sizeof(buf) - 1));
+  }
+};
+
+class Stream : public Print {
+ public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+
+  size_t readBytes(uint8_t* buffer, size_t len) {
+    size_t n = 0;
+    while (n < len && available() > 0)
+      buffer[n++] = (uint8_t)read();
+    return n;
+  }
+};
+
+// Console only: output goes to stdout (unless muted, e.g. around a benchmark
+// loop), nothing is ever received
+class HardwareSerial : public Stream {
+ public:
+  void begin(unsigned long) {}
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* data, size_t len) override { return muted ? len : fwrite(data, 1, len, stdout); }
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+
+  bool muted = false;
+};
+
+inline HardwareSerial Serial;
+
+#endif
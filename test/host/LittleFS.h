@@ -0,0 +1,135 @@
+#ifndef HOST_LITTLEFS_H
+#define HOST_LITTLEFS_H
+
+// LittleFS for the native test env: paths map into a scratch directory on the
+// host (LITTLEFS_ROOT, or one per process under /tmp). Open modes are the
+// fopen() modes the ESP32 VFS takes as well.
+
+#include <Arduino.h>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+enum SeekMode { SeekSet = 0, SeekCur = 1, SeekEnd = 2 };
+
+// Copies share the open file, as with the Arduino handle
+class File : public Stream {
+ public:
+  File() {}
+  explicit File(FILE* f) {
+    if (f)
+      file.reset(f, fclose);
+  }
+
+  operator bool() const { return file != nullptr; }
+
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* data, size_t len) override {
+    if (!file)
+      return 0;
+    turn(true);
+    return fwrite(data, 1, len, file.get());
+  }
+
+  size_t read(uint8_t* buf, size_t len) {
+    if (!file)
+      return 0;
+    turn(false);
+    return fread(buf, 1, len, file.get());
+  }
+
+  int read() override {
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+  }
+
+  int peek() override {
+    int c = read();
+    if (c >= 0)
+      fseek(file.get(), -1, SEEK_CUR);
+    return c;
+  }
+
+  int available() override {
+    if (!file)
+      return 0;
+    return (int)(size() - position());
+  }
+
+  bool seek(uint32_t pos, SeekMode mode = SeekSet) {
+    return file && fseek(file.get(), pos, mode == SeekSet ? SEEK_SET : mode == SeekCur ? SEEK_CUR : SEEK_END) == 0;
+  }
+
+  size_t position() const { return file ? ftell(file.get()) : 0; }
+
+  size_t size() const {
+    if (!file)
+      return 0;
+    fflush(file.get());
+    struct stat st;
+    return fstat(fileno(file.get()), &st) == 0 ? st.st_size : 0;
+  }
+
+  void flush() {
+    if (file)
+      fflush(file.get());
+  }
+
+  void close() { file.reset(); }
+
+ private:
+  // stdio needs a positioning call between reading and writing the same stream
+  void turn(bool toWrite) {
+    if (writing != toWrite)
+      fseek(file.get(), 0, SEEK_CUR);
+    writing = toWrite;
+  }
+
+  std::shared_ptr<FILE> file;
+  bool writing = false;
+};
+
+class LittleFSFS {
+ public:
+  bool begin(bool formatOnFail = false) {
+    (void)formatOnFail;
+    if (root.empty()) {
+      const char* env = getenv("LITTLEFS_ROOT");
+      root = env ? env : "/tmp/littlefs-" + std::to_string(getpid());
+    }
+    std::error_code ec;
+    std::filesystem::create_directories(root, ec);
+    return !ec;
+  }
+
+  // Remove every file; tests call this to start from an empty flash
+  bool format() {
+    std::error_code ec;
+    std::filesystem::remove_all(root, ec);
+    return begin();
+  }
+
+  File open(const char* path, const char* mode = "r") {
+    std::string fmode(mode);
+    if (fmode.find('b') == std::string::npos)
+      fmode += 'b';
+    return File(fopen(hostPath(path).c_str(), fmode.c_str()));
+  }
+
+  bool exists(const char* path) { return access(hostPath(path).c_str(), F_OK) == 0; }
+  bool remove(const char* path) { return ::remove(hostPath(path).c_str()) == 0; }
+  bool rename(const char* from, const char* to) {
+    return ::rename(hostPath(from).c_str(), hostPath(to).c_str()) == 0;
+  }
+
+ private:
+  std::string hostPath(const char* path) { return root + path; }
+
+  std::string root;
+};
+
+inline LittleFSFS LittleFS;
+
+#endif
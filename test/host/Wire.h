@@ -0,0 +1,76 @@
+#ifndef HOST_WIRE_H
+#define HOST_WIRE_H
+
+// I2C for the native test env: transactions go to one simulated device that a
+// test attaches to Wire. With none attached, writes are NACKed and reads return nothing.
+
+#include <Arduino.h>
+
+class HostI2cDevice {
+ public:
+  virtual ~HostI2cDevice() {}
+  // A complete write transaction from the host; false NACKs it
+  virtual bool receive(const uint8_t* data, size_t len) = 0;
+  // A read transaction of up to len bytes; returns the number supplied
+  virtual size_t respond(uint8_t* out, size_t len) = 0;
+};
+
+#define HOST_I2C_BUFFER 128
+
+class TwoWire {
+ public:
+  bool begin(int sda = -1, int scl = -1, uint32_t frequency = 0) {
+    (void)sda;
+    (void)scl;
+    (void)frequency;
+    return true;
+  }
+  void setClock(uint32_t) {}
+
+  void beginTransmission(uint8_t) { txLen = 0; }
+
+  size_t write(uint8_t c) {
+    if (txLen >= sizeof(tx))
+      return 0;
+    tx[txLen++] = c;
+    return 1;
+  }
+
+  size_t write(const uint8_t* data, size_t len) {
+    size_t n = 0;
+    while (n < len && write(data[n]))
+      n++;
+    return n;
+  }
+
+  uint8_t endTransmission(bool stop = true) {
+    (void)stop;
+    transactions++;
+    return device && device->receive(tx, txLen) ? 0 : 2; // 2: address NACK
+  }
+
+  uint8_t requestFrom(uint8_t address, uint8_t len) {
+    (void)address;
+    transactions++;
+    rxLen = device ? device->respond(rx, min((size_t)len, sizeof(rx))) : 0;
+    rxPos = 0;
+    return rxLen;
+  }
+
+  int available() { return rxLen - rxPos; }
+  int read() { return rxPos < rxLen ? rx[rxPos++] : -1; }
+
+  HostI2cDevice* device = nullptr;
+  uint32_t transactions = 0;
+
+ private:
+  uint8_t tx[HOST_I2C_BUFFER];
+  size_t txLen = 0;
+  uint8_t rx[HOST_I2C_BUFFER];
+  size_t rxLen = 0;
+  size_t rxPos = 0;
+};
+
+inline TwoWire Wire;
+
+#endif
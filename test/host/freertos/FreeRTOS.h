@@ -0,0 +1,16 @@
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+// The FreeRTOS types and constants the portable modules use, for the native test env
+
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define portMAX_DELAY 0xFFFFFFFF
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef HOST_SEMPHR_H
+#define HOST_SEMPHR_H
+
+// Mutex semaphores backed by std::timed_mutex (ticks are milliseconds here)
+
+#include <chrono>
+#include <mutex>
+#include "FreeRTOS.h"
+
+typedef std::timed_mutex* SemaphoreHandle_t;
+
+inline SemaphoreHandle_t xSemaphoreCreateMutex() {
+  return new std::timed_mutex();
+}
+
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t mutex, TickType_t ticks) {
+  if (ticks == portMAX_DELAY) {
+    mutex->lock();
+    return pdTRUE;
+  }
+  return mutex->try_lock_for(std::chrono::milliseconds(ticks)) ? pdTRUE : pdFALSE;
+}
+
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t mutex) {
+  mutex->unlock();
+  return pdTRUE;
+}
+
+#endif
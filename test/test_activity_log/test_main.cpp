@@ -0,0 +1,271 @@
+// Activity log on a host: batching, the circular file, CRC checks and crash
+// recovery, plus a taps/second benchmark against the old append-a-JSON-line
+// logger. Run with: pio test -e native -f test_activity_log
+
+#include <unity.h>
+#include <LittleFS.h>
+#include <time.h>
+#include "activity_log.h"
+
+// On-flash layout from activity_log.cpp, for tests that damage records
+#define LOG_HEADER_SIZE 32
+#define CURSOR_FILE "/test.cur"
+
+static CardUid uidFor(uint32_t n) {
+  uint8_t bytes[4] = {0x04, (uint8_t)(n >> 16), (uint8_t)(n >> 8), (uint8_t)n};
+  CardUid uid;
+  cardUidFromBytes(bytes, sizeof(bytes), uid);
+  return uid;
+}
+
+// Queue count taps and commit them all
+static void logTaps(uint32_t first, uint32_t count, unsigned long& now) {
+  for (uint32_t i = 0; i < count; i++) {
+    TEST_ASSERT_TRUE(activityLogAppend(uidFor(first + i), 1000 + first + i, ACTIVITY_ALLOWED));
+    activityLogService(now);
+  }
+  now += ACTIVITY_LOG_FLUSH_MS;
+  activityLogService(now);
+  TEST_ASSERT_EQUAL_UINT32(0, activityLogStats().pending);
+}
+
+static void damageSlot(uint32_t seq) {
+  File f = LittleFS.open(ACTIVITY_LOG_FILE, "r+");
+  f.seek(LOG_HEADER_SIZE + (seq % ACTIVITY_LOG_CAPACITY) * sizeof(ActivityRecord) + 6, SeekSet);
+  uint8_t garbage[4] = {0xDE, 0xAD, 0xBE, 0xEF};
+  f.write(garbage, sizeof(garbage));
+  f.close();
+}
+
+void setUp() {
+  LittleFS.begin(true);
+  LittleFS.format();
+  Serial.muted = true; // one line per committed batch
+  TEST_ASSERT_TRUE(activityLogBegin());
+}
+
+void tearDown() {
+  Serial.muted = false;
+}
+
+void test_batches_by_size_and_age() {
+  unsigned long now = 0;
+  ActivityLogStats before = activityLogStats();
+
+  for (uint32_t i = 0; i < ACTIVITY_LOG_BATCH - 1; i++)
+    activityLogAppend(uidFor(i), 0, ACTIVITY_UNKNOWN);
+  activityLogService(now);
+  TEST_ASSERT_EQUAL_UINT32(ACTIVITY_LOG_BATCH - 1, activityLogStats().pending);
+
+  // A full batch commits at once
+  activityLogAppend(uidFor(99), 0, ACTIVITY_UNKNOWN);
+  activityLogService(now);
+  TEST_ASSERT_EQUAL_UINT32(0, activityLogStats().pending);
+  TEST_ASSERT_EQUAL_UINT32(before.batches + 1, activityLogStats().batches);
+
+  // A short batch waits for ACTIVITY_LOG_FLUSH_MS
+  uint32_t seq = 0;
+  activityLogAppend(uidFor(7), 1234, ACTIVITY_ALLOWED, &seq);
+  activityLogService(now);
+  activityLogService(now + ACTIVITY_LOG_FLUSH_MS - 1);
+  TEST_ASSERT_EQUAL_UINT32(1, activityLogStats().pending);
+  activityLogService(now + ACTIVITY_LOG_FLUSH_MS);
+  TEST_ASSERT_EQUAL_UINT32(0, activityLogStats().pending);
+
+  ActivityRecord r;
+  TEST_ASSERT_TRUE(activityLogRead(seq, r));
+  TEST_ASSERT_EQUAL_UINT32(seq, r.seq);
+  TEST_ASSERT_EQUAL_UINT32(1234, r.time);
+  TEST_ASSERT_EQUAL_UINT8(ACTIVITY_ALLOWED, r.status);
+  TEST_ASSERT_EQUAL_UINT8(4, r.uidLength);
+  TEST_ASSERT_EQUAL_UINT8(7, r.uid[3]);
+  TEST_ASSERT_FALSE(activityLogRead(seq + 1, r));
+}
+
+void test_ring_wraps_and_keeps_newest() {
+  unsigned long now = 0;
+  const uint32_t total = ACTIVITY_LOG_CAPACITY + 100;
+  logTaps(0, total, now);
+
+  ActivityLogStats s = activityLogStats();
+  TEST_ASSERT_EQUAL_UINT32(total, s.nextSeq);
+  TEST_ASSERT_EQUAL_UINT32(total - ACTIVITY_LOG_CAPACITY, s.firstSeq);
+
+  ActivityRecord r;
+  TEST_ASSERT_FALSE(activityLogRead(s.firstSeq - 1, r)); // overwritten
+  TEST_ASSERT_TRUE(activityLogRead(s.firstSeq, r));
+  TEST_ASSERT_EQUAL_UINT32(1000 + s.firstSeq, r.time);
+  TEST_ASSERT_TRUE(activityLogRead(total - 1, r));
+  TEST_ASSERT_EQUAL_UINT32(1000 + total - 1, r.time);
+
+  // A range read stops at the end of the ring
+  ActivityRecord range[64];
+  uint32_t seq = ACTIVITY_LOG_CAPACITY - 10;
+  TEST_ASSERT_EQUAL_size_t(10, activityLogReadRange(seq, range, 64));
+  TEST_ASSERT_EQUAL_UINT32(seq + 9, range[9].seq);
+  TEST_ASSERT_EQUAL_size_t(64, activityLogReadRange(ACTIVITY_LOG_CAPACITY, range, 64));
+
+  // Sequence numbers survive a reopen
+  TEST_ASSERT_TRUE(activityLogBegin());
+  TEST_ASSERT_EQUAL_UINT32(total, activityLogStats().nextSeq);
+}
+
+void test_recovery_skips_torn_batch() {
+  unsigned long now = 0;
+  logTaps(0, 40, now);
+
+  // Power lost while the last batch was written: its records fail their CRC
+  for (uint32_t seq = 32; seq < 40; seq++)
+    damageSlot(seq);
+  ActivityRecord r;
+  TEST_ASSERT_FALSE(activityLogRead(35, r));
+  ActivityRecord range[8];
+  TEST_ASSERT_EQUAL_size_t(8, activityLogReadRange(30, range, 8));
+  TEST_ASSERT_EQUAL_UINT32(31, range[1].seq);
+  TEST_ASSERT_EQUAL_HEX32(0xFFFFFFFF, range[2].seq);
+
+  TEST_ASSERT_TRUE(activityLogBegin());
+  TEST_ASSERT_EQUAL_UINT32(32, activityLogStats().nextSeq);
+  TEST_ASSERT_TRUE(activityLogRead(31, r));
+
+  // New taps reuse the torn slots
+  logTaps(100, 1, now);
+  TEST_ASSERT_TRUE(activityLogRead(32, r));
+  TEST_ASSERT_EQUAL_UINT32(1100, r.time);
+}
+
+void test_damaged_header_recreates_log() {
+  unsigned long now = 0;
+  logTaps(0, 20, now);
+  File f = LittleFS.open(ACTIVITY_LOG_FILE, "r+");
+  f.write((const uint8_t*)"XXXX", 4); // magic
+  f.close();
+
+  TEST_ASSERT_TRUE(activityLogBegin());
+  TEST_ASSERT_EQUAL_UINT32(0, activityLogStats().nextSeq);
+}
+
+void test_clear_survives_reopen() {
+  unsigned long now = 0;
+  logTaps(0, 50, now);
+  TEST_ASSERT_TRUE(activityLogClear());
+  TEST_ASSERT_EQUAL_UINT32(50, activityLogStats().firstSeq);
+
+  TEST_ASSERT_TRUE(activityLogBegin());
+  ActivityLogStats s = activityLogStats();
+  TEST_ASSERT_EQUAL_UINT32(50, s.firstSeq);
+  TEST_ASSERT_EQUAL_UINT32(50, s.nextSeq);
+  ActivityRecord r;
+  TEST_ASSERT_FALSE(activityLogRead(49, r));
+}
+
+void test_seek_time_skips_untimed_records() {
+  unsigned long now = 0;
+  // Times 1000..1019, with the first five logged before NTP sync
+  for (uint32_t i = 0; i < 20; i++)
+    activityLogAppend(uidFor(i), i < 5 ? 0 : 1000 + i, ACTIVITY_ALLOWED);
+  activityLogService(now); // the first full batch
+  now += ACTIVITY_LOG_FLUSH_MS;
+  activityLogService(now); // starts the wait for the rest
+  now += ACTIVITY_LOG_FLUSH_MS;
+  activityLogService(now);
+  TEST_ASSERT_EQUAL_UINT32(20, activityLogStats().nextSeq);
+
+  TEST_ASSERT_EQUAL_UINT32(0, activityLogSeekTime(0));
+  TEST_ASSERT_EQUAL_UINT32(0, activityLogSeekTime(1005));
+  TEST_ASSERT_EQUAL_UINT32(10, activityLogSeekTime(1010));
+  TEST_ASSERT_EQUAL_UINT32(20, activityLogSeekTime(5000));
+}
+
+void test_cursor_crc() {
+  uint32_t seq = 0;
+  TEST_ASSERT_FALSE(activityCursorLoad(CURSOR_FILE, seq));
+  TEST_ASSERT_TRUE(activityCursorSave(CURSOR_FILE, 1234));
+  TEST_ASSERT_TRUE(activityCursorSave(CURSOR_FILE, 5678)); // rewritten in place
+  TEST_ASSERT_TRUE(activityCursorLoad(CURSOR_FILE, seq));
+  TEST_ASSERT_EQUAL_UINT32(5678, seq);
+
+  File f = LittleFS.open(CURSOR_FILE, "r+");
+  f.seek(4, SeekSet);
+  f.write((uint8_t)0x01);
+  f.close();
+  TEST_ASSERT_FALSE(activityCursorLoad(CURSOR_FILE, seq));
+}
+
+void test_record_json() {
+  setenv("TZ", "UTC0", 1);
+  tzset();
+  ActivityRecord r = {};
+  r.seq = 42;
+  r.time = 1700000000;
+  r.status = ACTIVITY_UNKNOWN;
+  r.uidLength = 4;
+  r.uid[0] = 0x04;
+  r.uid[3] = 0xAB;
+  char json[128];
+  size_t len = activityRecordToJson(r, json, sizeof(json));
+  TEST_ASSERT_EQUAL_STRING("{\"seq\":42,\"time\":\"2023-11-14 22:13:20\",\"uid\":\"040000AB\",\"status\":\"unknown\"}", json);
+  TEST_ASSERT_EQUAL_size_t(strlen(json), len);
+
+  r.time = 0;
+  TEST_ASSERT_EQUAL_size_t(15, activityRecordToJson(r, json, 16)); // truncated, still terminated
+  TEST_ASSERT_EQUAL_size_t(15, strlen(json));
+}
+
+// The logger this replaced: open, append one JSON line, flush and close per tap
+static void legacyLogActivity(const char* uid, const char* status) {
+  File f = LittleFS.open("/activities.log", "a");
+  if (!f)
+    return;
+  char ts[32];
+  time_t t = time(nullptr);
+  struct tm timeinfo;
+  localtime_r(&t, &timeinfo);
+  strftime(ts, sizeof(ts), "%Y-%m-%d %H:%M:%S", &timeinfo);
+  f.printf("{\"time\":\"%s\",\"uid\":\"%s\",\"status\":\"%s\"}\n", ts, uid, status);
+  f.flush();
+  f.close();
+}
+
+// Sustained taps/second, queueing plus commits. Host file I/O is far cheaper
+// than a LittleFS metadata commit, so the gap on the device is wider than here.
+void test_taps_per_second_benchmark() {
+  const uint32_t taps = 20000;
+  unsigned long now = 0;
+  unsigned long start = micros();
+  for (uint32_t i = 0; i < taps; i++) {
+    activityLogAppend(uidFor(i), 1000 + i, ACTIVITY_ALLOWED);
+    activityLogService(now);
+  }
+  activityLogService(now + ACTIVITY_LOG_FLUSH_MS);
+  double batchedUs = (double)(micros() - start) / taps;
+  TEST_ASSERT_EQUAL_UINT32(taps, activityLogStats().nextSeq);
+
+  char uid[CARD_UID_HEX_SIZE];
+  start = micros();
+  for (uint32_t i = 0; i < taps; i++) {
+    cardUidToHex(uidFor(i), uid);
+    legacyLogActivity(uid, "allowed");
+  }
+  double legacyUs = (double)(micros() - start) / taps;
+
+  char msg[128];
+  snprintf(msg, sizeof(msg), "batched binary log: %.2f us/tap (%.0f taps/s), JSON append: %.2f us/tap (%.0f taps/s)",
+           batchedUs, 1e6 / batchedUs, legacyUs, 1e6 / legacyUs);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_TRUE(batchedUs < legacyUs);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_batches_by_size_and_age);
+  RUN_TEST(test_ring_wraps_and_keeps_newest);
+  RUN_TEST(test_recovery_skips_torn_batch);
+  RUN_TEST(test_damaged_header_recreates_log);
+  RUN_TEST(test_clear_survives_reopen);
+  RUN_TEST(test_seek_time_skips_untimed_records);
+  RUN_TEST(test_cursor_crc);
+  RUN_TEST(test_record_json);
+  RUN_TEST(test_taps_per_second_benchmark);
+  return UNITY_END();
+}
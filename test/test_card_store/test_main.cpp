@@ -0,0 +1,434 @@
+// Card store on a host: hashed lookups, in-place edits, imports, and a lookup
+// benchmark against the line-by-line scan of /cards.txt it replaced.
+// Run with: pio test -e native -f test_card_store
+
+#include <unity.h>
+#include <LittleFS.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include "card_store.h"
+#include "led_effects.h"
+
+#define CACHE_BUDGET (4 * 1024 * 1024)
+
+static uint32_t rng = 1;
+
+static uint32_t nextRandom() {
+  rng = rng * 1103515245u + 12345u;
+  return rng >> 8;
+}
+
+// Distinct 7-byte UIDs: a counter in the low bytes, random filler above
+static CardUid makeUid(uint32_t n) {
+  uint8_t bytes[7] = {0x04, (uint8_t)nextRandom(), (uint8_t)nextRandom(), (uint8_t)(n >> 24),
+                      (uint8_t)(n >> 16), (uint8_t)(n >> 8), (uint8_t)n};
+  CardUid uid;
+  cardUidFromBytes(bytes, sizeof(bytes), uid);
+  return uid;
+}
+
+static void writeFile(const char* path, const std::string& text) {
+  File f = LittleFS.open(path, "w");
+  f.write((const uint8_t*)text.data(), text.size());
+  f.close();
+}
+
+// "uid,color,animation" rows for the given cards; card i gets color i
+static std::string csvFor(const std::vector<CardUid>& uids) {
+  static const char* const animations[] = {"solid", "blink", "pulse", "spin", "rainbow", "none"};
+  std::string csv;
+  char hex[CARD_UID_HEX_SIZE];
+  char row[64];
+  for (size_t i = 0; i < uids.size(); i++) {
+    cardUidToHex(uids[i], hex);
+    snprintf(row, sizeof(row), "%s,#%06X,%s\n", hex, (unsigned)(i & 0xFFFFFF), animations[i % 6]);
+    csv += row;
+  }
+  return csv;
+}
+
+// The lookup the card store replaced: read /cards.txt a line at a time and
+// compare the UID field case-insensitively
+static bool legacyScan(const char* path, const char* uidHex, uint32_t& color) {
+  File file = LittleFS.open(path, "r");
+  if (!file)
+    return false;
+
+  std::string line;
+  while (file.available()) {
+    line.clear();
+    int c;
+    while ((c = file.read()) >= 0 && c != '\n')
+      line += (char)c;
+
+    size_t first = line.find(',');
+    size_t second = first == std::string::npos ? first : line.find(',', first + 1);
+    if (second == std::string::npos)
+      continue;
+    if (strcasecmp(line.substr(0, first).c_str(), uidHex) == 0) {
+      color = parseColor(line.c_str() + first + 1, second - first - 1);
+      file.close();
+      return true;
+    }
+  }
+  file.close();
+  return false;
+}
+
+// The web task runs cardStoreService() between requests; so do the loops below
+static void putServiced(const CardUid& uid, const CardInfo& card) {
+  cardStoreService();
+  TEST_ASSERT_TRUE(cardStorePut(uid, card));
+}
+
+void setUp() {
+  rng = 1;
+  LittleFS.begin(true);
+  LittleFS.format();
+}
+
+void tearDown() {}
+
+void test_uid_hex_round_trip() {
+  CardUid uid;
+  char hex[CARD_UID_HEX_SIZE];
+  TEST_ASSERT_TRUE(cardUidFromHex("04a1b2c3", 8, uid));
+  TEST_ASSERT_EQUAL_UINT8(4, uid.length);
+  cardUidToHex(uid, hex);
+  TEST_ASSERT_EQUAL_STRING("04A1B2C3", hex);
+
+  TEST_ASSERT_FALSE(cardUidFromHex("04A", 3, uid));                    // odd length
+  TEST_ASSERT_FALSE(cardUidFromHex("0011223344556677889900", 22, uid)); // 11 bytes
+  TEST_ASSERT_FALSE(cardUidFromHex("04G1", 4, uid));
+}
+
+void test_uid_hash_includes_length() {
+  // The same leading bytes under different lengths must be different keys
+  uint8_t bytes[7] = {0x04, 0x11, 0x22, 0x33, 0, 0, 0};
+  CardUid four, seven;
+  cardUidFromBytes(bytes, 4, four);
+  cardUidFromBytes(bytes, 7, seven);
+  TEST_ASSERT_FALSE(cardUidEquals(four, seven));
+  TEST_ASSERT_TRUE(cardUidHash(four) != cardUidHash(seven));
+}
+
+void test_migrates_cards_txt() {
+  writeFile(CARDS_FILE,
+            "04A1B2C3,#FF0000,solid\n"
+            "  04a1b2c4 , #0f0 , blink \n"
+            "\n"
+            "nothex,#FF0000,solid\n"
+            "04A1B2C5,#FF0000,sparkle\n"
+            "04A1B2C3,#0000FF,pulse\n"
+            "04A1B2C6,#123456,none");
+  TEST_ASSERT_TRUE(cardStoreBegin(CACHE_BUDGET));
+  TEST_ASSERT_FALSE(LittleFS.exists(CARDS_FILE));
+  TEST_ASSERT_TRUE(LittleFS.exists(CARDS_FILE ".bak"));
+
+  const CardImportStats& imported = cardImportStats();
+  TEST_ASSERT_EQUAL_UINT32(6, imported.rows);
+  TEST_ASSERT_EQUAL_UINT32(4, imported.accepted);
+  TEST_ASSERT_EQUAL_UINT32(2, imported.rejected);
+  TEST_ASSERT_EQUAL_UINT32(1, imported.duplicates);
+  TEST_ASSERT_EQUAL_UINT32(4, imported.firstRejectedLine);
+  TEST_ASSERT_EQUAL_UINT32(3, cardStoreStats().cardCount);
+
+  CardUid uid;
+  CardInfo card;
+  cardUidFromHex("04A1B2C3", 8, uid);
+  TEST_ASSERT_TRUE(cardStoreFind(uid, card));
+  TEST_ASSERT_EQUAL_HEX32(0xFF0000, card.color); // the first row wins
+  TEST_ASSERT_EQUAL_UINT8(LED_ANIM_SOLID, card.animation);
+  cardUidFromHex("04A1B2C4", 8, uid);
+  TEST_ASSERT_TRUE(cardStoreFind(uid, card));
+  TEST_ASSERT_EQUAL_HEX32(0x00FF00, card.color);
+  TEST_ASSERT_EQUAL_UINT8(LED_ANIM_BLINK, card.animation);
+  cardUidFromHex("04A1B2C5", 8, uid);
+  TEST_ASSERT_FALSE(cardStoreFind(uid, card));
+}
+
+void test_put_update_remove() {
+  TEST_ASSERT_TRUE(cardStoreBegin(CACHE_BUDGET));
+  TEST_ASSERT_EQUAL_UINT32(0, cardStoreStats().cardCount);
+
+  CardUid uid = makeUid(1);
+  CardInfo card = {0x112233, LED_ANIM_PULSE};
+  TEST_ASSERT_TRUE(cardStorePut(uid, card));
+  card = {0x445566, LED_ANIM_SPIN};
+  TEST_ASSERT_TRUE(cardStorePut(uid, card));
+  TEST_ASSERT_EQUAL_UINT32(1, cardStoreStats().cardCount);
+
+  CardInfo found;
+  TEST_ASSERT_TRUE(cardStoreFind(uid, found));
+  TEST_ASSERT_EQUAL_HEX32(0x445566, found.color);
+  TEST_ASSERT_EQUAL_UINT8(LED_ANIM_SPIN, found.animation);
+
+  TEST_ASSERT_TRUE(cardStoreRemove(uid));
+  TEST_ASSERT_FALSE(cardStoreRemove(uid));
+  TEST_ASSERT_FALSE(cardStoreFind(uid, found));
+  TEST_ASSERT_EQUAL_UINT32(0, cardStoreStats().cardCount);
+
+  // Edits are on flash: reopening sees them
+  TEST_ASSERT_TRUE(cardStorePut(uid, card));
+  TEST_ASSERT_TRUE(cardStoreBegin(0));
+  TEST_ASSERT_FALSE(cardStoreStats().cacheReady);
+  TEST_ASSERT_TRUE(cardStoreFind(uid, found));
+  TEST_ASSERT_EQUAL_HEX32(0x445566, found.color);
+}
+
+// Grow from the empty table and delete three cards in four, so probe chains
+// run through tombstones; then compact and check nothing was lost
+void test_probe_chains_survive_growth_and_deletes() {
+  TEST_ASSERT_TRUE(cardStoreBegin(CACHE_BUDGET));
+  const uint32_t count = 3000;
+  std::vector<CardUid> uids;
+  for (uint32_t i = 0; i < count; i++) {
+    uids.push_back(makeUid(i));
+    CardInfo card = {i, LED_ANIM_SOLID};
+    putServiced(uids[i], card);
+  }
+  TEST_ASSERT_EQUAL_UINT32(count, cardStoreStats().cardCount);
+  TEST_ASSERT_LESS_OR_EQUAL(cardStoreStats().slotCount * 85 / 100, count);
+
+  for (uint32_t i = 0; i < count; i++) {
+    if (i % 4)
+      TEST_ASSERT_TRUE(cardStoreRemove(uids[i]));
+  }
+
+  CardInfo card;
+  for (int pass = 0; pass < 2; pass++) {
+    for (uint32_t i = 0; i < count; i++) {
+      bool found = cardStoreFind(uids[i], card);
+      TEST_ASSERT_EQUAL(i % 4 == 0, found);
+      if (found)
+        TEST_ASSERT_EQUAL_UINT32(i, card.color);
+    }
+    if (pass == 0) {
+      TEST_ASSERT_GREATER_THAN(cardStoreStats().slotCount / 4, cardStoreStats().tombstones);
+      cardStoreService();
+      TEST_ASSERT_EQUAL_UINT32(0, cardStoreStats().tombstones);
+      TEST_ASSERT_TRUE(cardStoreBegin(0)); // second pass probes flash instead of the cache
+    }
+  }
+}
+
+// Puts never rebuild: past FULL_LOAD_PCT new cards wait for the service call
+void test_full_table_waits_for_service() {
+  TEST_ASSERT_TRUE(cardStoreBegin(CACHE_BUDGET));
+  std::vector<CardUid> uids;
+  CardInfo card = {1, LED_ANIM_SOLID};
+  do {
+    uids.push_back(makeUid(uids.size()));
+  } while (cardStorePut(uids.back(), card));
+  TEST_ASSERT_EQUAL_size_t(15 + 1, uids.size()); // 95% of the first 16 slots, then one refused
+  TEST_ASSERT_EQUAL_UINT32(16, cardStoreStats().slotCount);
+  TEST_ASSERT_TRUE(cardStoreStats().rebuildDue);
+  TEST_ASSERT_TRUE(cardStorePut(uids[0], card)); // updates still go in
+
+  cardStoreService();
+  TEST_ASSERT_EQUAL_UINT32(32, cardStoreStats().slotCount);
+  TEST_ASSERT_FALSE(cardStoreStats().rebuildDue);
+  TEST_ASSERT_TRUE(cardStorePut(uids.back(), card));
+  TEST_ASSERT_EQUAL_UINT32(16, cardStoreStats().cardCount);
+}
+
+// A grow runs on its own task while the NFC task looks cards up and a web
+// handler edits them. Lookups must never miss, and edits made during the
+// build must survive the swap.
+void test_rebuild_runs_beside_lookups_and_edits() {
+  TEST_ASSERT_TRUE(cardStoreBegin(CACHE_BUDGET));
+  std::vector<CardUid> uids;
+  while (!cardStoreStats().rebuildDue || cardStoreStats().slotCount < 16384) {
+    uids.push_back(makeUid(uids.size()));
+    CardInfo card = {(uint32_t)uids.size() - 1, LED_ANIM_SOLID};
+    if (cardStoreStats().slotCount < 16384)
+      cardStoreService();
+    TEST_ASSERT_TRUE(cardStorePut(uids.back(), card));
+  }
+  uint32_t slots = cardStoreStats().slotCount;
+  const uint32_t edits = 8;
+  std::vector<CardUid> added;
+  for (uint32_t i = 0; i < edits; i++)
+    added.push_back(makeUid(1000000 + i));
+
+  std::atomic<bool> done(false);
+  std::thread web([&done] {
+    cardStoreService();
+    done = true;
+  });
+
+  uint32_t lookups = 0;
+  uint32_t worstUs = 0;
+  CardInfo found;
+  for (uint32_t i = 0; !done || i < edits; i++) {
+    if (i < edits) {
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+      CardInfo card = {0xE000 + i, LED_ANIM_PULSE};
+      TEST_ASSERT_TRUE(cardStorePut(added[i], card));
+      TEST_ASSERT_TRUE(cardStoreRemove(uids[i]));
+    }
+    const CardUid& uid = uids[edits + i % (uids.size() - edits)];
+    unsigned long start = micros();
+    TEST_ASSERT_TRUE(cardStoreFind(uid, found));
+    worstUs = max(worstUs, (uint32_t)(micros() - start));
+    lookups++;
+  }
+  web.join();
+
+  TEST_ASSERT_EQUAL_UINT32(slots * 2, cardStoreStats().slotCount);
+  TEST_ASSERT_EQUAL_UINT32(uids.size(), cardStoreStats().cardCount);
+  for (uint32_t i = 0; i < edits; i++) {
+    TEST_ASSERT_FALSE(cardStoreFind(uids[i], found));
+    TEST_ASSERT_TRUE(cardStoreFind(added[i], found));
+    TEST_ASSERT_EQUAL_HEX32(0xE000 + i, found.color);
+  }
+  for (uint32_t i = edits; i < uids.size(); i++) {
+    TEST_ASSERT_TRUE(cardStoreFind(uids[i], found));
+    TEST_ASSERT_EQUAL_UINT32(i, found.color);
+  }
+
+  char msg[160];
+  snprintf(msg, sizeof(msg), "%u cards: rebuild %u ms, lock held %u us for the swap; %u lookups meanwhile, worst %u us",
+           (unsigned)uids.size(), cardStoreStats().lastRebuildMs, cardStoreStats().lastSwapUs, lookups, worstUs);
+  TEST_MESSAGE(msg);
+}
+
+void test_streaming_import_replaces_cards() {
+  TEST_ASSERT_TRUE(cardStoreBegin(CACHE_BUDGET));
+  CardUid old = makeUid(99);
+  CardInfo card = {1, LED_ANIM_SOLID};
+  TEST_ASSERT_TRUE(cardStorePut(old, card));
+
+  std::vector<CardUid> uids;
+  for (uint32_t i = 0; i < 500; i++)
+    uids.push_back(makeUid(1000 + i));
+  std::string csv = csvFor(uids);
+
+  TEST_ASSERT_TRUE(cardImportBegin());
+  TEST_ASSERT_FALSE(cardImportBegin()); // one import at a time
+  // Odd chunk sizes split rows across writes
+  for (size_t i = 0; i < csv.size(); i += 37)
+    cardImportWrite((const uint8_t*)csv.data() + i, min((size_t)37, csv.size() - i));
+  TEST_ASSERT_TRUE(cardStoreFind(old, card)); // old cards until the swap
+  TEST_ASSERT_TRUE(cardImportEnd());
+
+  TEST_ASSERT_EQUAL_UINT32(500, cardStoreStats().cardCount);
+  TEST_ASSERT_FALSE(cardStoreFind(old, card));
+  for (uint32_t i = 0; i < uids.size(); i++) {
+    TEST_ASSERT_TRUE(cardStoreFind(uids[i], card));
+    TEST_ASSERT_EQUAL_UINT32(i, card.color);
+  }
+}
+
+static void collectUid(const CardText& card, void* context) {
+  ((std::vector<std::string>*)context)->push_back(card.uid);
+}
+
+// Pages resume from the slot cursor, and no call reads more than
+// CARD_LIST_SCAN_SLOTS slots, even when nothing matches
+void test_listing_resumes_and_bounds_scans() {
+  TEST_ASSERT_TRUE(cardStoreBegin(CACHE_BUDGET));
+  const uint32_t count = 2000;
+  for (uint32_t i = 0; i < count; i++) {
+    CardInfo card = {i, LED_ANIM_SOLID};
+    putServiced(makeUid(i), card);
+  }
+  TEST_ASSERT_GREATER_THAN(CARD_LIST_SCAN_SLOTS, cardStoreStats().slotCount);
+
+  std::vector<std::string> seen;
+  CardListCursor cursor = {0, 0, false};
+  TEST_ASSERT_EQUAL_UINT32(0, cardStoreListNext(cursor, "FF", 100, collectUid, &seen));
+  TEST_ASSERT_FALSE(cursor.done);
+  TEST_ASSERT_EQUAL_UINT32(CARD_LIST_SCAN_SLOTS, cursor.slot);
+
+  // 100-card pages, each resumed from a fresh cursor at the previous slot
+  uint32_t next = 0;
+  uint32_t calls = 0;
+  bool done = false;
+  while (!done) {
+    CardListCursor page = {next, 0, false};
+    uint32_t got = 0;
+    while (!page.done && got < 100) {
+      got += cardStoreListNext(page, "", 100 - got, collectUid, &seen);
+      calls++;
+    }
+    next = page.slot;
+    done = page.done;
+  }
+  TEST_ASSERT_EQUAL_size_t(count, seen.size());
+  std::sort(seen.begin(), seen.end());
+  TEST_ASSERT_TRUE(std::adjacent_find(seen.begin(), seen.end()) == seen.end());
+  TEST_ASSERT_LESS_OR_EQUAL(cardStoreStats().slotCount / CARD_LIST_SCAN_SLOTS + count / 100 + 2, calls);
+
+  // The one-shot form keeps going past the scan limit
+  seen.clear();
+  TEST_ASSERT_EQUAL_UINT32(500, cardStoreList("", 1500, 1000, collectUid, &seen));
+}
+
+// Lookup time at 100, 1k, 10k and 50k cards: the hashed store on flash and in
+// the RAM cache against the old scan. Host numbers, so only the ratios carry over.
+void test_lookup_benchmark() {
+  static const uint32_t sizes[] = {100, 1000, 10000, 50000};
+  char msg[160];
+  TEST_MESSAGE("cards   store(flash) us   store(cache) us   scan us");
+
+  for (uint32_t n : sizes) {
+    LittleFS.format();
+    std::vector<CardUid> uids;
+    for (uint32_t i = 0; i < n; i++)
+      uids.push_back(makeUid(i));
+    std::string csv = csvFor(uids);
+    writeFile(CARDS_FILE, csv);
+    writeFile("/scan.txt", csv);
+
+    const uint32_t lookups = 2000;
+    double perLookupUs[2];
+    for (int cached = 0; cached < 2; cached++) {
+      TEST_ASSERT_TRUE(cardStoreBegin(cached ? CACHE_BUDGET : 0));
+      TEST_ASSERT_EQUAL(cached == 1, cardStoreStats().cacheReady);
+      CardInfo card;
+      unsigned long start = micros();
+      for (uint32_t i = 0; i < lookups; i++) {
+        uint32_t k = nextRandom() % n;
+        TEST_ASSERT_TRUE(cardStoreFind(uids[k], card));
+        TEST_ASSERT_EQUAL_UINT32(k & 0xFFFFFF, card.color);
+      }
+      perLookupUs[cached] = (double)(micros() - start) / lookups;
+    }
+
+    // The scan is linear, so fewer samples keep the big tables quick
+    uint32_t scans = n >= 10000 ? 20 : 200;
+    char hex[CARD_UID_HEX_SIZE];
+    uint32_t color;
+    unsigned long start = micros();
+    for (uint32_t i = 0; i < scans; i++) {
+      uint32_t k = nextRandom() % n;
+      cardUidToHex(uids[k], hex);
+      TEST_ASSERT_TRUE(legacyScan("/scan.txt", hex, color));
+      TEST_ASSERT_EQUAL_UINT32(k & 0xFFFFFF, color);
+    }
+    double scanUs = (double)(micros() - start) / scans;
+
+    snprintf(msg, sizeof(msg), "%5u   %17.2f   %15.2f   %7.1f", (unsigned)n, perLookupUs[0], perLookupUs[1], scanUs);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_TRUE(perLookupUs[0] < scanUs || n <= 100);
+  }
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_uid_hex_round_trip);
+  RUN_TEST(test_uid_hash_includes_length);
+  RUN_TEST(test_migrates_cards_txt);
+  RUN_TEST(test_put_update_remove);
+  RUN_TEST(test_probe_chains_survive_growth_and_deletes);
+  RUN_TEST(test_full_table_waits_for_service);
+  RUN_TEST(test_rebuild_runs_beside_lookups_and_edits);
+  RUN_TEST(test_streaming_import_replaces_cards);
+  RUN_TEST(test_listing_resumes_and_bounds_scans);
+  RUN_TEST(test_lookup_benchmark);
+  return UNITY_END();
+}
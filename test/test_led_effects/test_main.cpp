@@ -0,0 +1,198 @@
+// LED effect engine on a host: effects are ticked with a made-up clock and
+// the frame buffer is checked pixel by pixel, then pushed to an in-memory strip.
+// Run with: pio test -e native -f test_led_effects
+
+#include <unity.h>
+#include <math.h>
+#include "led_effects.h"
+
+#define RED 0xFF0000
+#define WHITE 0xFFFFFF
+
+// What the engine's gamma table holds for a level
+static uint8_t gamma8(uint8_t level) {
+  return (uint8_t)(powf(level / 255.0f, 2.6f) * 255.0f + 0.5f);
+}
+
+// One channel at full intensity under a global brightness
+static uint32_t atBrightness(uint8_t value, uint8_t brightness) {
+  return (value * (brightness + 1)) >> 8;
+}
+
+// color scaled by level at full brightness, where the brightness table is the identity
+static uint32_t scaled(uint32_t color, uint8_t level) {
+  uint32_t r = (((color >> 16) & 0xFF) * (level + 1)) >> 8;
+  uint32_t g = (((color >> 8) & 0xFF) * (level + 1)) >> 8;
+  uint32_t b = ((color & 0xFF) * (level + 1)) >> 8;
+  return (r << 16) | (g << 8) | b;
+}
+
+static void assertFill(uint32_t expected, uint16_t count) {
+  const uint32_t* frame = ledFrame();
+  for (uint16_t i = 0; i < count; i++)
+    TEST_ASSERT_EQUAL_HEX32(expected, frame[i]);
+}
+
+void setUp() {
+  ledEffectStop();
+  ledEngineBegin(12, 255);
+  ledEffectTick(0); // push the stop so every test starts clean
+}
+
+void tearDown() {}
+
+void test_parse_helpers() {
+  TEST_ASSERT_EQUAL_HEX32(0x00FF00, parseColor("#0f0", 4));
+  TEST_ASSERT_EQUAL_HEX32(0x123456, parseColor("123456", 6));
+  TEST_ASSERT_EQUAL_HEX32(0, parseColor("#12zz56", 7));
+  TEST_ASSERT_TRUE(isValidColor("#ABC", 4));
+  TEST_ASSERT_FALSE(isValidColor("#ABCD", 5));
+  TEST_ASSERT_EQUAL_UINT8(LED_ANIM_RAINBOW, parseAnimation("rainbow", 7));
+  TEST_ASSERT_EQUAL_UINT8(LED_ANIM_NONE, parseAnimation("none", 4));
+  TEST_ASSERT_TRUE(isValidAnimation("none", 4));
+  TEST_ASSERT_FALSE(isValidAnimation("sparkle", 7));
+  TEST_ASSERT_EQUAL_STRING("spin", animationName(LED_ANIM_SPIN));
+  TEST_ASSERT_EQUAL_STRING("none", animationName(200));
+}
+
+void test_blink_cycles_and_ends() {
+  // Two cycles in a second: on for 250 ms, off for 250 ms
+  ledEffectStart(LED_ANIM_BLINK, RED, 1000, 2, 0);
+  TEST_ASSERT_TRUE(ledEffectTick(0));
+  assertFill(RED, 12);
+
+  TEST_ASSERT_FALSE(ledEffectTick(LED_FRAME_MS - 1)); // no frame due yet
+  TEST_ASSERT_TRUE(ledEffectTick(240));
+  assertFill(RED, 12);
+  TEST_ASSERT_TRUE(ledEffectTick(260));
+  assertFill(0, 12);
+  TEST_ASSERT_TRUE(ledEffectTick(500));
+  assertFill(RED, 12);
+  TEST_ASSERT_TRUE(ledEffectTick(760));
+  assertFill(0, 12);
+
+  // The end clears the ring once, then nothing more is pushed
+  TEST_ASSERT_TRUE(ledEffectActive());
+  TEST_ASSERT_TRUE(ledEffectTick(1000));
+  TEST_ASSERT_FALSE(ledEffectActive());
+  assertFill(0, 12);
+  TEST_ASSERT_FALSE(ledEffectTick(1020));
+}
+
+void test_frame_budget() {
+  // Ticked every millisecond for a second: one frame per LED_FRAME_MS
+  ledEffectStart(LED_ANIM_PULSE, RED, 0, 1, 0);
+  uint32_t frames = 0;
+  for (unsigned long now = 0; now < 1000; now++)
+    frames += ledEffectTick(now);
+  TEST_ASSERT_EQUAL_UINT32(1000 / LED_FRAME_MS, frames); // the start frame, then one every 20 ms to 980
+
+  // A solid color is rendered once and held
+  ledEffectStart(LED_ANIM_SOLID, RED, 0, 1, 0);
+  TEST_ASSERT_TRUE(ledEffectTick(0));
+  frames = 0;
+  for (unsigned long now = 1; now < 1000; now++)
+    frames += ledEffectTick(now);
+  TEST_ASSERT_EQUAL_UINT32(0, frames);
+  TEST_ASSERT_TRUE(ledEffectActive()); // no duration: plays until stopped
+
+  ledEffectStop();
+  TEST_ASSERT_TRUE(ledEffectTick(1000));
+  TEST_ASSERT_FALSE(ledEffectActive());
+}
+
+void test_pulse_follows_gamma() {
+  // One 1000 ms cycle: a triangle from dark to full and back, through the gamma table
+  ledEffectStart(LED_ANIM_PULSE, WHITE, 1000, 1, 0);
+  assertFill(0, 12);
+
+  uint32_t previous = 0;
+  for (unsigned long now = LED_FRAME_MS; now <= 500; now += LED_FRAME_MS) {
+    ledEffectTick(now);
+    uint32_t ramp = now * 510 / 1000;
+    uint8_t level = ramp < 256 ? ramp : 510 - ramp;
+    assertFill(scaled(WHITE, gamma8(level)), 12);
+    TEST_ASSERT_TRUE(ledFrame()[0] >= previous); // rising half
+    previous = ledFrame()[0];
+  }
+  TEST_ASSERT_EQUAL_HEX32(WHITE, ledFrame()[0]); // the peak
+  ledEffectTick(740);
+  assertFill(scaled(WHITE, gamma8(510 - 740 * 510 / 1000)), 12);
+}
+
+void test_spin_head_and_tail() {
+  ledEngineBegin(8, 255);
+  ledEffectStart(LED_ANIM_SPIN, RED, 0, 1, 0);
+  ledEffectTick(2 * LED_FRAME_MS); // one pixel per frame: head at 2
+
+  const uint32_t* frame = ledFrame();
+  TEST_ASSERT_EQUAL_HEX32(scaled(RED, gamma8(255)), frame[2]);
+  TEST_ASSERT_EQUAL_HEX32(scaled(RED, gamma8(127)), frame[1]);
+  TEST_ASSERT_EQUAL_HEX32(scaled(RED, gamma8(63)), frame[0]);
+  TEST_ASSERT_EQUAL_HEX32(scaled(RED, gamma8(31)), frame[7]); // the tail wraps
+  for (int i = 3; i < 7; i++)
+    TEST_ASSERT_EQUAL_HEX32(0, frame[i]);
+
+  // Around the ring and back to the same head
+  ledEffectTick(10 * LED_FRAME_MS);
+  TEST_ASSERT_EQUAL_HEX32(scaled(RED, gamma8(255)), frame[2]);
+}
+
+void test_rainbow_spreads_the_wheel() {
+  ledEngineBegin(6, 255);
+  ledEffectStart(LED_ANIM_RAINBOW, 0, 0, 1, 0);
+  static const uint32_t start[6] = {0xFF0000, 0xFFFF00, 0x00FF00, 0x00FFFF, 0x0000FF, 0xFF00FF};
+  TEST_ASSERT_EQUAL_HEX32_ARRAY(start, ledFrame(), 6);
+
+  // A quarter turn in 500 ms: pixel 0 moves 384 of 1536 around the wheel
+  ledEffectTick(500);
+  TEST_ASSERT_EQUAL_HEX32(0x7FFF00, ledFrame()[0]);
+  ledEffectTick(2000); // a full turn
+  TEST_ASSERT_EQUAL_HEX32_ARRAY(start, ledFrame(), 6);
+}
+
+void test_brightness_scales_held_frames() {
+  ledEngineBegin(4, 128);
+  ledEffectStart(LED_ANIM_SOLID, WHITE, 0, 1, 0);
+  ledEffectTick(0);
+  uint32_t c = atBrightness(255, 128);
+  assertFill((c << 16) | (c << 8) | c, 4);
+
+  // A held solid frame picks up a new brightness without a restart
+  ledEngineSetBrightness(64);
+  TEST_ASSERT_TRUE(ledEffectTick(1));
+  c = atBrightness(255, 64);
+  assertFill((c << 16) | (c << 8) | c, 4);
+
+  ledEngineSetBrightness(0);
+  ledEffectTick(2);
+  assertFill(0, 4);
+}
+
+void test_show_pushes_the_frame() {
+  Adafruit_NeoPixel strip(12);
+  ledEffectStart(LED_ANIM_SOLID, RED, 500, 1, 0);
+  if (ledEffectTick(0))
+    ledEffectShow(strip);
+  TEST_ASSERT_EQUAL_UINT32(1, strip.shows);
+  for (uint16_t i = 0; i < 12; i++)
+    TEST_ASSERT_EQUAL_HEX32(RED, strip.getPixelColor(i));
+
+  if (ledEffectTick(500))
+    ledEffectShow(strip);
+  TEST_ASSERT_EQUAL_UINT32(2, strip.shows);
+  TEST_ASSERT_EQUAL_HEX32(0, strip.getPixelColor(0));
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_parse_helpers);
+  RUN_TEST(test_blink_cycles_and_ends);
+  RUN_TEST(test_frame_budget);
+  RUN_TEST(test_pulse_follows_gamma);
+  RUN_TEST(test_spin_head_and_tail);
+  RUN_TEST(test_rainbow_spreads_the_wheel);
+  RUN_TEST(test_brightness_scales_held_frames);
+  RUN_TEST(test_show_pushes_the_frame);
+  return UNITY_END();
+}
@@ -0,0 +1,231 @@
+// MQTT codec on a host, checked byte for byte against MQTT 3.1.1 and through
+// a small broker stand-in that decodes what the publisher sends and answers
+// with CONNACK/PUBACK. Run with: pio test -e native -f test_mqtt_packet
+
+#include <unity.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "mqtt_packet.h"
+
+// --- Broker stand-in ---
+
+struct BrokerPacket {
+  uint8_t type;
+  uint8_t flags;
+  std::vector<uint8_t> body;
+};
+
+// Split a byte stream into packets, decoding remaining lengths independently of the codec
+static std::vector<BrokerPacket> brokerParse(const uint8_t* data, size_t len) {
+  std::vector<BrokerPacket> packets;
+  size_t i = 0;
+  while (i < len) {
+    BrokerPacket p;
+    p.type = data[i] >> 4;
+    p.flags = data[i] & 0x0F;
+    i++;
+    uint32_t length = 0;
+    uint32_t multiplier = 1;
+    uint8_t digit;
+    do {
+      TEST_ASSERT_TRUE(i < len);
+      digit = data[i++];
+      length += (digit & 0x7F) * multiplier;
+      multiplier *= 128;
+    } while (digit & 0x80);
+    TEST_ASSERT_TRUE(i + length <= len);
+    p.body.assign(data + i, data + i + length);
+    i += length;
+    packets.push_back(p);
+  }
+  return packets;
+}
+
+static std::string brokerString(const std::vector<uint8_t>& body, size_t& at) {
+  size_t len = (body[at] << 8) | body[at + 1];
+  std::string s(body.begin() + at + 2, body.begin() + at + 2 + len);
+  at += 2 + len;
+  return s;
+}
+
+// Feed a byte stream to the reader; returns the packets it completed
+static std::vector<MqttReader> readAll(MqttReader& reader, const uint8_t* data, size_t len) {
+  std::vector<MqttReader> done;
+  for (size_t i = 0; i < len; i++) {
+    if (mqttReaderFeed(reader, data[i]))
+      done.push_back(reader);
+  }
+  return done;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_connect_bytes() {
+  uint8_t out[64];
+  size_t n = mqttEncodeConnect(out, sizeof(out), "dev1", nullptr, nullptr, 30);
+  const uint8_t expected[] = {0x10, 16, 0, 4, 'M', 'Q', 'T', 'T', 4, 0x02, 0, 30, 0, 4, 'd', 'e', 'v', '1'};
+  TEST_ASSERT_EQUAL_size_t(sizeof(expected), n);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, out, n);
+}
+
+void test_connect_credentials() {
+  uint8_t out[64];
+  size_t n = mqttEncodeConnect(out, sizeof(out), "dev1", "user", "pw", 60);
+  std::vector<BrokerPacket> packets = brokerParse(out, n);
+  TEST_ASSERT_EQUAL_size_t(1, packets.size());
+  TEST_ASSERT_EQUAL_UINT8(MQTT_CONNECT, packets[0].type);
+
+  const std::vector<uint8_t>& body = packets[0].body;
+  TEST_ASSERT_EQUAL_HEX8(0xC2, body[7]); // user, password, clean session
+  size_t at = 10;
+  TEST_ASSERT_EQUAL_STRING("dev1", brokerString(body, at).c_str());
+  TEST_ASSERT_EQUAL_STRING("user", brokerString(body, at).c_str());
+  TEST_ASSERT_EQUAL_STRING("pw", brokerString(body, at).c_str());
+  TEST_ASSERT_EQUAL_size_t(body.size(), at);
+
+  // A password without a user is not allowed by 3.1.1, so it is left out
+  n = mqttEncodeConnect(out, sizeof(out), "dev1", "", "pw", 60);
+  TEST_ASSERT_EQUAL_HEX8(0x02, out[9]);
+  TEST_ASSERT_EQUAL_size_t(18, n);
+}
+
+void test_publish_qos1() {
+  uint8_t out[64];
+  const char* payload = "{\"uid\":\"04A1\"}";
+  size_t n = mqttEncodePublish(out, sizeof(out), "taps/dev1", 0x1234, (const uint8_t*)payload, strlen(payload), false);
+  std::vector<BrokerPacket> packets = brokerParse(out, n);
+  TEST_ASSERT_EQUAL_size_t(1, packets.size());
+  TEST_ASSERT_EQUAL_UINT8(MQTT_PUBLISH, packets[0].type);
+  TEST_ASSERT_EQUAL_HEX8(0x02, packets[0].flags); // QoS 1, no DUP, no retain
+
+  size_t at = 0;
+  const std::vector<uint8_t>& body = packets[0].body;
+  TEST_ASSERT_EQUAL_STRING("taps/dev1", brokerString(body, at).c_str());
+  TEST_ASSERT_EQUAL_HEX16(0x1234, (body[at] << 8) | body[at + 1]);
+  at += 2;
+  TEST_ASSERT_EQUAL_STRING(payload, std::string(body.begin() + at, body.end()).c_str());
+
+  n = mqttEncodePublish(out, sizeof(out), "taps/dev1", 0x1234, (const uint8_t*)payload, strlen(payload), true);
+  TEST_ASSERT_EQUAL_HEX8(0x3A, out[0]); // DUP on a resend
+}
+
+void test_remaining_length_boundaries() {
+  // 127 fits one length byte, 128 needs two, 16384 needs three
+  static const size_t bodies[] = {127, 128, 16383, 16384};
+  static const size_t lengthBytes[] = {1, 2, 2, 3};
+  std::vector<uint8_t> payload(16384, 'x');
+  std::vector<uint8_t> out(16400);
+  for (size_t i = 0; i < 4; i++) {
+    size_t payloadLen = bodies[i] - 2 - 1 - 2; // topic "t" and the packet id
+    size_t n = mqttEncodePublish(out.data(), out.size(), "t", 1, payload.data(), payloadLen, false);
+    TEST_ASSERT_EQUAL_size_t(1 + lengthBytes[i] + bodies[i], n);
+    std::vector<BrokerPacket> packets = brokerParse(out.data(), n);
+    TEST_ASSERT_EQUAL_size_t(bodies[i], packets[0].body.size());
+  }
+}
+
+void test_encoders_refuse_small_buffers() {
+  uint8_t out[32];
+  const uint8_t payload[20] = {0};
+  // "t" plus id plus 20 bytes is 25 of body: 27 bytes in all
+  TEST_ASSERT_EQUAL_size_t(27, mqttEncodePublish(out, 27, "t", 1, payload, sizeof(payload), false));
+  TEST_ASSERT_EQUAL_size_t(0, mqttEncodePublish(out, 26, "t", 1, payload, sizeof(payload), false));
+  TEST_ASSERT_EQUAL_size_t(0, mqttEncodeConnect(out, 17, "dev1", nullptr, nullptr, 30));
+  TEST_ASSERT_EQUAL_size_t(0, mqttEncodePingReq(out, 1));
+
+  TEST_ASSERT_EQUAL_size_t(2, mqttEncodePingReq(out, sizeof(out)));
+  TEST_ASSERT_EQUAL_HEX8(0xC0, out[0]);
+  TEST_ASSERT_EQUAL_size_t(2, mqttEncodeDisconnect(out, sizeof(out)));
+  TEST_ASSERT_EQUAL_HEX8(0xE0, out[0]);
+}
+
+void test_reader_broker_replies() {
+  // CONNACK accepted, two PUBACKs and a PINGRESP back to back
+  const uint8_t stream[] = {0x20, 2, 0, 0, 0x40, 2, 0x12, 0x34, 0x40, 2, 0x00, 0x07, 0xD0, 0};
+  MqttReader reader;
+  mqttReaderReset(reader);
+  std::vector<MqttReader> packets = readAll(reader, stream, sizeof(stream));
+  TEST_ASSERT_EQUAL_size_t(4, packets.size());
+  TEST_ASSERT_EQUAL_UINT8(MQTT_CONNACK, packets[0].type);
+  TEST_ASSERT_EQUAL_UINT8(0, mqttConnackCode(packets[0]));
+  TEST_ASSERT_EQUAL_UINT8(MQTT_PUBACK, packets[1].type);
+  TEST_ASSERT_EQUAL_UINT16(0x1234, mqttPacketId(packets[1]));
+  TEST_ASSERT_EQUAL_UINT16(7, mqttPacketId(packets[2]));
+  TEST_ASSERT_EQUAL_UINT8(MQTT_PINGRESP, packets[3].type);
+
+  // Refused: bad credentials
+  const uint8_t refused[] = {0x20, 2, 0, 5};
+  packets = readAll(reader, refused, sizeof(refused));
+  TEST_ASSERT_EQUAL_size_t(1, packets.size());
+  TEST_ASSERT_EQUAL_UINT8(5, mqttConnackCode(packets[0]));
+}
+
+void test_reader_skips_long_packets() {
+  // An inbound PUBLISH with a 200-byte body (two length bytes), then a PUBACK
+  std::vector<uint8_t> stream = {0x30, 0xC8, 0x01};
+  stream.insert(stream.end(), 200, 0xAA);
+  const uint8_t puback[] = {0x40, 2, 0x00, 0x09};
+  stream.insert(stream.end(), puback, puback + sizeof(puback));
+
+  MqttReader reader;
+  mqttReaderReset(reader);
+  std::vector<MqttReader> packets = readAll(reader, stream.data(), stream.size());
+  TEST_ASSERT_EQUAL_size_t(2, packets.size());
+  TEST_ASSERT_EQUAL_UINT8(MQTT_PUBLISH, packets[0].type);
+  TEST_ASSERT_EQUAL_UINT32(200, packets[0].length);
+  TEST_ASSERT_EQUAL_UINT16(9, mqttPacketId(packets[1]));
+}
+
+// A publisher session against the stand-in: CONNECT, a window of QoS 1
+// PUBLISHes, each PUBACK matched back to its packet id
+void test_session_against_broker() {
+  uint8_t wire[1024];
+  size_t n = mqttEncodeConnect(wire, sizeof(wire), "door-1", "site", "secret", 30);
+  for (uint16_t id = 1; id <= 8; id++) {
+    char payload[64];
+    int len = snprintf(payload, sizeof(payload), "{\"seq\":%u,\"status\":\"allowed\"}", id);
+    size_t m = mqttEncodePublish(wire + n, sizeof(wire) - n, "site/taps", id, (const uint8_t*)payload, len, false);
+    TEST_ASSERT_TRUE(m > 0);
+    n += m;
+  }
+  n += mqttEncodeDisconnect(wire + n, sizeof(wire) - n);
+
+  std::vector<BrokerPacket> received = brokerParse(wire, n);
+  TEST_ASSERT_EQUAL_size_t(10, received.size());
+  TEST_ASSERT_EQUAL_UINT8(MQTT_CONNECT, received[0].type);
+  TEST_ASSERT_EQUAL_UINT8(MQTT_DISCONNECT, received[9].type);
+
+  // The broker acknowledges in reverse order; the publisher must match by id
+  std::vector<uint8_t> replies = {0x20, 2, 0, 0};
+  for (size_t i = 8; i >= 1; i--) {
+    const std::vector<uint8_t>& body = received[i].body;
+    size_t at = 0;
+    TEST_ASSERT_EQUAL_STRING("site/taps", brokerString(body, at).c_str());
+    replies.insert(replies.end(), {0x40, 2, body[at], body[at + 1]});
+  }
+
+  MqttReader reader;
+  mqttReaderReset(reader);
+  std::vector<MqttReader> acks = readAll(reader, replies.data(), replies.size());
+  TEST_ASSERT_EQUAL_size_t(9, acks.size());
+  TEST_ASSERT_EQUAL_UINT8(0, mqttConnackCode(acks[0]));
+  for (size_t i = 1; i < acks.size(); i++) {
+    TEST_ASSERT_EQUAL_UINT8(MQTT_PUBACK, acks[i].type);
+    TEST_ASSERT_EQUAL_UINT16(9 - i, mqttPacketId(acks[i]));
+  }
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_connect_bytes);
+  RUN_TEST(test_connect_credentials);
+  RUN_TEST(test_publish_qos1);
+  RUN_TEST(test_remaining_length_boundaries);
+  RUN_TEST(test_encoders_refuse_small_buffers);
+  RUN_TEST(test_reader_broker_replies);
+  RUN_TEST(test_reader_skips_long_packets);
+  RUN_TEST(test_session_against_broker);
+  return UNITY_END();
+}
@@ -0,0 +1,455 @@
+// PN532 detection on a host, against a simulated reader on the I2C bus:
+// command frames, ACKs, responses, the IRQ line and aborts. Also compares
+// idle reader traffic and detection delay of the three detection modes.
+// Run with: pio test -e native -f test_nfc_reader
+
+#include <unity.h>
+#include <deque>
+#include <vector>
+#include <Wire.h>
+#include "nfc_reader.h"
+
+#define IRQ_PIN 4
+#define READY_POLL_MS 20
+
+static const uint8_t ackFrame[6] = {0x00, 0x00, 0xFF, 0x00, 0xFF, 0x00};
+
+struct SimCard {
+  std::vector<uint8_t> uid;      // or the IDm for FeliCa
+  uint16_t atqa;
+  uint8_t sak;
+  bool felica;
+  std::vector<uint8_t> memory;   // NTAG user memory from page 4
+  std::vector<uint8_t> desfire;  // contents of the DESFire file
+};
+
+// A PN532 in I2C mode. Frames it has to say (ACKs, responses) queue up; the
+// first byte of every read is the ready status, and IRQ is low while one is queued.
+class SimPn532 : public HostI2cDevice {
+ public:
+  int irqPin = -1;
+  const SimCard* card = nullptr; // in the field
+  bool searching = false;
+  uint8_t searchBaud = 0;
+  bool corruptNext = false;      // damage the checksum of the next response
+  uint32_t badFrames = 0;        // frames from the host that failed a check
+  uint32_t aborts = 0;
+  std::vector<uint8_t> lastCommand;
+
+  void place(const SimCard* c) {
+    card = c;
+    answerSearch();
+  }
+
+  // A search with finite retries gave up without a card
+  void expireSearch() {
+    if (!searching)
+      return;
+    searching = false;
+    queueResponse(0x4A, {0x00});
+  }
+
+  bool receive(const uint8_t* data, size_t len) override {
+    if (len == sizeof(ackFrame) && memcmp(data, ackFrame, len) == 0) {
+      aborts++;
+      searching = false; // an answer already queued stays queued
+      return true;
+    }
+    // 00 00 FF LEN LCS D4 cmd... DCS 00
+    if (len < 8 || data[0] != 0x00 || data[1] != 0x00 || data[2] != 0xFF ||
+        (uint8_t)(data[3] + data[4]) != 0 || (size_t)data[3] + 7 != len || data[5] != 0xD4) {
+      badFrames++;
+      return true;
+    }
+    uint8_t sum = 0;
+    for (size_t i = 5; i < len - 1; i++)
+      sum += data[i];
+    if (sum != 0) {
+      badFrames++;
+      return true;
+    }
+
+    lastCommand.assign(data + 6, data + 5 + data[3]);
+    frames.push_back(std::vector<uint8_t>(ackFrame, ackFrame + sizeof(ackFrame)));
+    run(lastCommand);
+    updateIrq();
+    return true;
+  }
+
+  size_t respond(uint8_t* out, size_t len) override {
+    memset(out, 0, len);
+    if (frames.empty())
+      return len; // status byte 0: not ready
+    out[0] = 0x01;
+    if (len == 1)
+      return 1; // a status poll leaves the frame for the full read
+    const std::vector<uint8_t>& f = frames.front();
+    memcpy(out + 1, f.data(), min(f.size(), len - 1));
+    frames.pop_front();
+    updateIrq();
+    return len;
+  }
+
+  bool ready() const { return !frames.empty(); }
+
+ private:
+  void run(const std::vector<uint8_t>& cmd) {
+    switch (cmd[0]) {
+      case 0x4A: // InListPassiveTarget
+        searching = true;
+        searchBaud = cmd[2];
+        answerSearch();
+        break;
+      case 0x40: // InDataExchange
+        exchange(std::vector<uint8_t>(cmd.begin() + 2, cmd.end()));
+        break;
+      default:
+        queueResponse(cmd[0], {});
+        break;
+    }
+  }
+
+  void answerSearch() {
+    if (!searching || !card || card->felica != (searchBaud == 0x01))
+      return;
+    searching = false;
+    std::vector<uint8_t> data = {0x01, 0x01};
+    if (card->felica) {
+      data.insert(data.end(), {0x12, 0x01});
+      data.insert(data.end(), card->uid.begin(), card->uid.end());
+      data.insert(data.end(), 8, 0xAA); // PMm
+    } else {
+      data.insert(data.end(), {(uint8_t)(card->atqa >> 8), (uint8_t)card->atqa, card->sak, (uint8_t)card->uid.size()});
+      data.insert(data.end(), card->uid.begin(), card->uid.end());
+    }
+    queueResponse(0x4A, data);
+    updateIrq();
+  }
+
+  void exchange(const std::vector<uint8_t>& apdu) {
+    std::vector<uint8_t> reply = {0x00}; // PN532 status: success
+    if (!card) {
+      queueResponse(0x40, {0x01}); // timeout
+      return;
+    }
+    if (apdu[0] == 0x30 && !card->memory.empty()) { // NTAG READ: 4 pages
+      size_t at = (apdu[1] - 4) * 4;
+      for (size_t i = 0; i < 16; i++)
+        reply.push_back(at + i < card->memory.size() ? card->memory[at + i] : 0);
+    } else if (apdu[0] == 0x5A && !card->desfire.empty()) { // SelectApplication
+      reply.push_back(0x00);
+    } else if (apdu[0] == 0xBD && !card->desfire.empty()) { // ReadData
+      reply.push_back(0x00);
+      reply.insert(reply.end(), card->desfire.begin(), card->desfire.begin() + min((size_t)apdu[5], card->desfire.size()));
+    } else {
+      reply = {0x01};
+    }
+    queueResponse(0x40, reply);
+  }
+
+  // 00 00 FF LEN LCS D5 cmd+1 data... DCS 00
+  void queueResponse(uint8_t cmd, const std::vector<uint8_t>& data) {
+    uint8_t len = data.size() + 2;
+    std::vector<uint8_t> f = {0x00, 0x00, 0xFF, len, (uint8_t)(0x100 - len), 0xD5, (uint8_t)(cmd + 1)};
+    f.insert(f.end(), data.begin(), data.end());
+    uint8_t sum = 0;
+    for (size_t i = 5; i < f.size(); i++)
+      sum += f[i];
+    f.push_back((uint8_t)(0x100 - sum) + (corruptNext ? 1 : 0));
+    f.push_back(0x00);
+    corruptNext = false;
+    frames.push_back(f);
+  }
+
+  void updateIrq() {
+    if (irqPin >= 0)
+      hostPinWrite(irqPin, frames.empty() ? HIGH : LOW);
+  }
+
+  std::deque<std::vector<uint8_t>> frames;
+};
+
+static const SimCard classic = {{0xDE, 0xAD, 0xBE, 0xEF}, 0x0004, 0x08, false, {}, {}};
+static const SimCard ntag = {{0x04, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66}, 0x0044, 0x00, false,
+                             // CC-less user memory: NDEF TLV with one short Text record "emp-1234"
+                             {0x03, 0x0F, 0xD1, 0x01, 0x0B, 'T', 0x02, 'e', 'n',
+                              'e', 'm', 'p', '-', '1', '2', '3', '4', 0xFE},
+                             {}};
+static const SimCard blankNtag = {{0x04, 0x99, 0x88, 0x77, 0x66, 0x55, 0x44}, 0x0044, 0x00, false,
+                                  {0xFE}, {}};
+static const SimCard desfire = {{0x04, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06}, 0x0344, 0x20, false, {},
+                                {'B', 'A', 'D', 'G', 'E', '-', '0', '0', '4', '2', 0, 0, 0, 0, 0, 0}};
+static const SimCard felicaCard = {{0x01, 0x2E, 0x3C, 0x4D, 0x5E, 0x6F, 0x70, 0x81}, 0, 0, true, {}, {}};
+
+static SimPn532* sim = nullptr;
+static Adafruit_PN532 pn532;
+
+static NfcConfig config(bool eventDriven, int irqPin, bool felica = false, int desfireAid = 0) {
+  return NfcConfig{eventDriven, irqPin, READY_POLL_MS, felica, true, desfireAid, 1};
+}
+
+// Poll once a millisecond until a detection or the limit; returns the elapsed ms, or -1
+static int pollUntilDetected(NfcCredential& cred, int limitMs) {
+  for (int ms = 0; ms <= limitMs; ms++) {
+    if (nfcReaderPoll(cred, millis()))
+      return ms;
+    hostSkipMs(1);
+  }
+  return -1;
+}
+
+static void assertUid(const std::vector<uint8_t>& expected, const CardUid& uid) {
+  TEST_ASSERT_EQUAL_UINT8(expected.size(), uid.length);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected.data(), uid.bytes, expected.size());
+}
+
+void setUp() {
+  sim = new SimPn532();
+  Wire.device = sim;
+  hostPinWrite(IRQ_PIN, HIGH);
+  pn532.uidLength = 0;
+}
+
+void tearDown() {
+  Wire.device = nullptr;
+  delete sim;
+}
+
+void test_command_frames_are_well_formed() {
+  TEST_ASSERT_TRUE(nfcReaderBegin(pn532, config(true, -1, true)));
+  // RFConfiguration MaxRetries so FeliCa gets a turn
+  const uint8_t retries[] = {0x32, 0x05, 0xFF, 0x01, NFC_ALTERNATE_RETRIES};
+  TEST_ASSERT_EQUAL_size_t(sizeof(retries), sim->lastCommand.size());
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(retries, sim->lastCommand.data(), sizeof(retries));
+
+  NfcCredential cred;
+  TEST_ASSERT_FALSE(nfcReaderPoll(cred, millis()));
+  const uint8_t search[] = {0x4A, 0x01, 0x00};
+  TEST_ASSERT_EQUAL_size_t(sizeof(search), sim->lastCommand.size());
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(search, sim->lastCommand.data(), sizeof(search));
+  TEST_ASSERT_TRUE(sim->searching);
+  TEST_ASSERT_EQUAL_UINT32(0, sim->badFrames);
+  TEST_ASSERT_FALSE(sim->ready()); // the ACK was read
+}
+
+void test_ready_poll_detects_classic() {
+  TEST_ASSERT_TRUE(nfcReaderBegin(pn532, config(true, -1)));
+  TEST_ASSERT_EQUAL_UINT8(NFC_DETECT_READY, nfcReaderStats().mode);
+  NfcCredential cred;
+  NfcReaderStats before = nfcReaderStats();
+  TEST_ASSERT_FALSE(nfcReaderPoll(cred, millis()));
+  TEST_ASSERT_EQUAL_UINT32(before.arms + 1, nfcReaderStats().arms);
+
+  sim->place(&classic);
+  int ms = pollUntilDetected(cred, 100);
+  TEST_ASSERT_TRUE(ms >= 0 && ms <= READY_POLL_MS);
+  assertUid(classic.uid, cred.uid);
+  assertUid(classic.uid, cred.key);
+  TEST_ASSERT_EQUAL_UINT8(NFC_CARD_MIFARE_CLASSIC, cred.type);
+  TEST_ASSERT_EQUAL_HEX16(0x0004, cred.atqa);
+  TEST_ASSERT_EQUAL_HEX8(0x08, cred.sak);
+  TEST_ASSERT_EQUAL_UINT32(before.detections + 1, nfcReaderStats().detections);
+
+  // The next poll arms a new search
+  TEST_ASSERT_FALSE(sim->searching);
+  sim->place(nullptr);
+  nfcReaderPoll(cred, millis());
+  TEST_ASSERT_TRUE(sim->searching);
+}
+
+void test_irq_detects_without_bus_polling() {
+  TEST_ASSERT_TRUE(nfcReaderBegin(pn532, config(true, IRQ_PIN)));
+  sim->irqPin = IRQ_PIN;
+  TEST_ASSERT_EQUAL_UINT8(NFC_DETECT_IRQ, nfcReaderStats().mode);
+  NfcCredential cred;
+  nfcReaderPoll(cred, millis());
+
+  // Idle: no bus traffic at all while armed
+  uint32_t transactions = Wire.transactions;
+  for (int i = 0; i < 1000; i++)
+    TEST_ASSERT_FALSE(nfcReaderPoll(cred, millis()));
+  TEST_ASSERT_EQUAL_UINT32(transactions, Wire.transactions);
+
+  sim->place(&classic); // IRQ falls, the handler records the time
+  TEST_ASSERT_TRUE(nfcReaderPoll(cred, millis()));
+  assertUid(classic.uid, cred.uid);
+  TEST_ASSERT_EQUAL_UINT32(transactions + 1, Wire.transactions); // just the response read
+}
+
+void test_irq_already_low_when_armed() {
+  TEST_ASSERT_TRUE(nfcReaderBegin(pn532, config(true, IRQ_PIN)));
+  sim->irqPin = IRQ_PIN;
+  sim->card = &classic; // answers the search as soon as it is armed
+  NfcCredential cred;
+  TEST_ASSERT_TRUE(pollUntilDetected(cred, 5) >= 0);
+  assertUid(classic.uid, cred.uid);
+}
+
+void test_ntag_keyed_by_ndef_text() {
+  TEST_ASSERT_TRUE(nfcReaderBegin(pn532, config(true, -1)));
+  NfcTypeStats before = nfcTypeStats(NFC_CARD_NTAG);
+  NfcCredential cred;
+  nfcReaderPoll(cred, millis());
+  sim->place(&ntag);
+  TEST_ASSERT_TRUE(pollUntilDetected(cred, 100) >= 0);
+  TEST_ASSERT_EQUAL_UINT8(NFC_CARD_NTAG, cred.type);
+  assertUid(ntag.uid, cred.uid);
+
+  CardUid expected;
+  cardKeyTagged(CARD_KEY_NDEF, (const uint8_t*)"emp-1234", 8, expected);
+  TEST_ASSERT_TRUE(cardUidEquals(expected, cred.key));
+  TEST_ASSERT_EQUAL_UINT32(before.reads + 1, nfcTypeStats(NFC_CARD_NTAG).reads);
+  TEST_ASSERT_EQUAL_UINT32(before.fallbacks, nfcTypeStats(NFC_CARD_NTAG).fallbacks);
+}
+
+void test_ntag_without_ndef_falls_back_to_uid() {
+  TEST_ASSERT_TRUE(nfcReaderBegin(pn532, config(true, -1)));
+  NfcTypeStats before = nfcTypeStats(NFC_CARD_NTAG);
+  NfcCredential cred;
+  nfcReaderPoll(cred, millis());
+  sim->place(&blankNtag);
+  TEST_ASSERT_TRUE(pollUntilDetected(cred, 100) >= 0);
+  assertUid(blankNtag.uid, cred.key);
+  TEST_ASSERT_EQUAL_UINT32(before.fallbacks + 1, nfcTypeStats(NFC_CARD_NTAG).fallbacks);
+}
+
+void test_desfire_keyed_by_file() {
+  TEST_ASSERT_TRUE(nfcReaderBegin(pn532, config(true, -1, false, 0x123456)));
+  NfcCredential cred;
+  nfcReaderPoll(cred, millis());
+  sim->place(&desfire);
+  TEST_ASSERT_TRUE(pollUntilDetected(cred, 100) >= 0);
+  TEST_ASSERT_EQUAL_UINT8(NFC_CARD_DESFIRE, cred.type);
+
+  CardUid expected;
+  cardKeyTagged(CARD_KEY_DESFIRE, desfire.desfire.data(), NFC_DESFIRE_READ_LEN, expected);
+  TEST_ASSERT_TRUE(cardUidEquals(expected, cred.key));
+}
+
+void test_felica_gets_a_turn() {
+  TEST_ASSERT_TRUE(nfcReaderBegin(pn532, config(true, -1, true)));
+  NfcCredential cred;
+  nfcReaderPoll(cred, millis());
+  TEST_ASSERT_EQUAL_UINT8(0x00, sim->searchBaud);
+
+  // The ISO14443A search runs out of retries; the next one is FeliCa
+  sim->place(&felicaCard);
+  sim->expireSearch();
+  TEST_ASSERT_TRUE(pollUntilDetected(cred, 100) >= 0);
+  TEST_ASSERT_EQUAL_UINT8(NFC_CARD_FELICA, cred.type);
+  assertUid(felicaCard.uid, cred.uid);
+  CardUid expected;
+  cardKeyTagged(CARD_KEY_FELICA, felicaCard.uid.data(), 8, expected);
+  TEST_ASSERT_TRUE(cardUidEquals(expected, cred.key));
+}
+
+void test_bad_checksum_rearms() {
+  TEST_ASSERT_TRUE(nfcReaderBegin(pn532, config(true, -1)));
+  NfcCredential cred;
+  nfcReaderPoll(cred, millis());
+  NfcReaderStats before = nfcReaderStats();
+  sim->corruptNext = true;
+  sim->place(&classic);
+  TEST_ASSERT_EQUAL_INT(-1, pollUntilDetected(cred, READY_POLL_MS + 5));
+  TEST_ASSERT_EQUAL_UINT32(before.arms + 1, nfcReaderStats().arms); // searched again
+  TEST_ASSERT_TRUE(pollUntilDetected(cred, 100) >= 0);              // and the card answers that
+  assertUid(classic.uid, cred.uid);
+}
+
+void test_idle_cancels_search_and_drops_late_answer() {
+  TEST_ASSERT_TRUE(nfcReaderBegin(pn532, config(true, -1)));
+  NfcCredential cred;
+  nfcReaderPoll(cred, millis());
+  TEST_ASSERT_TRUE(sim->searching);
+
+  // A card answers just before the abort lands
+  sim->place(&classic);
+  nfcReaderIdle();
+  TEST_ASSERT_EQUAL_UINT32(1, sim->aborts);
+  TEST_ASSERT_TRUE(sim->ready());
+  nfcReaderIdle(); // not armed: nothing more is sent
+  TEST_ASSERT_EQUAL_UINT32(1, sim->aborts);
+
+  // Re-arming drops the stale answer rather than taking it for the ACK
+  sim->place(nullptr);
+  NfcReaderStats before = nfcReaderStats();
+  TEST_ASSERT_FALSE(nfcReaderPoll(cred, millis()));
+  TEST_ASSERT_EQUAL_UINT32(before.arms + 1, nfcReaderStats().arms);
+  TEST_ASSERT_TRUE(sim->searching);
+  TEST_ASSERT_FALSE(sim->ready());
+  TEST_ASSERT_EQUAL_INT(-1, pollUntilDetected(cred, 3 * READY_POLL_MS));
+}
+
+void test_poll_mode_uses_driver() {
+  TEST_ASSERT_TRUE(nfcReaderBegin(pn532, config(false, -1)));
+  TEST_ASSERT_EQUAL_UINT8(NFC_DETECT_POLL, nfcReaderStats().mode);
+  NfcCredential cred;
+  TEST_ASSERT_FALSE(nfcReaderPoll(cred, millis()));
+  memcpy(pn532.cardUid, classic.uid.data(), classic.uid.size());
+  pn532.uidLength = classic.uid.size();
+  TEST_ASSERT_TRUE(nfcReaderPoll(cred, millis()));
+  assertUid(classic.uid, cred.key);
+  TEST_ASSERT_EQUAL_UINT8(NFC_CARD_UNKNOWN, cred.type); // untyped without ATQA/SAK
+}
+
+// Reader transactions per idle second and placement-to-read delay per mode,
+// with the caller polling once a millisecond. The simulated poll mode returns
+// at once; on hardware each of its calls also blocks for up to NFC_POLL_TIMEOUT_MS.
+void test_detection_modes_benchmark() {
+  struct Mode {
+    const char* name;
+    bool eventDriven;
+    int irqPin;
+  } modes[] = {{"poll", false, -1}, {"ready_poll", true, -1}, {"irq", true, IRQ_PIN}};
+  uint32_t idleCalls[3];
+  char msg[160];
+  TEST_MESSAGE("mode         idle calls/s   detect ms   read us");
+
+  for (int m = 0; m < 3; m++) {
+    TEST_ASSERT_TRUE(nfcReaderBegin(pn532, config(modes[m].eventDriven, modes[m].irqPin)));
+    sim->irqPin = modes[m].irqPin;
+    sim->place(nullptr);
+    pn532.uidLength = 0;
+
+    // Two stats windows with no card; the first still holds the bring-up and arm
+    NfcCredential cred;
+    for (int ms = 0; ms <= 2 * NFC_STATS_WINDOW_MS; ms++) {
+      nfcReaderPoll(cred, millis());
+      hostSkipMs(1);
+    }
+    idleCalls[m] = nfcReaderStats().callsPerSec;
+
+    // Place a card halfway between ready polls
+    hostSkipMs(READY_POLL_MS / 2);
+    sim->place(&classic);
+    memcpy(pn532.cardUid, classic.uid.data(), classic.uid.size());
+    pn532.uidLength = classic.uid.size();
+    int detectMs = pollUntilDetected(cred, 1000);
+    TEST_ASSERT_TRUE(detectMs >= 0);
+
+    snprintf(msg, sizeof(msg), "%-10s   %12u   %9d   %7u", modes[m].name, (unsigned)idleCalls[m], detectMs,
+             (unsigned)nfcReaderStats().lastLatencyUs);
+    TEST_MESSAGE(msg);
+  }
+
+  TEST_ASSERT_EQUAL_UINT32(0, idleCalls[2]);
+  TEST_ASSERT_LESS_OR_EQUAL(1000 / READY_POLL_MS + 1, idleCalls[1]);
+  TEST_ASSERT_GREATER_THAN(idleCalls[1], idleCalls[0]);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_command_frames_are_well_formed);
+  RUN_TEST(test_ready_poll_detects_classic);
+  RUN_TEST(test_irq_detects_without_bus_polling);
+  RUN_TEST(test_irq_already_low_when_armed);
+  RUN_TEST(test_ntag_keyed_by_ndef_text);
+  RUN_TEST(test_ntag_without_ndef_falls_back_to_uid);
+  RUN_TEST(test_desfire_keyed_by_file);
+  RUN_TEST(test_felica_gets_a_turn);
+  RUN_TEST(test_bad_checksum_rearms);
+  RUN_TEST(test_idle_cancels_search_and_drops_late_answer);
+  RUN_TEST(test_poll_mode_uses_driver);
+  RUN_TEST(test_detection_modes_benchmark);
+  return UNITY_END();
+}
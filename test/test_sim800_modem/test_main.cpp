@@ -0,0 +1,287 @@
+// SIM800 driver on a host, against a scripted fake modem: bring-up, HTTP
+// POSTs, URC handling, timeouts and resets, all without a delay().
+// Run with: pio test -e native -f test_sim800_modem
+
+#include <unity.h>
+#include <string>
+#include <vector>
+#include "sim800_modem.h"
+
+#define APN "internet"
+
+// Answers AT commands the way a SIM800L does: echo until ATE0, results
+// framed by CR LF, DOWNLOAD then raw body for HTTPDATA, and the HTTPACTION
+// result as a later URC. Everything the driver wrote is kept for checks.
+class FakeModem : public Stream {
+ public:
+  std::vector<std::string> commands;
+  std::string body;                   // last HTTPDATA payload
+  std::vector<int> registration{1};   // successive +CREG stat values; the last one sticks
+  int bearer = 1;                     // +SAPBR status: 1 connected, 3 closed
+  int httpStatus = 200;
+  bool echo = true;
+  bool silent = false;                // powered off / wrong baud rate
+  bool holdAction = false;            // keep the +HTTPACTION URC back
+  bool splitReplies = false;          // hand out one byte per modemService() call
+
+  void releaseAction() { send("+HTTPACTION: 1," + std::to_string(httpStatus) + ",0"); }
+
+  size_t write(uint8_t c) override {
+    if (bodyExpected) {
+      body += (char)c;
+      if (--bodyExpected == 0)
+        send("OK");
+      return 1;
+    }
+    line += (char)c;
+    if (line.size() >= 2 && line.compare(line.size() - 2, 2, "\r\n") == 0) {
+      line.resize(line.size() - 2);
+      commands.push_back(line);
+      if (!silent)
+        respond(line);
+      line.clear();
+    }
+    return 1;
+  }
+
+  int available() override {
+    size_t left = rx.size() - rxPos;
+    if (!splitReplies)
+      return left;
+    starved = !starved; // every other call reports nothing, ending the driver's read loop
+    return starved ? 0 : min(left, (size_t)1);
+  }
+  int read() override { return rxPos < rx.size() ? (uint8_t)rx[rxPos++] : -1; }
+  int peek() override { return rxPos < rx.size() ? (uint8_t)rx[rxPos] : -1; }
+
+ private:
+  void send(const std::string& text) { rx += "\r\n" + text + "\r\n"; }
+
+  void respond(const std::string& cmd) {
+    if (echo)
+      rx += cmd + "\r";
+    if (cmd == "ATE0") {
+      echo = false;
+    } else if (cmd == "AT+CSQ") {
+      send("+CSQ: 18,0");
+    } else if (cmd == "AT+CREG?") {
+      int stat = registration.front();
+      if (registration.size() > 1)
+        registration.erase(registration.begin());
+      send("+CREG: 0," + std::to_string(stat));
+    } else if (cmd == "AT+CGATT?") {
+      send("+CGATT: 1");
+    } else if (cmd == "AT+SAPBR=2,1") {
+      send("+SAPBR: 1," + std::to_string(bearer) + ",\"10.20.30.40\"");
+    } else if (cmd == "AT+HTTPTERM") {
+      send("ERROR"); // no session open after power-up
+      return;
+    } else if (cmd.rfind("AT+HTTPDATA=", 0) == 0) {
+      bodyExpected = atoi(cmd.c_str() + 12);
+      body.clear();
+      send("DOWNLOAD");
+      return;
+    } else if (cmd == "AT+HTTPACTION=1") {
+      send("OK");
+      if (!holdAction)
+        releaseAction();
+      return;
+    }
+    send("OK");
+  }
+
+  std::string line;
+  std::string rx;
+  size_t rxPos = 0;
+  size_t bodyExpected = 0;
+  bool starved = true;
+};
+
+static FakeModem* modem = nullptr;
+
+// Let the driver and the fake talk until nothing more happens
+static void pump() {
+  for (int i = 0; i < 64; i++)
+    modemService(millis());
+}
+
+static bool sent(const char* command) {
+  for (const std::string& c : modem->commands) {
+    if (c == command)
+      return true;
+  }
+  return false;
+}
+
+static void bringUp() {
+  modemBegin(*modem, APN);
+  pump();
+  TEST_ASSERT_TRUE(modemReady());
+  modem->commands.clear();
+}
+
+void setUp() {
+  modem = new FakeModem();
+}
+
+void tearDown() {
+  delete modem;
+}
+
+void test_bring_up_sequence() {
+  modem->registration = {2, 2, 5}; // searching twice, then roaming
+  modemBegin(*modem, APN);
+  pump();
+  TEST_ASSERT_EQUAL_STRING("registration", modemStateName(modemStats().state));
+  TEST_ASSERT_EQUAL_INT8(18, modemStats().rssi);
+
+  // Registration is polled, never waited for
+  hostSkipMs(MODEM_REG_POLL_MS);
+  pump();
+  TEST_ASSERT_FALSE(modemReady());
+  hostSkipMs(MODEM_REG_POLL_MS);
+  pump();
+  TEST_ASSERT_TRUE(modemReady());
+
+  static const char* const expected[] = {
+    "AT", "ATE0", "AT+CSQ", "AT+CREG?", "AT+CREG?", "AT+CREG?", "AT+CGATT?",
+    "AT+SAPBR=3,1,\"CONTYPE\",\"GPRS\"", "AT+SAPBR=3,1,\"APN\",\"" APN "\"", "AT+SAPBR=1,1",
+    "AT+SAPBR=2,1", "AT+HTTPTERM", "AT+HTTPINIT", "AT+HTTPPARA=\"CID\",1",
+  };
+  TEST_ASSERT_EQUAL_size_t(sizeof(expected) / sizeof(expected[0]), modem->commands.size());
+  for (size_t i = 0; i < modem->commands.size(); i++)
+    TEST_ASSERT_EQUAL_STRING(expected[i], modem->commands[i].c_str());
+
+  ModemStats s = modemStats();
+  TEST_ASSERT_TRUE(s.registered);
+  TEST_ASSERT_TRUE(s.bearerUp);
+}
+
+void test_http_post_and_session_reuse() {
+  bringUp();
+  ModemStats before = modemStats();
+  const char* body = "batch-1";
+  TEST_ASSERT_TRUE(modemHttpPost("http://example.org/events", "text/plain", (const uint8_t*)body, strlen(body)));
+  TEST_ASSERT_FALSE(modemHttpPost("http://example.org/events", "text/plain", (const uint8_t*)body, 7)); // busy
+  TEST_ASSERT_EQUAL_INT(0, modemHttpResult());
+  pump();
+  TEST_ASSERT_EQUAL_INT(200, modemHttpResult());
+  TEST_ASSERT_TRUE(modemReady());
+  TEST_ASSERT_EQUAL_STRING("batch-1", modem->body.c_str());
+  TEST_ASSERT_TRUE(sent("AT+HTTPPARA=\"URL\",\"http://example.org/events\""));
+  TEST_ASSERT_TRUE(sent("AT+HTTPPARA=\"CONTENT\",\"text/plain\""));
+  TEST_ASSERT_TRUE(sent("AT+HTTPDATA=7,10000"));
+  TEST_ASSERT_EQUAL_UINT32(before.requests + 1, modemStats().requests);
+
+  // Same URL and type: only the body and the action go out
+  modem->commands.clear();
+  TEST_ASSERT_TRUE(modemHttpPost("http://example.org/events", "text/plain", (const uint8_t*)"b2", 2));
+  pump();
+  TEST_ASSERT_EQUAL_INT(200, modemHttpResult());
+  TEST_ASSERT_EQUAL_size_t(2, modem->commands.size());
+  TEST_ASSERT_EQUAL_STRING("AT+HTTPDATA=2,10000", modem->commands[0].c_str());
+  TEST_ASSERT_EQUAL_STRING("AT+HTTPACTION=1", modem->commands[1].c_str());
+  TEST_ASSERT_EQUAL_STRING("b2", modem->body.c_str());
+}
+
+void test_action_result_arrives_later() {
+  bringUp();
+  modem->holdAction = true;
+  modem->httpStatus = 503;
+  ModemStats before = modemStats();
+  TEST_ASSERT_TRUE(modemHttpPost("http://example.org/events", "text/plain", (const uint8_t*)"x", 1));
+  pump();
+  TEST_ASSERT_EQUAL_INT(0, modemHttpResult());
+  TEST_ASSERT_EQUAL_STRING("http_action", modemStateName(modemStats().state));
+
+  // The server takes a while; the driver keeps returning straight away
+  hostSkipMs(MODEM_ACTION_TIMEOUT_MS / 2);
+  pump();
+  modem->releaseAction();
+  pump();
+  TEST_ASSERT_EQUAL_INT(503, modemHttpResult());
+  TEST_ASSERT_EQUAL_UINT32(before.failures + 1, modemStats().failures);
+  TEST_ASSERT_TRUE(modemReady());
+}
+
+void test_network_error_rechecks_bearer() {
+  bringUp();
+  modem->httpStatus = 601; // SIM800 network error
+  modem->bearer = 3;       // and the bearer is gone
+  ModemStats before = modemStats();
+  TEST_ASSERT_TRUE(modemHttpPost("http://example.org/events", "text/plain", (const uint8_t*)"x", 1));
+  pump();
+  TEST_ASSERT_EQUAL_INT(601, modemHttpResult());
+  TEST_ASSERT_TRUE(sent("AT+SAPBR=2,1"));
+  TEST_ASSERT_EQUAL_STRING("reset_wait", modemStateName(modemStats().state));
+  TEST_ASSERT_EQUAL_UINT32(before.resets + 1, modemStats().resets);
+
+  // After the back-off the bring-up runs again and the bearer comes back
+  modem->bearer = 1;
+  hostSkipMs(MODEM_RESET_BACKOFF_MS);
+  pump();
+  TEST_ASSERT_TRUE(modemReady());
+}
+
+void test_action_timeout_fails_request() {
+  bringUp();
+  modem->holdAction = true;
+  TEST_ASSERT_TRUE(modemHttpPost("http://example.org/events", "text/plain", (const uint8_t*)"x", 1));
+  pump();
+  hostSkipMs(MODEM_ACTION_TIMEOUT_MS);
+  pump();
+  TEST_ASSERT_EQUAL_INT(MODEM_RESULT_TIMEOUT, modemHttpResult());
+  TEST_ASSERT_EQUAL_STRING("reset_wait", modemStateName(modemStats().state));
+}
+
+void test_silent_modem_backs_off() {
+  modem->silent = true;
+  ModemStats before = modemStats();
+  modemBegin(*modem, APN);
+  for (int i = 0; i < MODEM_PROBE_ATTEMPTS; i++) {
+    pump();
+    hostSkipMs(MODEM_CMD_TIMEOUT_MS);
+  }
+  pump();
+  TEST_ASSERT_EQUAL_size_t(MODEM_PROBE_ATTEMPTS, modem->commands.size());
+  TEST_ASSERT_EQUAL_STRING("reset_wait", modemStateName(modemStats().state));
+  TEST_ASSERT_EQUAL_UINT32(before.resets + 1, modemStats().resets);
+
+  modem->silent = false;
+  hostSkipMs(MODEM_RESET_BACKOFF_MS);
+  pump();
+  TEST_ASSERT_TRUE(modemReady());
+}
+
+void test_replies_split_across_reads() {
+  modem->splitReplies = true; // one byte per service call
+  modemBegin(*modem, APN);
+  for (int i = 0; i < 2000 && !modemReady(); i++)
+    modemService(millis());
+  TEST_ASSERT_TRUE(modemReady());
+  TEST_ASSERT_EQUAL_INT8(18, modemStats().rssi);
+}
+
+void test_cellular_transport_url() {
+  bringUp();
+  const uint8_t body[] = {1, 2, 3};
+  TEST_ASSERT_TRUE(cellularTransport.available());
+  TEST_ASSERT_TRUE(cellularTransport.start("10.0.0.5", 8080, body, sizeof(body)));
+  pump();
+  TEST_ASSERT_EQUAL_INT(200, cellularTransport.poll());
+  TEST_ASSERT_TRUE(sent("AT+HTTPPARA=\"URL\",\"http://10.0.0.5:8080" UPLOAD_PATH "\""));
+  TEST_ASSERT_TRUE(sent("AT+HTTPPARA=\"CONTENT\",\"" UPLOAD_CONTENT_TYPE "\""));
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_bring_up_sequence);
+  RUN_TEST(test_http_post_and_session_reuse);
+  RUN_TEST(test_action_result_arrives_later);
+  RUN_TEST(test_network_error_rechecks_bearer);
+  RUN_TEST(test_action_timeout_fails_request);
+  RUN_TEST(test_silent_modem_backs_off);
+  RUN_TEST(test_replies_split_across_reads);
+  RUN_TEST(test_cellular_transport_url);
+  return UNITY_END();
+}